@@ -8,6 +8,7 @@
 #ifndef NFCXX_NETMSG_H
 #define NFCXX_NETMSG_H
 
+#include "bitstream.h"
 #include "public.h"
 
 /*
@@ -15,6 +16,11 @@
 
    CBinaryPackage
 
+   Для длинных серий мелких полей вместо WriteBits/nReadBits удобнее
+   CBitWriter/CBitReader: BeginBitWriting отдаёт писателю текущую
+   позицию пакета, EndBitWriting возвращает её обратно. Между ними
+   пакет напрямую не трогаем.
+
 ===========================================================================
 */
 
@@ -82,6 +88,12 @@ class CBinaryPackage
     void BeginReading() const;
     void ReadByteAlign() const;
     int nReadBits(int nBits) const;
+
+    void BeginBitWriting(CBitWriter &writer);
+    void EndBitWriting(CBitWriter &writer);
+    void BeginBitReading(CBitReader &reader) const;
+    void EndBitReading(const CBitReader &reader) const;
+
     void SetHasChanged(bool b)
     {
         bChanged = b;
@@ -101,6 +113,11 @@ class CBinaryPackage
     void WriteFloat(float f);
     void WriteString(const char *szBuffer, size_t nBufferSize);
     void WriteData(const void *pData, size_t nLength);
+    void WriteVarUInt32(uint32 c);
+    void WriteVarUInt64(uint64 c);
+    void WriteVarInt32(int32 c);
+    void WriteVarInt64(int64 c);
+    void WriteGamma(uint32 c);
 
     bool ReadBool(bool &c) const;
     int8 ReadInt8(int8 &c) const;
@@ -112,10 +129,181 @@ class CBinaryPackage
     float ReadFloat(float &f) const;
     int ReadString(char *szBuffer, size_t nBufferSize) const;
     int ReadData(void *pData, size_t nLength) const;
+    uint32 ReadVarUInt32(uint32 &c) const;
+    uint64 ReadVarUInt64(uint64 &c) const;
+    int32 ReadVarInt32(int32 &c) const;
+    int64 ReadVarInt64(int64 &c) const;
+    uint32 ReadGamma(uint32 &c) const;
+    bool ReadVarUInt32Array(uint32 *pValues, int nCount) const;
+    bool ReadVarInt32Array(int32 *pValues, int nCount) const;
 
   private:
     bool CheckOverflow(int nBits);
     ubyte *GetByteSpace(int nLength);
 };
 
+inline void CBinaryPackage::BeginBitWriting(CBitWriter &writer)
+{
+    writer.Init(pWriteData, (int)nAllocatedSize, (int)(nCurrentSize * 8 + nWriteBit));
+}
+
+inline void CBinaryPackage::EndBitWriting(CBitWriter &writer)
+{
+    // при переполнении пакет помечается и сбрасывается так же, как в WriteBits, без ошибки
+    if (writer.IsOverflowed())
+    {
+        bOverflowed = true;
+        nCurrentSize = 0;
+        nWriteBit = 0;
+        temp = 0;
+        return;
+    }
+
+    writer.Flush();
+
+    int iBit = writer.GetBitIndex();
+    nCurrentSize = iBit >> 3;
+    nWriteBit = iBit & 7;
+    temp = nWriteBit ? pWriteData[nCurrentSize] : 0;
+}
+
+inline void CBinaryPackage::BeginBitReading(CBitReader &reader) const
+{
+    reader.Init(nReadData, (int)nCurrentSize, GetNumBitsRead());
+}
+
+inline void CBinaryPackage::EndBitReading(const CBitReader &reader) const
+{
+    int iBit = reader.GetBitIndex();
+    nReadCount = (iBit + 7) >> 3;
+    nReadBit = iBit & 7;
+}
+
+inline void CBinaryPackage::WriteData(const void *pData, size_t nLength)
+{
+    CBitWriter writer;
+    BeginBitWriting(writer);
+    writer.WriteBytes(pData, (int)nLength);
+    EndBitWriting(writer);
+}
+
+inline int CBinaryPackage::ReadData(void *pData, size_t nLength) const
+{
+    CBitReader reader;
+    BeginBitReading(reader);
+    reader.ReadBytes(pData, (int)nLength);
+    if (reader.IsOverflowed())
+        return -1;
+
+    EndBitReading(reader);
+    return (int)nLength;
+}
+
+/*
+===========================================================================
+
+   Целые переменной длины (см. bitstream.h). Ошибка чтения - выход за
+   пределы или испорченное число - возвращает 0 и не двигает позицию.
+
+===========================================================================
+*/
+inline void CBinaryPackage::WriteVarUInt64(uint64 c)
+{
+    CBitWriter writer;
+    BeginBitWriting(writer);
+    writer.WriteVarUInt(c);
+    EndBitWriting(writer);
+}
+
+inline void CBinaryPackage::WriteVarUInt32(uint32 c)
+{
+    WriteVarUInt64(c);
+}
+
+inline void CBinaryPackage::WriteVarInt32(int32 c)
+{
+    WriteVarUInt64(ZigZagEncode32(c));
+}
+
+inline void CBinaryPackage::WriteVarInt64(int64 c)
+{
+    WriteVarUInt64(ZigZagEncode64(c));
+}
+
+inline void CBinaryPackage::WriteGamma(uint32 c)
+{
+    CBitWriter writer;
+    BeginBitWriting(writer);
+    writer.WriteGamma(c);
+    EndBitWriting(writer);
+}
+
+inline uint64 CBinaryPackage::ReadVarUInt64(uint64 &c) const
+{
+    CBitReader reader;
+    BeginBitReading(reader);
+    c = reader.ReadVarUInt();
+    if (!reader.IsOverflowed())
+        EndBitReading(reader);
+    return c;
+}
+
+inline uint32 CBinaryPackage::ReadVarUInt32(uint32 &c) const
+{
+    CBitReader reader;
+    BeginBitReading(reader);
+    uint64 iValue = reader.ReadVarUInt(VARINT_MAX_GROUPS_32);
+    c = iValue <= 0xFFFFFFFFull ? (uint32)iValue : 0;
+    if (!reader.IsOverflowed() && iValue <= 0xFFFFFFFFull)
+        EndBitReading(reader);
+    return c;
+}
+
+inline int32 CBinaryPackage::ReadVarInt32(int32 &c) const
+{
+    uint32 iValue;
+    c = ZigZagDecode32(ReadVarUInt32(iValue));
+    return c;
+}
+
+inline int64 CBinaryPackage::ReadVarInt64(int64 &c) const
+{
+    uint64 iValue;
+    c = ZigZagDecode64(ReadVarUInt64(iValue));
+    return c;
+}
+
+inline uint32 CBinaryPackage::ReadGamma(uint32 &c) const
+{
+    CBitReader reader;
+    BeginBitReading(reader);
+    c = reader.ReadGamma();
+    if (!reader.IsOverflowed())
+        EndBitReading(reader);
+    return c;
+}
+
+// массив читается одним проходом: одна проверка границы на число, пока далеко до конца
+inline bool CBinaryPackage::ReadVarUInt32Array(uint32 *pValues, int nCount) const
+{
+    CBitReader reader;
+    BeginBitReading(reader);
+    if (!reader.ReadVarUIntArray(pValues, nCount))
+        return false;
+
+    EndBitReading(reader);
+    return true;
+}
+
+inline bool CBinaryPackage::ReadVarInt32Array(int32 *pValues, int nCount) const
+{
+    CBitReader reader;
+    BeginBitReading(reader);
+    if (!reader.ReadVarIntArray(pValues, nCount))
+        return false;
+
+    EndBitReading(reader);
+    return true;
+}
+
 #endif //!__NETMSG__H__
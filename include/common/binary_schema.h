@@ -0,0 +1,308 @@
+/*
+  This file associated with Hayato Labs project.
+
+  For license and copyright information please follow this link:
+  https://github.com/hayatolabs/general/blob/main/LEGAL
+*/
+
+#ifndef HAYATOLABS_BINARY_SCHEMA_H
+#define HAYATOLABS_BINARY_SCHEMA_H
+
+#include "binary_package.h"
+#include <type_traits>
+
+/*
+===========================================================================
+
+   Схемы сериализации для CBinaryPackage
+
+   Структура один раз перечисляет свои поля, а код записи и чтения
+   разворачивается шаблонами в линейную последовательность сдвигов.
+   Размер сообщения в битах известен при компиляции, поэтому место в
+   пакете проверяется один раз на всё сообщение.
+
+      struct playerstate_t
+      {
+          int32 m_iHealth;
+          float m_flSpeed;
+          uint8 m_nFlags;
+
+          typedef CSchema<SCHEMA_FIELD_BITS(playerstate_t, m_iHealth, 10),
+                          SCHEMA_FIELD(playerstate_t, m_flSpeed),
+                          SCHEMA_FIELD(playerstate_t, m_nFlags)> schema_t;
+      };
+
+      SchemaWrite(package, state);
+      SchemaRead(package, state);
+
+   Поля: целые (до 64 бит), bool, enum, float, double и структуры со
+   своей схемой. Для типа, который нельзя изменить, схему задаёт
+   специализация CSchemaOf<T>.
+
+===========================================================================
+*/
+
+template <typename T> struct SchemaVoid
+{
+    typedef void type;
+};
+
+template <typename T, typename = void> struct CSchemaOf
+{
+};
+
+template <typename T> struct CSchemaOf<T, typename SchemaVoid<typename T::schema_t>::type>
+{
+    typedef typename T::schema_t schema_t;
+};
+
+template <typename T> struct SchemaHasFields
+{
+    template <typename U> static char Test(typename CSchemaOf<U>::schema_t *);
+    template <typename U> static int Test(...);
+    static const bool VALUE = sizeof(Test<T>(0)) == 1;
+};
+
+enum schemavaluekind_t
+{
+    SCHEMA_INTEGER,
+    SCHEMA_INTEGER64,
+    SCHEMA_FLOAT,
+    SCHEMA_DOUBLE,
+    SCHEMA_NESTED,
+};
+
+template <typename M> struct SchemaKind
+{
+    static const schemavaluekind_t VALUE =
+        SchemaHasFields<M>::VALUE                      ? SCHEMA_NESTED
+        : std::is_same<M, float>::value                ? SCHEMA_FLOAT
+        : std::is_same<M, double>::value               ? SCHEMA_DOUBLE
+        : (std::is_integral<M>::value || std::is_enum<M>::value) && sizeof(M) == 8 ? SCHEMA_INTEGER64
+                                                                                   : SCHEMA_INTEGER;
+};
+
+/*
+===========================================================================
+
+   CSchemaValue - запись и чтение одного значения фиксированной ширины
+
+===========================================================================
+*/
+template <typename M, int nBits, schemavaluekind_t iKind = SchemaKind<M>::VALUE> struct CSchemaValue;
+
+template <typename M, int nBits> struct CSchemaValue<M, nBits, SCHEMA_INTEGER>
+{
+    static_assert(std::is_integral<M>::value || std::is_enum<M>::value, "unsupported schema field type");
+    static_assert(nBits > 0 && nBits <= (int)sizeof(M) * 8, "bad schema field width");
+
+    static void Write(CBitWriter &writer, const M &value)
+    {
+        writer.Append((uint32)value, nBits);
+    }
+    static void Read(CBitReader &reader, M &value)
+    {
+        uint32 iValue = reader.TakeBits(nBits);
+        if (std::is_signed<M>::value && nBits < 32 && (iValue & BIT(nBits - 1)))
+            iValue |= ~BitMask32(nBits);
+        value = (M)iValue;
+    }
+};
+
+template <typename M, int nBits> struct CSchemaValue<M, nBits, SCHEMA_INTEGER64>
+{
+    static_assert(nBits > 0 && nBits <= 64, "bad schema field width");
+
+    static void Write(CBitWriter &writer, const M &value)
+    {
+        uint64 iValue = (uint64)value;
+        writer.Append((uint32)iValue, nBits < 32 ? nBits : 32);
+        if (nBits > 32)
+            writer.Append((uint32)(iValue >> 32), nBits - 32);
+    }
+    static void Read(CBitReader &reader, M &value)
+    {
+        uint64 iValue = reader.TakeBits(nBits < 32 ? nBits : 32);
+        if (nBits > 32)
+            iValue |= (uint64)reader.TakeBits(nBits - 32) << 32;
+        if (std::is_signed<M>::value && nBits < 64 && (iValue & BIT(nBits - 1)))
+            iValue |= ~((BIT(nBits - 1) << 1) - 1);
+        value = (M)iValue;
+    }
+};
+
+template <typename M, int nBits> struct CSchemaValue<M, nBits, SCHEMA_FLOAT>
+{
+    static_assert(nBits == 32, "float schema fields are 32 bits");
+
+    static void Write(CBitWriter &writer, const M &value)
+    {
+        uint32 iValue;
+        memcpy(&iValue, &value, 4);
+        writer.Append(iValue, 32);
+    }
+    static void Read(CBitReader &reader, M &value)
+    {
+        uint32 iValue = reader.TakeBits(32);
+        memcpy(&value, &iValue, 4);
+    }
+};
+
+template <typename M, int nBits> struct CSchemaValue<M, nBits, SCHEMA_DOUBLE>
+{
+    static_assert(nBits == 64, "double schema fields are 64 bits");
+
+    static void Write(CBitWriter &writer, const M &value)
+    {
+        uint64 iValue;
+        memcpy(&iValue, &value, 8);
+        CSchemaValue<uint64, 64>::Write(writer, iValue);
+    }
+    static void Read(CBitReader &reader, M &value)
+    {
+        uint64 iValue;
+        CSchemaValue<uint64, 64>::Read(reader, iValue);
+        memcpy(&value, &iValue, 8);
+    }
+};
+
+template <typename M, int nBits> struct CSchemaValue<M, nBits, SCHEMA_NESTED>
+{
+    typedef typename CSchemaOf<M>::schema_t schema_t;
+    static_assert(nBits == schema_t::BITS, "nested schema field width must match its schema");
+
+    static void Write(CBitWriter &writer, const M &value)
+    {
+        schema_t::WriteFields(writer, value);
+    }
+    static void Read(CBitReader &reader, M &value)
+    {
+        schema_t::ReadFields(reader, value);
+    }
+};
+
+// ширина по умолчанию: вложенная схема целиком, bool - бит, остальное - размер типа
+template <typename M, bool bNested = SchemaHasFields<M>::VALUE> struct SchemaDefaultBits
+{
+    static const int VALUE = std::is_same<M, bool>::value ? 1 : (int)sizeof(M) * 8;
+};
+
+template <typename M> struct SchemaDefaultBits<M, true>
+{
+    static const int VALUE = CSchemaOf<M>::schema_t::BITS;
+};
+
+/*
+===========================================================================
+
+   CSchemaField - поле pMember структуры C шириной nBits
+
+===========================================================================
+*/
+template <typename C, typename M, M C::*pMember, int nBits> struct CSchemaField
+{
+    static const int BITS = nBits;
+
+    static void Write(CBitWriter &writer, const C &value)
+    {
+        CSchemaValue<M, nBits>::Write(writer, value.*pMember);
+    }
+    static void Read(CBitReader &reader, C &value)
+    {
+        CSchemaValue<M, nBits>::Read(reader, value.*pMember);
+    }
+};
+
+#define SCHEMA_FIELD_BITS(type, member, bits)                                                                          \
+    CSchemaField<type, decltype(((type *)0)->member), &type::member, bits>
+#define SCHEMA_FIELD(type, member)                                                                                     \
+    SCHEMA_FIELD_BITS(type, member, SchemaDefaultBits<decltype(((type *)0)->member)>::VALUE)
+
+/*
+===========================================================================
+
+   CSchema - список полей. WriteFields/ReadFields не проверяют место,
+   это делают SchemaWrite/SchemaRead один раз на сообщение.
+
+===========================================================================
+*/
+template <typename... Fields> struct CSchema;
+
+template <> struct CSchema<>
+{
+    static const int BITS = 0;
+
+    template <typename T> static void WriteFields(CBitWriter &, const T &)
+    {
+    }
+    template <typename T> static void ReadFields(CBitReader &, T &)
+    {
+    }
+};
+
+template <typename First, typename... Rest> struct CSchema<First, Rest...>
+{
+    static const int BITS = First::BITS + CSchema<Rest...>::BITS;
+
+    template <typename T> static void WriteFields(CBitWriter &writer, const T &value)
+    {
+        First::Write(writer, value);
+        CSchema<Rest...>::WriteFields(writer, value);
+    }
+    template <typename T> static void ReadFields(CBitReader &reader, T &value)
+    {
+        First::Read(reader, value);
+        CSchema<Rest...>::ReadFields(reader, value);
+    }
+};
+
+/*
+===========================================================================
+
+   SchemaWrite/SchemaRead - сериализация nCount значений подряд.
+   При нехватке места запись переводит пакет в состояние переполнения,
+   как WriteBits, а чтение возвращает false и не двигает позицию.
+
+===========================================================================
+*/
+template <typename T> inline bool SchemaWrite(CBinaryPackage &package, const T *pValues, int nCount)
+{
+    typedef typename CSchemaOf<T>::schema_t schema_t;
+
+    CBitWriter writer;
+    package.BeginBitWriting(writer);
+    if (writer.Reserve(schema_t::BITS * nCount))
+    {
+        for (int i = 0; i < nCount; i++)
+            schema_t::WriteFields(writer, pValues[i]);
+    }
+    package.EndBitWriting(writer);
+    return !writer.IsOverflowed();
+}
+
+template <typename T> inline bool SchemaRead(const CBinaryPackage &package, T *pValues, int nCount)
+{
+    typedef typename CSchemaOf<T>::schema_t schema_t;
+
+    CBitReader reader;
+    package.BeginBitReading(reader);
+    if (reader.GetRemainingBits() < schema_t::BITS * nCount)
+        return false;
+
+    for (int i = 0; i < nCount; i++)
+        schema_t::ReadFields(reader, pValues[i]);
+    package.EndBitReading(reader);
+    return true;
+}
+
+template <typename T> inline bool SchemaWrite(CBinaryPackage &package, const T &value)
+{
+    return SchemaWrite(package, &value, 1);
+}
+
+template <typename T> inline bool SchemaRead(const CBinaryPackage &package, T &value)
+{
+    return SchemaRead(package, &value, 1);
+}
+
+#endif /* HAYATOLABS_BINARY_SCHEMA_H */
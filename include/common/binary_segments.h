@@ -0,0 +1,470 @@
+/*
+  This file associated with Hayato Labs project.
+
+  For license and copyright information please follow this link:
+  https://github.com/hayatolabs/general/blob/main/LEGAL
+*/
+
+#ifndef HAYATOLABS_BINARY_SEGMENTS_H
+#define HAYATOLABS_BINARY_SEGMENTS_H
+
+#include "bitstream.h"
+#include "mem.h"
+#include "thread.h"
+
+#ifndef _WIN32
+#include <sys/uio.h>
+#endif
+
+#define PACKAGE_SEGMENT_SIZE 4096
+#define PACKAGE_SEGMENT_POOL_MAX 1024 // свободных сегментов держим не больше
+
+/*
+===========================================================================
+
+   packageiovec_t - элемент списка для отправки без склейки:
+   struct iovec для writev/sendmsg, на Windows раскладка WSABUF
+   для WSASend.
+
+===========================================================================
+*/
+#ifdef _WIN32
+struct packageiovec_t
+{
+    ULONG len;
+    CHAR *buf;
+};
+
+inline void PackageIovec_Set(packageiovec_t &vec, const void *pData, size_t nLength)
+{
+    vec.len = (ULONG)nLength;
+    vec.buf = (CHAR *)pData;
+}
+#else
+typedef struct iovec packageiovec_t;
+
+inline void PackageIovec_Set(packageiovec_t &vec, const void *pData, size_t nLength)
+{
+    vec.iov_base = (void *)pData;
+    vec.iov_len = nLength;
+}
+#endif
+
+/*
+===========================================================================
+
+   CPackageSegmentPool - сегменты по PACKAGE_SEGMENT_SIZE байт.
+   Освобождённые сегменты остаются в списке и выдаются повторно,
+   так что пакеты в установившемся режиме память не выделяют.
+   Мьютекс пула охраняет только список, общая зона берётся под
+   MemGeneralZoneMutex и вне мьютекса пула.
+
+===========================================================================
+*/
+class CPackageSegmentPool
+{
+  public:
+    CPackageSegmentPool() : m_pFree(NULL), m_nFree(0)
+    {
+    }
+    ~CPackageSegmentPool();
+
+    ubyte *Alloc();
+    void Free(ubyte *pSegment);
+
+    int GetNumFree() const
+    {
+        return m_nFree;
+    }
+
+  private:
+    struct freesegment_t
+    {
+        freesegment_t *m_pNext;
+    };
+
+    CSystemMutex m_Mutex;
+    freesegment_t *m_pFree;
+    int m_nFree;
+
+    CPackageSegmentPool(const CPackageSegmentPool &s)
+    {
+    }
+    void operator=(const CPackageSegmentPool &s)
+    {
+    }
+};
+
+inline CPackageSegmentPool::~CPackageSegmentPool()
+{
+    freesegment_t *pFree;
+    {
+        CScopedCriticalSection lock(m_Mutex);
+        pFree = m_pFree;
+        m_pFree = NULL;
+        m_nFree = 0;
+    }
+
+    CScopedCriticalSection lock(MemGeneralZoneMutex());
+    while (pFree)
+    {
+        freesegment_t *pNext = pFree->m_pNext;
+        g_pMemoryManager->Free(pFree);
+        pFree = pNext;
+    }
+}
+
+inline ubyte *CPackageSegmentPool::Alloc()
+{
+    {
+        CScopedCriticalSection lock(m_Mutex);
+        if (m_pFree)
+        {
+            freesegment_t *pSegment = m_pFree;
+            m_pFree = pSegment->m_pNext;
+            m_nFree--;
+            return (ubyte *)pSegment;
+        }
+    }
+
+    // общую зону m_Mutex не охраняет: она одна на все потоки и подсистемы
+    CScopedCriticalSection lock(MemGeneralZoneMutex());
+    return (ubyte *)g_pMemoryManager->Malloc(PACKAGE_SEGMENT_SIZE, TAG_PACKAGE);
+}
+
+inline void CPackageSegmentPool::Free(ubyte *pSegment)
+{
+    if (!pSegment)
+        return;
+
+    {
+        CScopedCriticalSection lock(m_Mutex);
+        if (m_nFree < PACKAGE_SEGMENT_POOL_MAX)
+        {
+            freesegment_t *pFree = (freesegment_t *)pSegment;
+            pFree->m_pNext = m_pFree;
+            m_pFree = pFree;
+            m_nFree++;
+            return;
+        }
+    }
+
+    CScopedCriticalSection lock(MemGeneralZoneMutex());
+    g_pMemoryManager->Free(pSegment);
+}
+
+inline CPackageSegmentPool *PackageSegmentPool()
+{
+    static CPackageSegmentPool s_Pool;
+    return &s_Pool;
+}
+
+/*
+===========================================================================
+
+   packagereservation_t - место под заголовок, заполняемое позже.
+   Байты лежат в одном сегменте и не двигаются до Clear.
+
+===========================================================================
+*/
+struct packagereservation_t
+{
+    ubyte *m_pData;
+    int m_nLength;
+};
+
+/*
+===========================================================================
+
+   CSegmentedPackage - растущий пакет из цепочки сегментов пула.
+
+   Битовый поток тот же, что у CBinaryPackage, но без верхней границы:
+   когда сегмент кончается, берётся следующий, недописанный байт
+   переносится в его начало. Сегменты не перемещаются, поэтому
+   Reserve отдаёт место под заголовок, которое заполняется после
+   того, как станут известны длины и контрольные суммы.
+
+   AppendReference вставляет чужой буфер без копирования: например,
+   уже сжатое тело сообщения. Буфер должен жить до отправки.
+
+      CSegmentedPackage package;
+      packagereservation_t header = package.Reserve(4);
+      package.WriteBits(iSequence, 16);
+      package.AppendReference(pPayload, nPayload);
+      package.Patch(header, &nTotal, 4);
+
+      packageiovec_t vecs[16];
+      int nVecs = package.Export(vecs, 16);
+      writev(socket, vecs, nVecs);
+
+   При нехватке памяти ставится флаг переполнения, дальнейшие записи
+   игнорируются, как у CBitWriter.
+
+===========================================================================
+*/
+class CSegmentedPackage
+{
+  public:
+    CSegmentedPackage(CPackageSegmentPool *pPool = PackageSegmentPool()) : m_pPool(pPool)
+    {
+        m_nClosedBytes = 0;
+        m_bOverflowed = false;
+    }
+    ~CSegmentedPackage()
+    {
+        Clear();
+    }
+
+    void Clear(); // вернуть сегменты пулу, ссылки забыть
+
+    void WriteBits(uint32 iValue, int nBits); // nBits от 0 до 32
+    void WriteByteAlign();
+    void WriteData(const void *pData, int nLength);
+    void AppendReference(const void *pData, int nLength);
+
+    packagereservation_t Reserve(int nLength);
+    void Patch(const packagereservation_t &reservation, const void *pData, int nLength);
+
+    int GetSize() const; // байт, включая неполный последний
+    int GetNumBitsWritten() const;
+    int GetNumExtents() const // верхняя граница числа элементов Export
+    {
+        return (int)m_Extents.size();
+    }
+    bool IsOverflowed() const
+    {
+        return m_bOverflowed;
+    }
+
+    // -1, если не хватает nMaxVecs; указатели действительны до следующей записи или Clear
+    int Export(packageiovec_t *pVecs, int nMaxVecs);
+    int CopyTo(ubyte *pOut, int nMaxSize);
+
+  private:
+    struct packageextent_t
+    {
+        ubyte *m_pData;
+        int m_nLength;     // байт; у открытого участка считается по писателю
+        ubyte *m_pSegment; // сегмент, который участок возвращает пулу, или NULL
+    };
+
+    CPackageSegmentPool *m_pPool;
+    std::vector<packageextent_t> m_Extents; // последний, если m_Writer.GetData(), - открытый
+    CBitWriter m_Writer;
+    int m_nClosedBytes;
+    bool m_bOverflowed;
+
+    bool EnsureSpace(int nBits);
+    void CloseExtent(ubyte *pCarry, int &nCarryBits);
+    bool IsOpen() const
+    {
+        return m_Writer.GetData() != NULL;
+    }
+
+    CSegmentedPackage(const CSegmentedPackage &s)
+    {
+    }
+    void operator=(const CSegmentedPackage &s)
+    {
+    }
+};
+
+inline void CSegmentedPackage::Clear()
+{
+    for (size_t i = 0; i < m_Extents.size(); i++)
+        m_pPool->Free(m_Extents[i].m_pSegment);
+
+    // ёмкость вектора остаётся: повторное использование пакета не выделяет память
+    m_Extents.clear();
+    m_Writer.Init(NULL, 0, 0);
+    m_nClosedBytes = 0;
+    m_bOverflowed = false;
+}
+
+// закрыть открытый участок по целому байту, неполный байт отдать наружу
+inline void CSegmentedPackage::CloseExtent(ubyte *pCarry, int &nCarryBits)
+{
+    nCarryBits = 0;
+    if (!IsOpen())
+        return;
+
+    m_Writer.Flush();
+    int iBit = m_Writer.GetBitIndex();
+    packageextent_t &extent = m_Extents.back();
+    extent.m_nLength = iBit >> 3;
+    m_nClosedBytes += extent.m_nLength;
+
+    nCarryBits = iBit & 7;
+    if (nCarryBits)
+        *pCarry = extent.m_pData[extent.m_nLength];
+
+    m_Writer.Init(NULL, 0, 0);
+}
+
+inline bool CSegmentedPackage::EnsureSpace(int nBits)
+{
+    if (m_bOverflowed)
+        return false;
+    if (IsOpen() && m_Writer.GetRemainingBits() >= nBits)
+        return true;
+
+    if (nBits > PACKAGE_SEGMENT_SIZE * 8 - 7)
+    {
+        common()->Error("CSegmentedPackage: %d bits don't fit a segment", nBits);
+        return false;
+    }
+
+    ubyte *pSegment = m_pPool->Alloc();
+    if (!pSegment)
+    {
+        m_bOverflowed = true;
+        return false;
+    }
+
+    ubyte carry = 0;
+    int nCarryBits;
+    CloseExtent(&carry, nCarryBits);
+
+    packageextent_t extent = {pSegment, 0, pSegment};
+    m_Extents.push_back(extent);
+
+    pSegment[0] = carry;
+    m_Writer.Init(pSegment, PACKAGE_SEGMENT_SIZE, nCarryBits);
+    return true;
+}
+
+inline void CSegmentedPackage::WriteBits(uint32 iValue, int nBits)
+{
+    if (EnsureSpace(nBits))
+        m_Writer.Append(iValue, nBits);
+}
+
+inline void CSegmentedPackage::WriteByteAlign()
+{
+    if (IsOpen())
+        m_Writer.WriteByteAlign();
+}
+
+inline void CSegmentedPackage::WriteData(const void *pData, int nLength)
+{
+    const ubyte *pIn = (const ubyte *)pData;
+    while (nLength > 0 && EnsureSpace(8))
+    {
+        int nChunk = Min(nLength, m_Writer.GetRemainingBits() >> 3);
+        m_Writer.WriteBytes(pIn, nChunk);
+        pIn += nChunk;
+        nLength -= nChunk;
+    }
+}
+
+inline void CSegmentedPackage::AppendReference(const void *pData, int nLength)
+{
+    if (m_bOverflowed || nLength <= 0)
+        return;
+
+    WriteByteAlign();
+
+    // остаток сегмента после ссылки продолжает принимать запись
+    ubyte *pTail = NULL;
+    int nTail = 0;
+    if (IsOpen())
+    {
+        nTail = m_Writer.GetRemainingBits() >> 3;
+
+        ubyte carry;
+        int nCarryBits;
+        CloseExtent(&carry, nCarryBits);
+        pTail = m_Extents.back().m_pData + m_Extents.back().m_nLength;
+    }
+
+    packageextent_t reference = {(ubyte *)pData, nLength, NULL};
+    m_Extents.push_back(reference);
+    m_nClosedBytes += nLength;
+
+    if (nTail >= 8)
+    {
+        packageextent_t tail = {pTail, 0, NULL};
+        m_Extents.push_back(tail);
+        m_Writer.Init(pTail, nTail, 0);
+    }
+}
+
+inline packagereservation_t CSegmentedPackage::Reserve(int nLength)
+{
+    packagereservation_t reservation = {NULL, 0};
+
+    WriteByteAlign();
+    if (nLength <= 0 || !EnsureSpace(nLength * 8))
+        return reservation;
+
+    // через WriteBytes: на выровненной позиции байты сразу уходят в сегмент и
+    // последующие записи слов их не перекроют
+    static const ubyte s_Zero[64] = {0};
+    reservation.m_pData = m_Writer.GetData() + (m_Writer.GetBitIndex() >> 3);
+    reservation.m_nLength = nLength;
+    for (int nLeft = nLength; nLeft > 0; nLeft -= (int)sizeof(s_Zero))
+        m_Writer.WriteBytes(s_Zero, Min(nLeft, (int)sizeof(s_Zero)));
+    return reservation;
+}
+
+inline void CSegmentedPackage::Patch(const packagereservation_t &reservation, const void *pData, int nLength)
+{
+    if (!reservation.m_pData || nLength > reservation.m_nLength)
+    {
+        common()->Error("CSegmentedPackage::Patch: %d bytes into %d reserved", nLength, reservation.m_nLength);
+        return;
+    }
+    memcpy(reservation.m_pData, pData, nLength);
+}
+
+inline int CSegmentedPackage::GetNumBitsWritten() const
+{
+    return m_nClosedBytes * 8 + (IsOpen() ? m_Writer.GetBitIndex() : 0);
+}
+
+inline int CSegmentedPackage::GetSize() const
+{
+    return (GetNumBitsWritten() + 7) >> 3;
+}
+
+inline int CSegmentedPackage::Export(packageiovec_t *pVecs, int nMaxVecs)
+{
+    if (IsOpen())
+    {
+        m_Writer.Flush();
+        m_Extents.back().m_nLength = (m_Writer.GetBitIndex() + 7) >> 3;
+    }
+
+    int nVecs = 0;
+    for (size_t i = 0; i < m_Extents.size(); i++)
+    {
+        if (!m_Extents[i].m_nLength)
+            continue;
+        if (nVecs == nMaxVecs)
+            return -1;
+        PackageIovec_Set(pVecs[nVecs++], m_Extents[i].m_pData, m_Extents[i].m_nLength);
+    }
+    return nVecs;
+}
+
+inline int CSegmentedPackage::CopyTo(ubyte *pOut, int nMaxSize)
+{
+    int nSize = GetSize();
+    if (nSize > nMaxSize)
+        return -1;
+
+    if (IsOpen())
+    {
+        m_Writer.Flush();
+        m_Extents.back().m_nLength = (m_Writer.GetBitIndex() + 7) >> 3;
+    }
+
+    for (size_t i = 0; i < m_Extents.size(); i++)
+    {
+        memcpy(pOut, m_Extents[i].m_pData, m_Extents[i].m_nLength);
+        pOut += m_Extents[i].m_nLength;
+    }
+    return nSize;
+}
+
+#endif /* HAYATOLABS_BINARY_SEGMENTS_H */
@@ -0,0 +1,559 @@
+/*
+  This file associated with Hayato Labs project.
+
+  For license and copyright information please follow this link:
+  https://github.com/hayatolabs/general/blob/main/LEGAL
+*/
+
+#ifndef HAYATOLABS_BITSTREAM_H
+#define HAYATOLABS_BITSTREAM_H
+
+#include "public.h"
+
+/*
+===========================================================================
+
+   Битовый ввод-вывод словами
+
+   Порядок бит тот же, что у CBinaryPackage и msg_t: первый бит потока -
+   младший бит первого байта. Слова пишутся и читаются через memcpy,
+   поэтому рассчитано на little-endian платформы.
+
+===========================================================================
+*/
+
+inline uint32 BitMask32(int nBits)
+{
+    return (uint32)(((uint64)1 << nBits) - 1);
+}
+
+/*
+===========================================================================
+
+   Целые переменной длины
+
+   ZigZag переводит знаковые в беззнаковые так, что маленькие по модулю
+   числа остаются маленькими: 0, -1, 1, -2 -> 0, 1, 2, 3.
+
+   VarUInt - LEB128: группы по 7 бит, младшая первой, восьмой бит
+   группы - продолжение. В битовом потоке группы не выравниваются.
+
+   Gamma - код Элиаса для значения + 1: N нулевых бит, единица и
+   младшие N бит, где N - номер старшего бита. Короче VarUInt для
+   чисел до 14, длиннее для больших.
+
+===========================================================================
+*/
+#define VARINT_MAX_GROUPS_32 5
+#define VARINT_MAX_GROUPS_64 10
+#define VARINT_GROUP_BITS 8
+
+inline uint32 ZigZagEncode32(int32 iValue)
+{
+    return ((uint32)iValue << 1) ^ (uint32)(iValue >> 31);
+}
+
+inline int32 ZigZagDecode32(uint32 iValue)
+{
+    return (int32)(iValue >> 1) ^ -(int32)(iValue & 1);
+}
+
+inline uint64 ZigZagEncode64(int64 iValue)
+{
+    return ((uint64)iValue << 1) ^ (uint64)(iValue >> 63);
+}
+
+inline int64 ZigZagDecode64(uint64 iValue)
+{
+    return (int64)(iValue >> 1) ^ -(int64)(iValue & 1);
+}
+
+inline int VarUIntGroups(uint64 iValue)
+{
+    return iValue ? Log2Floor(iValue) / 7 + 1 : 1;
+}
+
+inline int GammaBits(uint32 iValue)
+{
+    return Log2Floor((uint64)iValue + 1) * 2 + 1;
+}
+
+/*
+===========================================================================
+
+   CBitWriter - запись в буфер через 64-битный аккумулятор.
+
+   Биты копятся в регистре и уходят в буфер по 4 байта, выровненные
+   по байту блоки копируются memcpy. Неполный хвост аккумулятора
+   попадает в буфер только в Flush, до этого байты буфера после
+   GetBitIndex() / 8 не определены.
+
+   При нехватке места ставится флаг переполнения, дальнейшие записи
+   игнорируются.
+
+===========================================================================
+*/
+class CBitWriter
+{
+  public:
+    CBitWriter()
+    {
+        Init(NULL, 0, 0);
+    }
+    CBitWriter(ubyte *pData, int nMaxBytes, int iBitIndex = 0)
+    {
+        Init(pData, nMaxBytes, iBitIndex);
+    }
+
+    void Init(ubyte *pData, int nMaxBytes, int iBitIndex);
+
+    bool Reserve(int nBits); // false и переполнение, если nBits не поместятся
+    void Append(uint32 iValue, int nBits);    // без проверки места, после Reserve
+    void WriteBits(uint32 iValue, int nBits); // nBits от 0 до 32
+    void WriteBytes(const void *pData, int nLength);
+    void WriteVarUInt(uint64 iValue);
+    void WriteVarInt(int64 iValue)
+    {
+        WriteVarUInt(ZigZagEncode64(iValue));
+    }
+    void WriteGamma(uint32 iValue);
+    void WriteByteAlign();
+    void Flush();
+
+    int GetBitIndex() const
+    {
+        return m_iByte * 8 + m_nAccBits;
+    }
+    int GetRemainingBits() const
+    {
+        return m_nMaxBits - GetBitIndex();
+    }
+    bool IsOverflowed() const
+    {
+        return m_bOverflowed;
+    }
+    ubyte *GetData() const
+    {
+        return m_pData;
+    }
+
+  private:
+    ubyte *m_pData;
+    int m_nMaxBits;
+    int m_iByte;    // байт, с которого начинается аккумулятор
+    int m_nAccBits; // бит в аккумуляторе, всегда меньше 32 между вызовами
+    uint64 m_Acc;
+    bool m_bOverflowed;
+
+    void SpillBytes();
+};
+
+inline void CBitWriter::Init(ubyte *pData, int nMaxBytes, int iBitIndex)
+{
+    m_pData = pData;
+    m_nMaxBits = nMaxBytes * 8;
+    m_iByte = iBitIndex >> 3;
+    m_nAccBits = iBitIndex & 7;
+    m_bOverflowed = iBitIndex > m_nMaxBits;
+
+    // начатый байт продолжаем, как это делают WriteBits и HuffmanPutBit
+    m_Acc = (m_nAccBits && !m_bOverflowed) ? (m_pData[m_iByte] & BitMask32(m_nAccBits)) : 0;
+}
+
+inline bool CBitWriter::Reserve(int nBits)
+{
+    if (m_bOverflowed || nBits > GetRemainingBits())
+    {
+        m_bOverflowed = true;
+        return false;
+    }
+    return true;
+}
+
+inline void CBitWriter::Append(uint32 iValue, int nBits)
+{
+    m_Acc |= (uint64)(iValue & BitMask32(nBits)) << m_nAccBits;
+    m_nAccBits += nBits;
+
+    if (m_nAccBits >= 32)
+    {
+        uint32 word = (uint32)m_Acc;
+        memcpy(m_pData + m_iByte, &word, 4);
+        m_iByte += 4;
+        m_Acc >>= 32;
+        m_nAccBits -= 32;
+    }
+}
+
+// полные байты аккумулятора в буфер
+inline void CBitWriter::SpillBytes()
+{
+    for (; m_nAccBits >= 8; m_nAccBits -= 8)
+    {
+        m_pData[m_iByte++] = (ubyte)m_Acc;
+        m_Acc >>= 8;
+    }
+}
+
+inline void CBitWriter::WriteBits(uint32 iValue, int nBits)
+{
+    if (Reserve(nBits))
+        Append(iValue, nBits);
+}
+
+inline void CBitWriter::WriteBytes(const void *pData, int nLength)
+{
+    if (nLength <= 0 || !Reserve(nLength * 8))
+        return;
+
+    const ubyte *pIn = (const ubyte *)pData;
+    if (!(m_nAccBits & 7))
+    {
+        SpillBytes();
+        memcpy(m_pData + m_iByte, pIn, nLength);
+        m_iByte += nLength;
+        return;
+    }
+
+    for (; nLength >= 4; nLength -= 4, pIn += 4)
+    {
+        uint32 word;
+        memcpy(&word, pIn, 4);
+        Append(word, 32);
+    }
+    for (; nLength > 0; nLength--, pIn++)
+        Append(*pIn, 8);
+}
+
+inline void CBitWriter::WriteVarUInt(uint64 iValue)
+{
+    if (!Reserve(VarUIntGroups(iValue) * VARINT_GROUP_BITS))
+        return;
+
+    for (; iValue >= 0x80; iValue >>= 7)
+        Append((uint32)(iValue & 0x7F) | 0x80, VARINT_GROUP_BITS);
+    Append((uint32)iValue, VARINT_GROUP_BITS);
+}
+
+inline void CBitWriter::WriteGamma(uint32 iValue)
+{
+    uint64 x = (uint64)iValue + 1;
+    int nBits = Log2Floor(x);
+    if (!Reserve(nBits * 2 + 1))
+        return;
+
+    // нули и единица одним словом, пока помещаются
+    if (nBits < 32)
+        Append(1u << nBits, nBits + 1);
+    else
+    {
+        Append(0, nBits);
+        Append(1, 1);
+    }
+    Append((uint32)x, nBits);
+}
+
+inline void CBitWriter::WriteByteAlign()
+{
+    int nPad = -m_nAccBits & 7;
+    if (nPad && Reserve(nPad))
+        Append(0, nPad);
+}
+
+inline void CBitWriter::Flush()
+{
+    if (!m_nAccBits)
+        return;
+
+    // хвост пишется без сдвига позиции: следующая запись слова его перекроет
+    uint64 acc = m_Acc;
+    for (int i = 0; i < ((m_nAccBits + 7) >> 3); i++, acc >>= 8)
+        m_pData[m_iByte + i] = (ubyte)acc;
+}
+
+/*
+===========================================================================
+
+   CBitReader - чтение из буфера 64-битными окнами.
+
+   Каждое чтение берёт невыровненное 64-битное слово с текущего байта,
+   поэтому до 32 бит достаются одним сдвигом и маской. У конца буфера
+   слово собирается побайтово, недостающие байты считаются нулевыми.
+
+   Чтение за пределом ставит флаг переполнения и возвращает 0.
+
+===========================================================================
+*/
+class CBitReader
+{
+  public:
+    CBitReader()
+    {
+        Init(NULL, 0, 0);
+    }
+    CBitReader(const ubyte *pData, int nBytes, int iBitIndex = 0)
+    {
+        Init(pData, nBytes, iBitIndex);
+    }
+
+    void Init(const ubyte *pData, int nBytes, int iBitIndex)
+    {
+        m_pData = pData;
+        m_nBytes = nBytes;
+        m_iBit = iBitIndex;
+        m_bOverflowed = false;
+    }
+
+    uint32 PeekBits(int nBits) const; // без проверки границы, за концом нули
+    void SkipBits(int nBits);
+    uint32 TakeBits(int nBits) // без проверки границы, после проверки GetRemainingBits
+    {
+        uint32 iValue = PeekBits(nBits);
+        m_iBit += nBits;
+        return iValue;
+    }
+    uint32 ReadBits(int nBits); // nBits от 0 до 32
+    int ReadSignedBits(int nBits);
+    void ReadBytes(void *pData, int nLength);
+
+    // испорченное число (слишком много групп) считается выходом за предел
+    uint64 ReadVarUInt(int nMaxGroups = VARINT_MAX_GROUPS_64);
+    int64 ReadVarInt()
+    {
+        return ZigZagDecode64(ReadVarUInt());
+    }
+    uint32 ReadGamma();
+    bool ReadVarUIntArray(uint32 *pValues, int nCount);
+    bool ReadVarIntArray(int32 *pValues, int nCount);
+    void ReadByteAlign()
+    {
+        m_iBit = (m_iBit + 7) & ~7;
+    }
+
+    int GetBitIndex() const
+    {
+        return m_iBit;
+    }
+    int GetRemainingBits() const
+    {
+        return m_nBytes * 8 - m_iBit;
+    }
+    bool IsOverflowed() const
+    {
+        return m_bOverflowed;
+    }
+
+  private:
+    const ubyte *m_pData;
+    int m_nBytes;
+    int m_iBit;
+    bool m_bOverflowed;
+
+    uint64 LoadWord(int iByte) const;
+    bool TakeVarUInt(uint64 &iValue, int nMaxGroups); // false - больше nMaxGroups групп
+};
+
+inline uint64 CBitReader::LoadWord(int iByte) const
+{
+    uint64 word = 0;
+    if (iByte + 8 <= m_nBytes)
+        memcpy(&word, m_pData + iByte, 8);
+    else
+    {
+        for (int i = 0; iByte + i < m_nBytes && i < 8; i++)
+            word |= (uint64)m_pData[iByte + i] << (i * 8);
+    }
+    return word;
+}
+
+inline uint32 CBitReader::PeekBits(int nBits) const
+{
+    // сдвиг не больше 7, так что в слове остаётся минимум 57 бит
+    return (uint32)(LoadWord(m_iBit >> 3) >> (m_iBit & 7)) & BitMask32(nBits);
+}
+
+inline void CBitReader::SkipBits(int nBits)
+{
+    m_iBit += nBits;
+    if (m_iBit > m_nBytes * 8)
+        m_bOverflowed = true;
+}
+
+inline uint32 CBitReader::ReadBits(int nBits)
+{
+    if (nBits > GetRemainingBits())
+    {
+        m_bOverflowed = true;
+        return 0;
+    }
+
+    return TakeBits(nBits);
+}
+
+inline int CBitReader::ReadSignedBits(int nBits)
+{
+    uint32 iValue = ReadBits(nBits);
+    if (nBits > 0 && nBits < 32 && (iValue & BIT(nBits - 1)))
+        iValue |= ~BitMask32(nBits);
+    return (int)iValue;
+}
+
+inline void CBitReader::ReadBytes(void *pData, int nLength)
+{
+    ubyte *pOut = (ubyte *)pData;
+    if (nLength <= 0)
+        return;
+    if (nLength * 8 > GetRemainingBits())
+    {
+        m_bOverflowed = true;
+        memset(pOut, 0, nLength);
+        return;
+    }
+
+    if (!(m_iBit & 7))
+    {
+        memcpy(pOut, m_pData + (m_iBit >> 3), nLength);
+        m_iBit += nLength * 8;
+        return;
+    }
+
+    for (; nLength >= 4; nLength -= 4, pOut += 4)
+    {
+        uint32 word = PeekBits(32);
+        memcpy(pOut, &word, 4);
+        m_iBit += 32;
+    }
+    for (; nLength > 0; nLength--, pOut++)
+    {
+        *pOut = (ubyte)PeekBits(8);
+        m_iBit += 8;
+    }
+}
+
+/*
+===========================================================================
+
+   Чтение VarUInt: одно 64-битное окно покрывает до 7 групп, так что
+   конец числа находится по маске битов продолжения, без побитового
+   цикла. Длинные 64-битные значения дочитываются по группе.
+
+===========================================================================
+*/
+inline bool CBitReader::TakeVarUInt(uint64 &iValue, int nMaxGroups)
+{
+    uint64 word = LoadWord(m_iBit >> 3) >> (m_iBit & 7);
+    uint64 stop = ~word & 0x0080808080808080ull;
+
+    // самый частый случай - одна группа
+    if (stop & 0x80)
+    {
+        iValue = word & 0x7F;
+        m_iBit += VARINT_GROUP_BITS;
+        return true;
+    }
+
+    iValue = 0;
+    if (stop)
+    {
+        int nGroups = (LowestSetBit(stop) >> 3) + 1;
+        if (nGroups > nMaxGroups)
+            return false;
+
+        // сжимаем до семи групп без цикла: каждая следующая сдвигается на бит сильнее
+        uint64 x = word & ((1ull << (nGroups * 8)) - 1);
+        iValue = (x & 0x7F) | ((x >> 1) & 0x3F80) | ((x >> 2) & 0x1FC000) | ((x >> 3) & 0xFE00000) |
+                 ((x >> 4) & 0x7F0000000ull) | ((x >> 5) & 0x3F800000000ull) | ((x >> 6) & 0x1FC0000000000ull);
+        m_iBit += nGroups * VARINT_GROUP_BITS;
+        return true;
+    }
+
+    for (int i = 0; i < nMaxGroups; i++)
+    {
+        uint32 group = TakeBits(VARINT_GROUP_BITS);
+        iValue |= (uint64)(group & 0x7F) << (i * 7);
+        if (!(group & 0x80))
+            return true;
+    }
+    return false;
+}
+
+inline uint64 CBitReader::ReadVarUInt(int nMaxGroups)
+{
+    int iStart = m_iBit;
+    uint64 iValue;
+
+    // за концом буфера окно видит нули, то есть законченную группу, поэтому границу проверяем после
+    if (!TakeVarUInt(iValue, nMaxGroups) || m_iBit > m_nBytes * 8)
+    {
+        m_iBit = iStart;
+        m_bOverflowed = true;
+        return 0;
+    }
+    return iValue;
+}
+
+inline uint32 CBitReader::ReadGamma()
+{
+    // в окне не меньше 57 бит: до 28 нулей, единица и 28 бит значения
+    uint64 word = LoadWord(m_iBit >> 3) >> (m_iBit & 7);
+    int nBits = (uint32)word ? LowestSetBit(word) : ((word >> 32) & 1 ? 32 : 33);
+
+    if (nBits > 32 || nBits * 2 + 1 > GetRemainingBits())
+    {
+        m_bOverflowed = true;
+        return 0;
+    }
+
+    uint64 x;
+    if (nBits <= 28)
+        x = (word >> (nBits + 1)) & ((1ull << nBits) - 1);
+    else
+    {
+        m_iBit += nBits + 1;
+        x = PeekBits(nBits);
+        m_iBit -= nBits + 1;
+    }
+    m_iBit += nBits * 2 + 1;
+    return (uint32)((x | (1ull << nBits)) - 1);
+}
+
+inline bool CBitReader::ReadVarUIntArray(uint32 *pValues, int nCount)
+{
+    int i = 0;
+    uint64 iValue;
+
+    // пока хватает места на самые длинные числа, границу не проверяем
+    for (; i < nCount && GetRemainingBits() >= VARINT_MAX_GROUPS_32 * VARINT_GROUP_BITS; i++)
+    {
+        if (!TakeVarUInt(iValue, VARINT_MAX_GROUPS_32) || iValue > 0xFFFFFFFFull)
+        {
+            m_bOverflowed = true;
+            return false;
+        }
+        pValues[i] = (uint32)iValue;
+    }
+
+    for (; i < nCount; i++)
+    {
+        iValue = ReadVarUInt(VARINT_MAX_GROUPS_32);
+        if (m_bOverflowed || iValue > 0xFFFFFFFFull)
+        {
+            m_bOverflowed = true;
+            return false;
+        }
+        pValues[i] = (uint32)iValue;
+    }
+    return true;
+}
+
+inline bool CBitReader::ReadVarIntArray(int32 *pValues, int nCount)
+{
+    if (!ReadVarUIntArray((uint32 *)pValues, nCount))
+        return false;
+
+    for (int i = 0; i < nCount; i++)
+        pValues[i] = ZigZagDecode32((uint32)pValues[i]);
+    return true;
+}
+
+#endif /* HAYATOLABS_BITSTREAM_H */
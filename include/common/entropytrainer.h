@@ -0,0 +1,395 @@
+/*
+  This file associated with Hayato Labs project.
+
+  For license and copyright information please follow this link:
+  https://github.com/hayatolabs/general/blob/main/LEGAL
+*/
+
+#ifndef HAYATOLABS_ENTROPYTRAINER_H
+#define HAYATOLABS_ENTROPYTRAINER_H
+
+#include "rans.h"
+
+/*
+===========================================================================
+
+   CEntropyTrainer - статические таблицы по записи реального трафика.
+
+   Считает частоты байт в несжатых сообщениях (то, что потом уходит в
+   MSG_Compress или MSG_WriteData) и строит по ним:
+
+      - частоты rANS с суммой RANS_PROB_SCALE, подобранные по цене в
+        битах, а не простым округлением;
+      - канонический код Хаффмана с длинами не больше nMaxBits, в том же
+        порядке бит, что у HuffmanPutSymbol.
+
+   WriteHeader выводит обе таблицы constexpr-массивами, которые можно
+   вкомпилировать в приложение (RansRegisterTable) или в huffman_static.
+
+   Запись трафика - последовательность записей "длина (4 байта, LE) +
+   байты", её пишет EntropyTrainer_WriteCapture.
+
+===========================================================================
+*/
+class CEntropyTrainer
+{
+  public:
+    CEntropyTrainer()
+    {
+        Clear();
+    }
+
+    void Clear()
+    {
+        memset(m_Counts, 0, sizeof(m_Counts));
+        m_nMessages = 0;
+        m_nBytes = 0;
+    }
+
+    void AddPayload(const ubyte *pData, int nLength);
+    void AddMessage(const msg_t *msg, int offset)
+    {
+        AddPayload(msg->pData + offset, msg->nCursize - offset);
+    }
+    void Merge(const CEntropyTrainer &trainer);
+
+    void BuildFrequencies(uint32 *pFreq) const;
+    void BuildHuffmanLengths(uint8 *pLengths, int nMaxBits = HUFFMAN_MAX_CODE_BITS) const;
+    void BuildRansTable(ranstable_t &table) const;
+
+    // оценка размера корпуса в битах, без заголовков и состояний rANS
+    double EstimateRansBits(const uint32 *pFreq) const;
+    uint64 EstimateHuffmanBits(const uint8 *pLengths) const;
+
+    bool WriteHeader(FILE *f, const char *pszName) const;
+
+    uint64 GetCount(int iSymbol) const
+    {
+        return m_Counts[iSymbol];
+    }
+    uint64 GetMessageCount() const
+    {
+        return m_nMessages;
+    }
+    uint64 GetByteCount() const
+    {
+        return m_nBytes;
+    }
+
+  private:
+    uint64 m_Counts[256];
+    uint64 m_nMessages;
+    uint64 m_nBytes;
+
+    void BuildHuffmanDepths(const uint64 *pWeights, uint8 *pLengths) const;
+};
+
+inline void CEntropyTrainer::AddPayload(const ubyte *pData, int nLength)
+{
+    // четыре набора счётчиков, чтобы соседние одинаковые байты не ждали друг друга
+    uint32 counts[4][256];
+    memset(counts, 0, sizeof(counts));
+
+    int i = 0;
+    for (; i + 4 <= nLength; i += 4)
+    {
+        counts[0][pData[i]]++;
+        counts[1][pData[i + 1]]++;
+        counts[2][pData[i + 2]]++;
+        counts[3][pData[i + 3]]++;
+    }
+    for (; i < nLength; i++)
+        counts[0][pData[i]]++;
+
+    for (int iSymbol = 0; iSymbol < 256; iSymbol++)
+        m_Counts[iSymbol] += counts[0][iSymbol] + counts[1][iSymbol] + counts[2][iSymbol] + counts[3][iSymbol];
+
+    m_nMessages++;
+    m_nBytes += Max(nLength, 0);
+}
+
+inline void CEntropyTrainer::Merge(const CEntropyTrainer &trainer)
+{
+    for (int i = 0; i < 256; i++)
+        m_Counts[i] += trainer.m_Counts[i];
+    m_nMessages += trainer.m_nMessages;
+    m_nBytes += trainer.m_nBytes;
+}
+
+/*
+===========================================================================
+
+   BuildFrequencies - частоты для rANS.
+
+   Начальное приближение - пропорция с округлением, каждому байту не
+   меньше 1. Разницу с RANS_PROB_SCALE раздаём по одному слоту туда,
+   где это дешевле всего в битах корпуса.
+
+===========================================================================
+*/
+inline void CEntropyTrainer::BuildFrequencies(uint32 *pFreq) const
+{
+    uint64 nTotal = 0;
+    for (int i = 0; i < 256; i++)
+        nTotal += m_Counts[i];
+
+    int nSum = 0;
+    for (int i = 0; i < 256; i++)
+    {
+        uint64 nFreq = nTotal ? (m_Counts[i] * RANS_PROB_SCALE + nTotal / 2) / nTotal : 1;
+        pFreq[i] = (uint32)Max<uint64>(nFreq, 1);
+        nSum += pFreq[i];
+    }
+
+    while (nSum > RANS_PROB_SCALE)
+    {
+        int iBest = -1;
+        double flBestCost = 0;
+        for (int i = 0; i < 256; i++)
+        {
+            if (pFreq[i] <= 1)
+                continue;
+
+            double flCost = m_Counts[i] * log2((double)pFreq[i] / (pFreq[i] - 1));
+            if (iBest < 0 || flCost < flBestCost)
+            {
+                iBest = i;
+                flBestCost = flCost;
+            }
+        }
+        pFreq[iBest]--;
+        nSum--;
+    }
+
+    while (nSum < RANS_PROB_SCALE)
+    {
+        int iBest = 0;
+        double flBestGain = -1;
+        for (int i = 0; i < 256; i++)
+        {
+            double flGain = m_Counts[i] * log2((double)(pFreq[i] + 1) / pFreq[i]);
+            if (flGain > flBestGain)
+            {
+                iBest = i;
+                flBestGain = flGain;
+            }
+        }
+        pFreq[iBest]++;
+        nSum++;
+    }
+}
+
+inline void CEntropyTrainer::BuildRansTable(ranstable_t &table) const
+{
+    uint32 freq[256];
+    BuildFrequencies(freq);
+    table.Build(freq);
+}
+
+/*
+===========================================================================
+
+   BuildHuffmanLengths - длины кодов Хаффмана не длиннее nMaxBits.
+
+   Невстреченным байтам даётся вес 1, чтобы кодировался любой поток.
+   Если дерево выходит глубже nMaxBits, веса сглаживаются вдвое и
+   дерево строится заново - как это делают zlib-подобные кодеры.
+   256 символов не уложить короче 8 бит, а таблицы huffman.h
+   не разбирают коды длиннее HUFFMAN_MAX_CODE_BITS, поэтому nMaxBits
+   ограничивается диапазоном 8..HUFFMAN_MAX_CODE_BITS.
+
+===========================================================================
+*/
+inline void CEntropyTrainer::BuildHuffmanDepths(const uint64 *pWeights, uint8 *pLengths) const
+{
+    uint64 weights[511];
+    int parents[511];
+    bool bUsed[511];
+    int nNodes = 256;
+
+    for (int i = 0; i < 256; i++)
+    {
+        weights[i] = pWeights[i];
+        bUsed[i] = false;
+    }
+
+    // 256 символов, так что квадратичный поиск минимумов приемлем
+    while (nNodes < 511)
+    {
+        int iMin[2] = {-1, -1};
+        for (int i = 0; i < nNodes; i++)
+        {
+            if (bUsed[i])
+                continue;
+            if (iMin[0] < 0 || weights[i] < weights[iMin[0]])
+            {
+                iMin[1] = iMin[0];
+                iMin[0] = i;
+            }
+            else if (iMin[1] < 0 || weights[i] < weights[iMin[1]])
+                iMin[1] = i;
+        }
+
+        weights[nNodes] = weights[iMin[0]] + weights[iMin[1]];
+        bUsed[nNodes] = false;
+        bUsed[iMin[0]] = bUsed[iMin[1]] = true;
+        parents[iMin[0]] = parents[iMin[1]] = nNodes;
+        nNodes++;
+    }
+
+    for (int i = 0; i < 256; i++)
+    {
+        int nDepth = 0;
+        for (int iNode = i; iNode != 510; iNode = parents[iNode])
+            nDepth++;
+        pLengths[i] = (uint8)Min(nDepth, 255);
+    }
+}
+
+inline void CEntropyTrainer::BuildHuffmanLengths(uint8 *pLengths, int nMaxBits) const
+{
+    // при nMaxBits < 8 цикл ниже не закончился бы никогда, длиннее
+    // HUFFMAN_MAX_CODE_BITS не декодирует m_Single
+    nMaxBits = Max(8, Min(nMaxBits, HUFFMAN_MAX_CODE_BITS));
+
+    uint64 weights[256];
+    for (int i = 0; i < 256; i++)
+        weights[i] = m_Counts[i] + 1;
+
+    for (;;)
+    {
+        BuildHuffmanDepths(weights, pLengths);
+
+        int nMax = 0;
+        for (int i = 0; i < 256; i++)
+            nMax = Max<int>(nMax, pLengths[i]);
+        if (nMax <= nMaxBits)
+            return;
+
+        for (int i = 0; i < 256; i++)
+            weights[i] = (weights[i] >> 1) | 1;
+    }
+}
+
+/*
+===========================================================================
+
+   HuffmanCanonicalCodes - канонические коды по длинам, первый бит
+   потока - младший, как в huffmantables_t::m_Codes.
+
+===========================================================================
+*/
+inline void HuffmanCanonicalCodes(const uint8 *pLengths, uint16 *pCodes)
+{
+    int nCounts[33] = {0};
+    for (int i = 0; i < 256; i++)
+        nCounts[pLengths[i]]++;
+    nCounts[0] = 0;
+
+    uint32 nextCode[33];
+    uint32 iCode = 0;
+    for (int nBits = 1; nBits <= 32; nBits++)
+    {
+        iCode = (iCode + nCounts[nBits - 1]) << 1;
+        nextCode[nBits] = iCode;
+    }
+
+    for (int i = 0; i < 256; i++)
+    {
+        int nBits = pLengths[i];
+        if (!nBits)
+        {
+            pCodes[i] = 0;
+            continue;
+        }
+
+        // старший бит канонического кода идёт в поток первым
+        uint32 iValue = nextCode[nBits]++;
+        uint32 iReversed = 0;
+        for (int iBit = 0; iBit < nBits; iBit++)
+            iReversed |= ((iValue >> iBit) & 1) << (nBits - 1 - iBit);
+        pCodes[i] = (uint16)iReversed;
+    }
+}
+
+inline double CEntropyTrainer::EstimateRansBits(const uint32 *pFreq) const
+{
+    double flBits = 0;
+    for (int i = 0; i < 256; i++)
+    {
+        if (m_Counts[i])
+            flBits += m_Counts[i] * log2((double)RANS_PROB_SCALE / pFreq[i]);
+    }
+    return flBits;
+}
+
+inline uint64 CEntropyTrainer::EstimateHuffmanBits(const uint8 *pLengths) const
+{
+    uint64 nBits = 0;
+    for (int i = 0; i < 256; i++)
+        nBits += m_Counts[i] * pLengths[i];
+    return nBits;
+}
+
+/*
+===========================================================================
+
+   WriteHeader - сгенерированный заголовок с таблицами pszName:
+
+      g_<pszName>RansFreq[256]        - для ranstable_t::Build
+      g_<pszName>HuffmanLengths[256]
+      g_<pszName>HuffmanCodes[256]    - порядок бит как у HuffmanPutSymbol
+
+===========================================================================
+*/
+inline bool CEntropyTrainer::WriteHeader(FILE *f, const char *pszName) const
+{
+    uint32 freq[256];
+    uint8 lengths[256];
+    uint16 codes[256];
+    BuildFrequencies(freq);
+    BuildHuffmanLengths(lengths);
+    HuffmanCanonicalCodes(lengths, codes);
+
+    char szGuard[128];
+    snprintf(szGuard, sizeof(szGuard), "HAYATOLABS_ENTROPY_%s_H", pszName);
+    for (char *p = szGuard; *p; p++)
+        *p = (char)toupper((ubyte)*p);
+
+    fprintf(f, "/*\n  This file associated with Hayato Labs project.\n\n");
+    fprintf(f, "  For license and copyright information please follow this link:\n");
+    fprintf(f, "  https://github.com/hayatolabs/general/blob/main/LEGAL\n*/\n\n");
+    fprintf(f, "// Сгенерировано entropytrain: %llu сообщений, %llu байт. Не править вручную.\n\n",
+            (unsigned long long)m_nMessages, (unsigned long long)m_nBytes);
+    fprintf(f, "#ifndef %s\n#define %s\n\n#include \"common/public.h\"\n\n", szGuard, szGuard);
+
+    fprintf(f, "constexpr uint32 g_%sRansFreq[256] = {", pszName);
+    for (int i = 0; i < 256; i++)
+        fprintf(f, "%s%u%s", i % 16 ? " " : "\n    ", freq[i], i < 255 ? "," : "\n};\n\n");
+
+    fprintf(f, "constexpr uint8 g_%sHuffmanLengths[256] = {", pszName);
+    for (int i = 0; i < 256; i++)
+        fprintf(f, "%s%u%s", i % 16 ? " " : "\n    ", lengths[i], i < 255 ? "," : "\n};\n\n");
+
+    fprintf(f, "constexpr uint16 g_%sHuffmanCodes[256] = {", pszName);
+    for (int i = 0; i < 256; i++)
+        fprintf(f, "%s0x%03x%s", i % 12 ? " " : "\n    ", codes[i], i < 255 ? "," : "\n};\n\n");
+
+    fprintf(f, "#endif /* %s */\n", szGuard);
+    return !ferror(f);
+}
+
+/*
+===========================================================================
+
+   EntropyTrainer_WriteCapture - дописать сообщение в запись трафика
+
+===========================================================================
+*/
+inline bool EntropyTrainer_WriteCapture(FILE *f, const ubyte *pData, int nLength)
+{
+    ubyte header[4] = {(ubyte)nLength, (ubyte)(nLength >> 8), (ubyte)(nLength >> 16), (ubyte)(nLength >> 24)};
+    return fwrite(header, 4, 1, f) == 1 && (!nLength || fwrite(pData, nLength, 1, f) == 1);
+}
+
+#endif /* HAYATOLABS_ENTROPYTRAINER_H */
@@ -0,0 +1,173 @@
+/*
+  This file associated with Hayato Labs project.
+
+  For license and copyright information please follow this link:
+  https://github.com/hayatolabs/general/blob/main/LEGAL
+*/
+
+#ifndef HAYATOLABS_FILEMAPPING_H
+#define HAYATOLABS_FILEMAPPING_H
+
+#include "public.h"
+#include "platform.h"
+
+#if !defined(_WIN32)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+/*
+===========================================================================
+
+   filemapping_t - файл, целиком отображённый в память только для
+   чтения. Страницы подгружает система по мере обращения, копии в
+   куче нет; указатели внутрь m_pData живут до Close.
+
+   Путь передаётся в систему как есть, так же как его открывает
+   IFileSystem::FileOpen.
+
+===========================================================================
+*/
+struct filemapping_t
+{
+    const char *m_pData;
+    size_t m_nSize;
+
+#if defined(_WIN32)
+    HANDLE m_hFile;
+    HANDLE m_hMapping;
+#endif
+
+    bool Open(const char *pszFilepath);
+    void Close();
+
+    bool IsOpen() const
+    {
+        return m_pData != NULL;
+    }
+};
+
+// размер и время последней записи файла (в единицах системы), без открытия
+inline bool FileQueryInfo(const char *pszFilepath, uint64 &nSize, uint64 &iModifyTime)
+{
+#if defined(_WIN32)
+    WIN32_FILE_ATTRIBUTE_DATA data;
+    if (!GetFileAttributesExA(pszFilepath, GetFileExInfoStandard, &data) ||
+        (data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY))
+        return false;
+    nSize = ((uint64)data.nFileSizeHigh << 32) | data.nFileSizeLow;
+    iModifyTime = ((uint64)data.ftLastWriteTime.dwHighDateTime << 32) | data.ftLastWriteTime.dwLowDateTime;
+#else
+    struct stat info;
+    if (stat(pszFilepath, &info) != 0 || !S_ISREG(info.st_mode))
+        return false;
+    nSize = (uint64)info.st_size;
+#if defined(__APPLE__)
+    iModifyTime = (uint64)info.st_mtimespec.tv_sec * 1000000000ull + (uint64)info.st_mtimespec.tv_nsec;
+#else
+    iModifyTime = (uint64)info.st_mtim.tv_sec * 1000000000ull + (uint64)info.st_mtim.tv_nsec;
+#endif
+#endif
+    return true;
+}
+
+inline bool filemapping_t::Open(const char *pszFilepath)
+{
+    memset(this, 0, sizeof(*this));
+
+    // у пустого файла нечего отображать, но открыт он успешно
+    static const char s_szEmpty[1] = {0};
+
+#if defined(_WIN32)
+    m_hFile = CreateFileA(pszFilepath, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN,
+                          NULL);
+    if (m_hFile == INVALID_HANDLE_VALUE)
+    {
+        m_hFile = NULL;
+        return false;
+    }
+
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(m_hFile, &size))
+    {
+        Close();
+        return false;
+    }
+
+    if (size.QuadPart == 0)
+    {
+        m_pData = s_szEmpty;
+        return true;
+    }
+
+    m_hMapping = CreateFileMappingA(m_hFile, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (!m_hMapping)
+    {
+        Close();
+        return false;
+    }
+
+    m_pData = (const char *)MapViewOfFile(m_hMapping, FILE_MAP_READ, 0, 0, 0);
+    if (!m_pData)
+    {
+        Close();
+        return false;
+    }
+    m_nSize = (size_t)size.QuadPart;
+#else
+    int iFile = open(pszFilepath, O_RDONLY);
+    if (iFile < 0)
+        return false;
+
+    struct stat info;
+    if (fstat(iFile, &info) != 0 || !S_ISREG(info.st_mode))
+    {
+        close(iFile);
+        return false;
+    }
+
+    if (info.st_size == 0)
+    {
+        close(iFile);
+        m_pData = s_szEmpty;
+        return true;
+    }
+
+    // отображение держит файл само, дескриптор больше не нужен
+    void *pData = mmap(NULL, (size_t)info.st_size, PROT_READ, MAP_PRIVATE, iFile, 0);
+    close(iFile);
+    if (pData == MAP_FAILED)
+        return false;
+
+#if defined(MADV_SEQUENTIAL)
+    madvise(pData, (size_t)info.st_size, MADV_SEQUENTIAL);
+#endif
+    m_pData = (const char *)pData;
+    m_nSize = (size_t)info.st_size;
+#endif
+
+    return true;
+}
+
+inline void filemapping_t::Close()
+{
+#if defined(_WIN32)
+    if (m_pData && m_nSize)
+        UnmapViewOfFile(m_pData);
+    if (m_hMapping)
+        CloseHandle(m_hMapping);
+    if (m_hFile)
+        CloseHandle(m_hFile);
+    m_hMapping = NULL;
+    m_hFile = NULL;
+#else
+    if (m_pData && m_nSize)
+        munmap((void *)m_pData, m_nSize);
+#endif
+    m_pData = NULL;
+    m_nSize = 0;
+}
+
+#endif /* HAYATOLABS_FILEMAPPING_H */
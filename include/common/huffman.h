@@ -0,0 +1,682 @@
+/*
+  This file associated with Hayato Labs project.
+
+  For license and copyright information please follow this link:
+  https://github.com/hayatolabs/general/blob/main/LEGAL
+*/
+
+#ifndef HAYATOLABS_HUFFMAN_H
+#define HAYATOLABS_HUFFMAN_H
+
+#include "bitstream.h"
+#include "msg.h"
+
+#define HUFFMAN_MAX_CODE_BITS 11 // самый длинный код статического дерева
+#define HUFFMAN_LOOKUP_BITS 12   // бит на один шаг табличного декодера
+#define HUFFMAN_LOOKUP_SIZE (1 << HUFFMAN_LOOKUP_BITS)
+#define HUFFMAN_LOOKUP_SYMBOLS 3 // символов в одной записи таблицы
+
+/*
+===========================================================================
+
+   Таблицы статического Хаффмана для пакетного кодирования.
+
+   Коды берутся у HuffmanPutSymbol и HuffmanGetSymbol при первом
+   обращении, поэтому поток бит совпадает с ними бит в бит.
+
+   Запись таблицы декодера по 12 битам потока:
+      биты 0..23  - до трёх символов, первый в младшем байте
+      биты 24..27 - сколько бит потока они занимают
+      биты 28..29 - сколько символов в записи
+
+===========================================================================
+*/
+struct huffmantables_t
+{
+    uint16 m_Codes[256]; // код символа, первый бит потока - младший
+    uint8 m_Lengths[256];
+    uint16 m_Single[1 << HUFFMAN_MAX_CODE_BITS]; // символ | длина << 8
+    uint32 m_Multi[HUFFMAN_LOOKUP_SIZE];
+
+    huffmantables_t()
+    {
+        Build();
+    }
+    void Build();
+};
+
+inline void huffmantables_t::Build()
+{
+    for (int iSymbol = 0; iSymbol < 256; iSymbol++)
+    {
+        ubyte buffer[4] = {0, 0, 0, 0};
+        int nBits = HuffmanPutSymbol(buffer, 0, iSymbol);
+
+        m_Lengths[iSymbol] = (uint8)nBits;
+        m_Codes[iSymbol] = (uint16)((buffer[0] | (buffer[1] << 8)) & ((1 << nBits) - 1));
+    }
+
+    // декодер тоже опрашиваем целиком: в дереве есть код, не принадлежащий ни одному символу
+    for (int iIndex = 0; iIndex < (1 << HUFFMAN_MAX_CODE_BITS); iIndex++)
+    {
+        ubyte buffer[4] = {(ubyte)iIndex, (ubyte)(iIndex >> 8), 0, 0};
+        unsigned int iSymbol;
+        int nBits = HuffmanGetSymbol(&iSymbol, buffer, 0);
+        m_Single[iIndex] = (uint16)((iSymbol & 0xFF) | (nBits << 8));
+    }
+
+    for (uint32 iIndex = 0; iIndex < HUFFMAN_LOOKUP_SIZE; iIndex++)
+    {
+        uint32 nBits = 0, nSymbols = 0, symbols = 0;
+        while (nSymbols < HUFFMAN_LOOKUP_SYMBOLS)
+        {
+            uint32 entry = m_Single[(iIndex >> nBits) & ((1 << HUFFMAN_MAX_CODE_BITS) - 1)];
+            uint32 nLength = entry >> 8;
+            if (nBits + nLength > HUFFMAN_LOOKUP_BITS)
+                break;
+
+            symbols |= (entry & 0xFF) << (nSymbols * 8);
+            nBits += nLength;
+            nSymbols++;
+        }
+        m_Multi[iIndex] = symbols | (nBits << 24) | (nSymbols << 28);
+    }
+}
+
+inline const huffmantables_t *HuffmanTables()
+{
+    static huffmantables_t s_Tables;
+    return &s_Tables;
+}
+
+inline uint64 Huffman_Load64(const ubyte *pBuffer, int iByte, int nBufferSize)
+{
+    uint64 word = 0;
+    if (iByte + 8 <= nBufferSize)
+        memcpy(&word, pBuffer + iByte, 8);
+    else
+    {
+        for (int i = 0; iByte + i < nBufferSize && i < 8; i++)
+            word |= (uint64)pBuffer[iByte + i] << (i * 8);
+    }
+    return word;
+}
+
+/*
+===========================================================================
+
+   HuffmanDecodeBytes - раскодировать nCount символов, начиная с бита
+   iBitIndex. За шаг разбирается до 12 бит (до трёх символов), за одну
+   загрузку 64-битного слова - четыре шага. Биты за nBufferSize
+   считаются нулевыми. Возвращает номер бита после последнего символа.
+
+===========================================================================
+*/
+inline int HuffmanDecodeBytes(ubyte *pOut, int nCount, const ubyte *pBuffer, int nBufferSize, int iBitIndex)
+{
+    const huffmantables_t *pTables = HuffmanTables();
+    int i = 0;
+
+    // каждый шаг может записать HUFFMAN_LOOKUP_SYMBOLS байт, поэтому держим запас
+    while (nCount - i >= 4 * HUFFMAN_LOOKUP_SYMBOLS && (iBitIndex >> 3) + 8 <= nBufferSize)
+    {
+        uint64 word;
+        memcpy(&word, pBuffer + (iBitIndex >> 3), 8);
+        word >>= iBitIndex & 7;
+
+        // в слове не меньше 56 достоверных бит, четыре шага занимают не больше 48
+        for (int iStep = 0; iStep < 4; iStep++)
+        {
+            uint32 entry = pTables->m_Multi[word & (HUFFMAN_LOOKUP_SIZE - 1)];
+            pOut[i] = (ubyte)entry;
+            pOut[i + 1] = (ubyte)(entry >> 8);
+            pOut[i + 2] = (ubyte)(entry >> 16);
+            i += entry >> 28;
+
+            uint32 nBits = (entry >> 24) & 15;
+            word >>= nBits;
+            iBitIndex += nBits;
+        }
+    }
+
+    for (; i < nCount; i++)
+    {
+        uint64 word = Huffman_Load64(pBuffer, iBitIndex >> 3, nBufferSize) >> (iBitIndex & 7);
+        uint32 entry = pTables->m_Single[word & ((1 << HUFFMAN_MAX_CODE_BITS) - 1)];
+        pOut[i] = (ubyte)entry;
+        iBitIndex += entry >> 8;
+    }
+    return iBitIndex;
+}
+
+/*
+===========================================================================
+
+   HuffmanEncodeBytes - закодировать nCount байт с бита iBitIndex.
+   Коды копятся в 64-битном регистре и сбрасываются в буфер по 4 байта.
+   Как и HuffmanPutBit, первый неполный байт дополняется через OR,
+   последующие перезаписываются целиком.
+
+   Возвращает номер бита после последнего кода или -1, если данные не
+   помещаются в nBufferSize (в буфер тогда ничего не пишется).
+
+===========================================================================
+*/
+inline int HuffmanEncodeBytes(ubyte *pBuffer, int nBufferSize, int iBitIndex, const ubyte *pIn, int nCount)
+{
+    const huffmantables_t *pTables = HuffmanTables();
+
+    int nTotalBits = iBitIndex;
+    for (int i = 0; i < nCount; i++)
+        nTotalBits += pTables->m_Lengths[pIn[i]];
+    if (((nTotalBits + 7) >> 3) > nBufferSize)
+        return -1;
+
+    ubyte *pOut = pBuffer + (iBitIndex >> 3);
+    int nAccBits = iBitIndex & 7;
+    uint64 acc = nAccBits ? pOut[0] : 0;
+
+    for (int i = 0; i < nCount; i++)
+    {
+        acc |= (uint64)pTables->m_Codes[pIn[i]] << nAccBits;
+        nAccBits += pTables->m_Lengths[pIn[i]];
+
+        if (nAccBits >= 32)
+        {
+            uint32 word = (uint32)acc;
+            memcpy(pOut, &word, 4);
+            pOut += 4;
+            acc >>= 32;
+            nAccBits -= 32;
+        }
+    }
+
+    for (; nAccBits > 0; nAccBits -= 8)
+    {
+        *pOut++ = (ubyte)acc;
+        acc >>= 8;
+    }
+    return nTotalBits;
+}
+
+/*
+===========================================================================
+
+   Пакетные аналоги MSG_WriteData/MSG_ReadData для msg_t.
+   Результат совпадает с побайтовым MSG_WriteBits(msg, c, 8) и
+   MSG_ReadByte: для out-of-band сообщений вызывается штатный путь.
+
+===========================================================================
+*/
+inline void MSG_WriteHuffmanData(msg_t *msg, const void *pData, int nLength)
+{
+    if (msg->oob)
+    {
+        MSG_WriteData(msg, pData, nLength);
+        return;
+    }
+    if (msg->bOverflowed || nLength <= 0)
+        return;
+
+    int iBit = HuffmanEncodeBytes(msg->pData, msg->nMaxsize, msg->iBit, (const ubyte *)pData, nLength);
+    if (iBit < 0 || iBit > msg->nMaxbits)
+    {
+        if (!msg->bAllowOverflow)
+            common()->Error("MSG_WriteHuffmanData: can't write %d bytes", nLength);
+        msg->bOverflowed = true;
+        return;
+    }
+    msg->iBit = iBit;
+    msg->nCursize = (iBit >> 3) + 1;
+}
+
+inline void MSG_ReadHuffmanData(msg_t *msg, void *pData, int nLength)
+{
+    if (nLength <= 0)
+        return;
+
+    ubyte *pOut = (ubyte *)pData;
+    if (!msg->oob && msg->iBit < msg->nMaxbits)
+    {
+        int iBit = HuffmanDecodeBytes(pOut, nLength, msg->pData, msg->nMaxsize, msg->iBit);
+        if ((iBit >> 3) + 1 <= msg->nCursize)
+        {
+            msg->iBit = iBit;
+            msg->nReadCount = (iBit >> 3) + 1;
+            return;
+        }
+    }
+
+    // чтение за концом сообщения: побайтово, с той же подстановкой 0xFF
+    for (int i = 0; i < nLength; i++)
+    {
+        int c = MSG_ReadByte(msg);
+        pOut[i] = c < 0 ? 0xFF : (ubyte)c;
+    }
+}
+
+/*
+===========================================================================
+
+   CMsgBitWriter - запись в msg_t через CBitWriter.
+
+   Результат совпадает с MSG_WriteBits бит в бит: в обычном режиме
+   младшие bits & 7 бит пишутся как есть, остальные байты - кодами
+   Хаффмана, в out-of-band режиме поля идут сырыми байтами.
+
+   Состояние msg_t обновляется в End, до этого сообщение не трогаем.
+   В отличие от MSG_WriteBits, переполнение обнаруживается до записи,
+   так что за nMaxsize ничего не пишется.
+
+===========================================================================
+*/
+class CMsgBitWriter
+{
+  public:
+    CMsgBitWriter(msg_t *msg);
+
+    void WriteBits(int iValue, int nBits);
+    void WriteByte(int c)
+    {
+        WriteBits(c, 8);
+    }
+    void WriteShort(int c)
+    {
+        WriteBits(c, 16);
+    }
+    void WriteLong(int c)
+    {
+        WriteBits(c, 32);
+    }
+    void WriteData(const void *pData, int nLength);
+    void WriteVarUInt(uint32 iValue);
+    void WriteVarInt(int iValue)
+    {
+        WriteVarUInt(ZigZagEncode32(iValue));
+    }
+    void WriteGamma(uint32 iValue);
+    void End();
+
+  private:
+    msg_t *m_pMsg;
+    CBitWriter m_Writer;
+    int m_iStartBit;
+    const huffmantables_t *m_pTables;
+
+    CMsgBitWriter(const CMsgBitWriter &w)
+    {
+    }
+    void operator=(const CMsgBitWriter &w)
+    {
+    }
+};
+
+inline CMsgBitWriter::CMsgBitWriter(msg_t *msg) : m_pMsg(msg), m_pTables(HuffmanTables())
+{
+    // out-of-band сообщение пишется с nCursize, обычное - с iBit
+    m_iStartBit = msg->oob ? msg->nCursize * 8 : msg->iBit;
+    m_Writer.Init(msg->pData, msg->nMaxsize, m_iStartBit);
+}
+
+inline void CMsgBitWriter::WriteBits(int iValue, int nBits)
+{
+    if (nBits == 0 || nBits < -31 || nBits > 32)
+        common()->Error("MSG_WriteBits: bad bits %i", nBits);
+
+    if (m_pMsg->bOverflowed || m_Writer.IsOverflowed())
+        return;
+    if (nBits < 0)
+        nBits = -nBits;
+
+    if (m_pMsg->oob)
+    {
+        if (nBits != 8 && nBits != 16 && nBits != 32)
+        {
+            common()->Error("can't write %d bits", nBits);
+            return;
+        }
+        m_Writer.WriteBits((uint32)iValue, nBits);
+        return;
+    }
+
+    uint32 iBits = (uint32)iValue & BitMask32(nBits);
+    int nRaw = nBits & 7;
+    int nBytes = nBits >> 3;
+
+    // размер известен заранее, поэтому одна проверка на всё поле
+    int nTotal = nRaw;
+    for (int i = 0; i < nBytes; i++)
+        nTotal += m_pTables->m_Lengths[(iBits >> (nRaw + i * 8)) & 0xFF];
+    if (!m_Writer.Reserve(nTotal))
+        return;
+
+    m_Writer.WriteBits(iBits, nRaw);
+    for (iBits >>= nRaw; nBytes > 0; nBytes--, iBits >>= 8)
+        m_Writer.WriteBits(m_pTables->m_Codes[iBits & 0xFF], m_pTables->m_Lengths[iBits & 0xFF]);
+}
+
+inline void CMsgBitWriter::WriteData(const void *pData, int nLength)
+{
+    if (m_pMsg->oob)
+    {
+        if (!m_pMsg->bOverflowed)
+            m_Writer.WriteBytes(pData, nLength);
+        return;
+    }
+
+    const ubyte *pIn = (const ubyte *)pData;
+    for (int i = 0; i < nLength; i++)
+        WriteBits(pIn[i], 8);
+}
+
+/*
+===========================================================================
+
+   Целые переменной длины в msg_t. Группы VarUInt идут байтами через
+   WriteBits(8), то есть в обычном режиме тоже сжимаются Хаффманом.
+   Gamma в обычном режиме пишется сырыми битами - так же, как
+   MSG_WriteBits пишет поля короче байта, - а в out-of-band режиме,
+   где отдельных бит нет, заменяется на VarUInt.
+
+===========================================================================
+*/
+inline void CMsgBitWriter::WriteVarUInt(uint32 iValue)
+{
+    for (; iValue >= 0x80; iValue >>= 7)
+        WriteBits((iValue & 0x7F) | 0x80, VARINT_GROUP_BITS);
+    WriteBits(iValue, VARINT_GROUP_BITS);
+}
+
+inline void CMsgBitWriter::WriteGamma(uint32 iValue)
+{
+    if (m_pMsg->oob)
+        WriteVarUInt(iValue);
+    else if (!m_pMsg->bOverflowed)
+        m_Writer.WriteGamma(iValue);
+}
+
+inline void CMsgBitWriter::End()
+{
+    if (m_pMsg->bOverflowed)
+        return;
+    if (m_Writer.IsOverflowed())
+    {
+        if (!m_pMsg->bAllowOverflow)
+            common()->Error("CMsgBitWriter::End: overflow");
+        m_pMsg->bOverflowed = true;
+        return;
+    }
+
+    m_Writer.Flush();
+
+    int iBit = m_Writer.GetBitIndex();
+    if (m_pMsg->oob)
+    {
+        m_pMsg->iBit += iBit - m_iStartBit;
+        m_pMsg->nCursize = iBit >> 3;
+    }
+    else if (iBit != m_iStartBit)
+    {
+        m_pMsg->iBit = iBit;
+        m_pMsg->nCursize = (iBit >> 3) + 1;
+    }
+}
+
+/*
+===========================================================================
+
+   CMsgBitReader - чтение msg_t через CBitReader, зеркально
+   CMsgBitWriter. ReadBits повторяет поведение чтения msg_t: за nMaxbits
+   возвращает 0, отрицательное число бит расширяет знак. ReadByte и
+   ReadData за концом nCursize отдают -1 и 0xFF, как MSG_ReadByte.
+
+===========================================================================
+*/
+class CMsgBitReader
+{
+  public:
+    CMsgBitReader(msg_t *msg);
+
+    int ReadBits(int nBits);
+    int ReadByte();
+    int ReadShort()
+    {
+        return ReadBits(-16);
+    }
+    int ReadLong()
+    {
+        return ReadBits(32);
+    }
+    void ReadData(void *pData, int nLength);
+    uint32 ReadVarUInt();
+    int ReadVarInt()
+    {
+        return ZigZagDecode32(ReadVarUInt());
+    }
+    uint32 ReadGamma();
+    bool ReadVarUIntArray(uint32 *pValues, int nCount);
+    void End();
+
+  private:
+    msg_t *m_pMsg;
+    CBitReader m_Reader;
+    int m_iStartBit;
+    const huffmantables_t *m_pTables;
+
+    int GetMsgBit() const;
+    int GetReadCount() const;
+
+    CMsgBitReader(const CMsgBitReader &r)
+    {
+    }
+    void operator=(const CMsgBitReader &r)
+    {
+    }
+};
+
+inline CMsgBitReader::CMsgBitReader(msg_t *msg) : m_pMsg(msg), m_pTables(HuffmanTables())
+{
+    m_iStartBit = msg->oob ? msg->nReadCount * 8 : msg->iBit;
+    m_Reader.Init(msg->pData, msg->nMaxsize, m_iStartBit);
+}
+
+// в out-of-band режиме iBit сообщения идёт отдельно от позиции чтения
+inline int CMsgBitReader::GetMsgBit() const
+{
+    return m_pMsg->oob ? m_pMsg->iBit + m_Reader.GetBitIndex() - m_iStartBit : m_Reader.GetBitIndex();
+}
+
+inline int CMsgBitReader::GetReadCount() const
+{
+    int iBit = m_Reader.GetBitIndex();
+    return m_pMsg->oob ? iBit >> 3 : (iBit >> 3) + 1;
+}
+
+inline int CMsgBitReader::ReadBits(int nBits)
+{
+    if (GetMsgBit() >= m_pMsg->nMaxbits)
+        return 0;
+
+    bool bSigned = nBits < 0;
+    if (bSigned)
+        nBits = -nBits;
+
+    uint32 iValue = 0;
+    int nSignBits = nBits;
+    if (m_pMsg->oob)
+    {
+        if (nBits != 8 && nBits != 16 && nBits != 32)
+        {
+            common()->Error("can't read %d bits", nBits);
+            return 0;
+        }
+
+        // 16-битные значения out-of-band всегда знаковые
+        iValue = m_Reader.ReadBits(nBits);
+        if (nBits == 16)
+            iValue = (uint32)(int)(int16)iValue;
+    }
+    else
+    {
+        int nRaw = nBits & 7;
+        iValue = m_Reader.PeekBits(nRaw);
+        m_Reader.SkipBits(nRaw);
+
+        // штатное чтение расширяет знак только по ширине байтовой части
+        nSignBits = nBits - nRaw;
+
+        for (int iShift = nRaw; iShift < nBits; iShift += 8)
+        {
+            uint32 entry = m_pTables->m_Single[m_Reader.PeekBits(HUFFMAN_MAX_CODE_BITS)];
+            iValue |= (entry & 0xFF) << iShift;
+            m_Reader.SkipBits(entry >> 8);
+        }
+    }
+
+    if (bSigned && nSignBits > 0 && nSignBits < 32 && (iValue & BIT(nSignBits - 1)))
+        iValue |= ~BitMask32(nSignBits);
+    return (int)iValue;
+}
+
+inline int CMsgBitReader::ReadByte()
+{
+    int c = (ubyte)ReadBits(8);
+    if (GetReadCount() > m_pMsg->nCursize)
+        c = -1;
+    return c;
+}
+
+inline void CMsgBitReader::ReadData(void *pData, int nLength)
+{
+    ubyte *pOut = (ubyte *)pData;
+    for (int i = 0; i < nLength; i++)
+    {
+        int c = ReadByte();
+        pOut[i] = c < 0 ? 0xFF : (ubyte)c;
+    }
+}
+
+// за концом сообщения или на испорченном числе - 0
+inline uint32 CMsgBitReader::ReadVarUInt()
+{
+    if (m_pMsg->oob)
+    {
+        CBitReader reader(m_pMsg->pData, m_pMsg->nCursize, m_Reader.GetBitIndex());
+        uint32 iValue;
+        if (!reader.ReadVarUIntArray(&iValue, 1))
+            return 0;
+        m_Reader.SkipBits(reader.GetBitIndex() - m_Reader.GetBitIndex());
+        return iValue;
+    }
+
+    uint32 iValue = 0;
+    for (int i = 0; i < VARINT_MAX_GROUPS_32; i++)
+    {
+        int group = ReadByte();
+        if (group < 0)
+            return 0;
+
+        iValue |= (uint32)(group & 0x7F) << (i * 7);
+        if (!(group & 0x80))
+            return iValue;
+    }
+    return 0;
+}
+
+inline uint32 CMsgBitReader::ReadGamma()
+{
+    if (m_pMsg->oob)
+        return ReadVarUInt();
+    if (GetMsgBit() >= m_pMsg->nMaxbits)
+        return 0;
+
+    return m_Reader.ReadGamma();
+}
+
+// out-of-band числа лежат сырыми байтами и читаются пакетно
+inline bool CMsgBitReader::ReadVarUIntArray(uint32 *pValues, int nCount)
+{
+    if (m_pMsg->oob)
+    {
+        CBitReader reader(m_pMsg->pData, m_pMsg->nCursize, m_Reader.GetBitIndex());
+        if (!reader.ReadVarUIntArray(pValues, nCount))
+            return false;
+        m_Reader.SkipBits(reader.GetBitIndex() - m_Reader.GetBitIndex());
+        return true;
+    }
+
+    for (int i = 0; i < nCount; i++)
+    {
+        pValues[i] = ReadVarUInt();
+        if (GetReadCount() > m_pMsg->nCursize)
+            return false;
+    }
+    return true;
+}
+
+inline void CMsgBitReader::End()
+{
+    if (m_Reader.GetBitIndex() == m_iStartBit)
+        return;
+
+    m_pMsg->nReadCount = GetReadCount();
+    m_pMsg->iBit = GetMsgBit();
+}
+
+/*
+===========================================================================
+
+   MSG_WriteVarUInt/MSG_ReadVarUInt и остальные - одиночные числа
+   переменной длины в духе MSG_WriteShort/MSG_ReadShort.
+
+===========================================================================
+*/
+inline void MSG_WriteVarUInt(msg_t *msg, uint32 iValue)
+{
+    CMsgBitWriter writer(msg);
+    writer.WriteVarUInt(iValue);
+    writer.End();
+}
+
+inline void MSG_WriteVarInt(msg_t *msg, int iValue)
+{
+    MSG_WriteVarUInt(msg, ZigZagEncode32(iValue));
+}
+
+inline void MSG_WriteGamma(msg_t *msg, uint32 iValue)
+{
+    CMsgBitWriter writer(msg);
+    writer.WriteGamma(iValue);
+    writer.End();
+}
+
+inline uint32 MSG_ReadVarUInt(msg_t *msg)
+{
+    CMsgBitReader reader(msg);
+    uint32 iValue = reader.ReadVarUInt();
+    reader.End();
+    return iValue;
+}
+
+inline int MSG_ReadVarInt(msg_t *msg)
+{
+    return ZigZagDecode32(MSG_ReadVarUInt(msg));
+}
+
+inline uint32 MSG_ReadGamma(msg_t *msg)
+{
+    CMsgBitReader reader(msg);
+    uint32 iValue = reader.ReadGamma();
+    reader.End();
+    return iValue;
+}
+
+inline bool MSG_ReadVarUIntArray(msg_t *msg, uint32 *pValues, int nCount)
+{
+    CMsgBitReader reader(msg);
+    bool bResult = reader.ReadVarUIntArray(pValues, nCount);
+    reader.End();
+    return bResult;
+}
+
+#endif /* HAYATOLABS_HUFFMAN_H */
@@ -0,0 +1,302 @@
+/*
+  This file associated with Hayato Labs project.
+
+  For license and copyright information please follow this link:
+  https://github.com/hayatolabs/general/blob/main/LEGAL
+*/
+
+#ifndef HAYATOLABS_MEMALLOCATOR_H
+#define HAYATOLABS_MEMALLOCATOR_H
+
+#include "memtlsf.h"
+#include <new>
+
+#if __cplusplus >= 201703L || (defined(_MSVC_LANG) && _MSVC_LANG >= 201703L)
+#define MEMALLOC_HAS_PMR
+#include <memory_resource>
+#endif
+
+#define MEMALLOC_NATURAL_ALIGN 8 // выравнивание, которое гарантируют зона и менеджер памяти
+
+/*
+===========================================================================
+
+   Источники памяти для адаптеров: общий менеджер с тэгом или зона.
+   Выравнивание больше MEMALLOC_NATURAL_ALIGN делается с запасом,
+   исходный указатель хранится прямо перед выданным. Общий менеджер
+   вызывается под MemGeneralZoneMutex.
+
+===========================================================================
+*/
+struct memorytagsource_t
+{
+    memorytag_t m_iTag;
+
+    void *Malloc(size_t nSize) const
+    {
+        CScopedCriticalSection lock(MemGeneralZoneMutex());
+        return g_pMemoryManager->Malloc(nSize, m_iTag);
+    }
+    void Free(void *ptr) const
+    {
+        CScopedCriticalSection lock(MemGeneralZoneMutex());
+        g_pMemoryManager->Free(ptr);
+    }
+    bool operator==(const memorytagsource_t &) const
+    {
+        return true; // освобождать можно через любой тэг
+    }
+};
+
+struct memoryzonesource_t
+{
+    memoryzone_t *m_pZone;
+    CMemoryZone *m_pMemoryZone; // если задана, m_pZone не используется
+    memorytag_t m_iTag;
+
+    void *Malloc(size_t nSize) const
+    {
+        return m_pMemoryZone ? m_pMemoryZone->Malloc(nSize, m_iTag) : m_pZone->Malloc(nSize, m_iTag);
+    }
+    void Free(void *ptr) const
+    {
+        if (m_pMemoryZone)
+            m_pMemoryZone->Free(ptr);
+        else
+            m_pZone->Free(ptr);
+    }
+    bool operator==(const memoryzonesource_t &other) const
+    {
+        return m_pZone == other.m_pZone && m_pMemoryZone == other.m_pMemoryZone;
+    }
+};
+
+template <typename Source> void *MemAlloc_Malloc(const Source &source, size_t nSize, size_t nAlign)
+{
+    if (nAlign <= MEMALLOC_NATURAL_ALIGN)
+        return source.Malloc(nSize);
+    if (nSize > SIZE_MAX - nAlign - sizeof(void *))
+        return NULL;
+
+    ubyte *pBase = (ubyte *)source.Malloc(nSize + nAlign + sizeof(void *));
+    if (!pBase)
+        return NULL;
+
+    ubyte *pResult = (ubyte *)(((uintptr_t)pBase + sizeof(void *) + nAlign - 1) & ~(uintptr_t)(nAlign - 1));
+    ((void **)pResult)[-1] = pBase;
+    return pResult;
+}
+
+template <typename Source> void MemAlloc_Free(const Source &source, void *ptr, size_t nAlign)
+{
+    if (ptr)
+        source.Free(nAlign <= MEMALLOC_NATURAL_ALIGN ? ptr : ((void **)ptr)[-1]);
+}
+
+/*
+===========================================================================
+
+   CTagAllocator - аллокатор для контейнеров STL, выделяющий память
+   через g_pMemoryManager под заданным тэгом.
+
+   CTagVector<CFoo, TAG_RESOURCE> m_Items;
+
+===========================================================================
+*/
+template <typename T, memorytag_t iTag = TAG_GENERAL> class CTagAllocator
+{
+  public:
+    typedef T value_type;
+    template <typename U> struct rebind
+    {
+        typedef CTagAllocator<U, iTag> other;
+    };
+
+    CTagAllocator() noexcept
+    {
+    }
+    template <typename U> CTagAllocator(const CTagAllocator<U, iTag> &) noexcept
+    {
+    }
+
+    T *allocate(size_t nCount)
+    {
+        if (nCount > SIZE_MAX / sizeof(T))
+            throw std::bad_array_new_length();
+
+        memorytagsource_t source = {iTag};
+        void *ptr = MemAlloc_Malloc(source, nCount * sizeof(T), alignof(T));
+        if (!ptr)
+            throw std::bad_alloc();
+        return (T *)ptr;
+    }
+    void deallocate(T *ptr, size_t) noexcept
+    {
+        memorytagsource_t source = {iTag};
+        MemAlloc_Free(source, ptr, alignof(T));
+    }
+};
+
+template <typename T, typename U, memorytag_t iTag>
+bool operator==(const CTagAllocator<T, iTag> &, const CTagAllocator<U, iTag> &)
+{
+    return true;
+}
+
+template <typename T, typename U, memorytag_t iTag>
+bool operator!=(const CTagAllocator<T, iTag> &, const CTagAllocator<U, iTag> &)
+{
+    return false;
+}
+
+/*
+===========================================================================
+
+   CZoneAllocator - аллокатор для контейнеров STL поверх конкретной
+   зоны. Зона не потокобезопасна и должна жить дольше контейнера.
+
+   CZoneVector<CFoo> m_Items(CZoneAllocator<CFoo>(pZone, TAG_RESOURCE));
+
+===========================================================================
+*/
+template <typename T> class CZoneAllocator
+{
+  public:
+    typedef T value_type;
+
+    CZoneAllocator(memoryzone_t *pZone, memorytag_t iTag = TAG_GENERAL) noexcept
+    {
+        m_Source.m_pZone = pZone;
+        m_Source.m_pMemoryZone = NULL;
+        m_Source.m_iTag = iTag;
+    }
+    CZoneAllocator(CMemoryZone *pMemoryZone, memorytag_t iTag = TAG_GENERAL) noexcept
+    {
+        m_Source.m_pZone = NULL;
+        m_Source.m_pMemoryZone = pMemoryZone;
+        m_Source.m_iTag = iTag;
+    }
+    template <typename U> CZoneAllocator(const CZoneAllocator<U> &other) noexcept : m_Source(other.GetSource())
+    {
+    }
+
+    T *allocate(size_t nCount)
+    {
+        if (nCount > SIZE_MAX / sizeof(T))
+            throw std::bad_array_new_length();
+
+        void *ptr = MemAlloc_Malloc(m_Source, nCount * sizeof(T), alignof(T));
+        if (!ptr)
+            throw std::bad_alloc();
+        return (T *)ptr;
+    }
+    void deallocate(T *ptr, size_t) noexcept
+    {
+        MemAlloc_Free(m_Source, ptr, alignof(T));
+    }
+
+    const memoryzonesource_t &GetSource() const
+    {
+        return m_Source;
+    }
+
+  private:
+    memoryzonesource_t m_Source;
+};
+
+template <typename T, typename U> bool operator==(const CZoneAllocator<T> &a, const CZoneAllocator<U> &b)
+{
+    return a.GetSource() == b.GetSource();
+}
+
+template <typename T, typename U> bool operator!=(const CZoneAllocator<T> &a, const CZoneAllocator<U> &b)
+{
+    return !(a.GetSource() == b.GetSource());
+}
+
+template <typename T, memorytag_t iTag> using CTagVector = std::vector<T, CTagAllocator<T, iTag>>;
+template <memorytag_t iTag> using CTagString = std::basic_string<char, std::char_traits<char>, CTagAllocator<char, iTag>>;
+template <typename T> using CZoneVector = std::vector<T, CZoneAllocator<T>>;
+typedef std::basic_string<char, std::char_traits<char>, CZoneAllocator<char>> CZoneString;
+
+#ifdef MEMALLOC_HAS_PMR
+/*
+===========================================================================
+
+   Полиморфные ресурсы для std::pmr контейнеров: тип контейнера
+   не зависит от того, откуда берётся память.
+
+   CZoneMemoryResource resource(pZone, TAG_RESOURCE);
+   std::pmr::vector<CFoo> m_Items(&resource);
+
+===========================================================================
+*/
+class CTagMemoryResource : public std::pmr::memory_resource
+{
+  public:
+    CTagMemoryResource(memorytag_t iTag = TAG_GENERAL)
+    {
+        m_Source.m_iTag = iTag;
+    }
+
+  protected:
+    void *do_allocate(size_t nSize, size_t nAlign) override
+    {
+        void *ptr = MemAlloc_Malloc(m_Source, nSize, nAlign);
+        if (!ptr)
+            throw std::bad_alloc();
+        return ptr;
+    }
+    void do_deallocate(void *ptr, size_t, size_t nAlign) override
+    {
+        MemAlloc_Free(m_Source, ptr, nAlign);
+    }
+    bool do_is_equal(const std::pmr::memory_resource &other) const noexcept override
+    {
+        return dynamic_cast<const CTagMemoryResource *>(&other) != NULL;
+    }
+
+  private:
+    memorytagsource_t m_Source;
+};
+
+class CZoneMemoryResource : public std::pmr::memory_resource
+{
+  public:
+    CZoneMemoryResource(memoryzone_t *pZone, memorytag_t iTag = TAG_GENERAL)
+    {
+        m_Source.m_pZone = pZone;
+        m_Source.m_pMemoryZone = NULL;
+        m_Source.m_iTag = iTag;
+    }
+    CZoneMemoryResource(CMemoryZone *pMemoryZone, memorytag_t iTag = TAG_GENERAL)
+    {
+        m_Source.m_pZone = NULL;
+        m_Source.m_pMemoryZone = pMemoryZone;
+        m_Source.m_iTag = iTag;
+    }
+
+  protected:
+    void *do_allocate(size_t nSize, size_t nAlign) override
+    {
+        void *ptr = MemAlloc_Malloc(m_Source, nSize, nAlign);
+        if (!ptr)
+            throw std::bad_alloc();
+        return ptr;
+    }
+    void do_deallocate(void *ptr, size_t, size_t nAlign) override
+    {
+        MemAlloc_Free(m_Source, ptr, nAlign);
+    }
+    bool do_is_equal(const std::pmr::memory_resource &other) const noexcept override
+    {
+        const CZoneMemoryResource *pOther = dynamic_cast<const CZoneMemoryResource *>(&other);
+        return pOther && pOther->m_Source == m_Source;
+    }
+
+  private:
+    memoryzonesource_t m_Source;
+};
+#endif // MEMALLOC_HAS_PMR
+
+#endif /* HAYATOLABS_MEMALLOCATOR_H */
@@ -0,0 +1,214 @@
+/*
+  This file associated with Hayato Labs project.
+
+  For license and copyright information please follow this link:
+  https://github.com/hayatolabs/general/blob/main/LEGAL
+*/
+
+#ifndef HAYATOLABS_MEMDEBUG_H
+#define HAYATOLABS_MEMDEBUG_H
+
+#include "mem.h"
+#include "thread.h"
+
+#define MEMDEBUG_INITIAL_SIZE 1024 // начальное число ячеек таблицы, степень двойки
+
+/*
+===========================================================================
+
+   memorydebuginfo_t
+   Происхождение выделения. Хранится отдельно от заголовка блока
+   и только для выделений, сделанных через MallocDebug
+
+===========================================================================
+*/
+struct memorydebuginfo_t
+{
+    const void *m_pAddress; // NULL - ячейка пуста
+    const char *m_szFnname;
+    const char *m_szFilename;
+    int m_iLine;
+    memorytag_t m_iTag;
+    size_t m_nAllocationSize;
+};
+
+/*
+===========================================================================
+
+   CMemoryDebugTable - хэш-таблица с открытой адресацией:
+   адрес выделения -> memorydebuginfo_t
+
+===========================================================================
+*/
+class CMemoryDebugTable
+{
+  public:
+    CMemoryDebugTable() : m_pEntries(NULL), m_nCapacity(0), m_nCount(0)
+    {
+    }
+    ~CMemoryDebugTable()
+    {
+        if (m_pEntries)
+        {
+            CScopedCriticalSection lock(MemGeneralZoneMutex());
+            g_pMemoryManager->Free(m_pEntries);
+        }
+    }
+
+    void Insert(const void *ptr, memorytag_t iTag, size_t nSize, const char *pszFnname, const char *pszFilename,
+                int iLine);
+    void Remove(const void *ptr);
+    bool Find(const void *ptr, memorydebuginfo_t &info);
+    void LogLeaks(); // Вывести все выделения, которые ещё не освобождены
+
+    int GetCount() const
+    {
+        return m_nCount;
+    }
+
+  private:
+    memorydebuginfo_t *m_pEntries;
+    int m_nCapacity;
+    int m_nCount;
+    CSystemMutex m_Mutex;
+
+    static uint32 HashPointer(const void *ptr)
+    {
+        uint64 x = (uint64)(uintptr_t)ptr;
+        x ^= x >> 33;
+        x *= 0xff51afd7ed558ccdULL;
+        x ^= x >> 33;
+        return (uint32)x;
+    }
+
+    int FindSlot(const void *ptr) const;
+    bool Grow();
+};
+
+inline int CMemoryDebugTable::FindSlot(const void *ptr) const
+{
+    int iMask = m_nCapacity - 1;
+    for (int i = HashPointer(ptr) & iMask;; i = (i + 1) & iMask)
+    {
+        if (m_pEntries[i].m_pAddress == ptr || !m_pEntries[i].m_pAddress)
+            return i;
+    }
+}
+
+// Вызывается под m_Mutex; общая зона - под своим мьютексом, m_Mutex её не охраняет
+inline bool CMemoryDebugTable::Grow()
+{
+    int nOldCapacity = m_nCapacity;
+    memorydebuginfo_t *pOldEntries = m_pEntries;
+
+    int nCapacity = nOldCapacity ? nOldCapacity * 2 : MEMDEBUG_INITIAL_SIZE;
+    memorydebuginfo_t *pEntries;
+    {
+        CScopedCriticalSection lock(MemGeneralZoneMutex());
+        pEntries = (memorydebuginfo_t *)g_pMemoryManager->Malloc(sizeof(memorydebuginfo_t) * nCapacity, TAG_NONE);
+    }
+    if (!pEntries)
+        return false;
+
+    memset(pEntries, 0, sizeof(memorydebuginfo_t) * nCapacity);
+    m_pEntries = pEntries;
+    m_nCapacity = nCapacity;
+
+    for (int i = 0; i < nOldCapacity; i++)
+    {
+        if (pOldEntries[i].m_pAddress)
+            m_pEntries[FindSlot(pOldEntries[i].m_pAddress)] = pOldEntries[i];
+    }
+
+    if (pOldEntries)
+    {
+        CScopedCriticalSection lock(MemGeneralZoneMutex());
+        g_pMemoryManager->Free(pOldEntries);
+    }
+    return true;
+}
+
+inline void CMemoryDebugTable::Insert(const void *ptr, memorytag_t iTag, size_t nSize, const char *pszFnname,
+                                      const char *pszFilename, int iLine)
+{
+    CScopedCriticalSection lock(m_Mutex);
+
+    // держим заполнение не выше 3/4
+    if ((m_nCount + 1) * 4 > m_nCapacity * 3 && !Grow())
+        return;
+
+    memorydebuginfo_t &info = m_pEntries[FindSlot(ptr)];
+    if (!info.m_pAddress)
+        m_nCount++;
+
+    info.m_pAddress = ptr;
+    info.m_szFnname = pszFnname;
+    info.m_szFilename = pszFilename;
+    info.m_iLine = iLine;
+    info.m_iTag = iTag;
+    info.m_nAllocationSize = nSize;
+}
+
+inline void CMemoryDebugTable::Remove(const void *ptr)
+{
+    CScopedCriticalSection lock(m_Mutex);
+    if (!m_nCount)
+        return;
+
+    int iMask = m_nCapacity - 1;
+    int i = FindSlot(ptr);
+    if (!m_pEntries[i].m_pAddress)
+        return;
+
+    m_pEntries[i].m_pAddress = NULL;
+    m_nCount--;
+
+    // сдвигаем хвост цепочки, чтобы не оставлять дыр при линейном пробировании
+    for (int j = (i + 1) & iMask; m_pEntries[j].m_pAddress; j = (j + 1) & iMask)
+    {
+        int iHome = HashPointer(m_pEntries[j].m_pAddress) & iMask;
+        if (((j - iHome) & iMask) >= ((j - i) & iMask))
+        {
+            m_pEntries[i] = m_pEntries[j];
+            m_pEntries[j].m_pAddress = NULL;
+            i = j;
+        }
+    }
+}
+
+inline bool CMemoryDebugTable::Find(const void *ptr, memorydebuginfo_t &info)
+{
+    CScopedCriticalSection lock(m_Mutex);
+    if (!m_nCount)
+        return false;
+
+    const memorydebuginfo_t &entry = m_pEntries[FindSlot(ptr)];
+    if (!entry.m_pAddress)
+        return false;
+
+    info = entry;
+    return true;
+}
+
+inline void CMemoryDebugTable::LogLeaks()
+{
+    CScopedCriticalSection lock(m_Mutex);
+    for (int i = 0; i < m_nCapacity; i++)
+    {
+        const memorydebuginfo_t &info = m_pEntries[i];
+        if (!info.m_pAddress)
+            continue;
+
+        common()->Print("[%s, iLine: %d, in: %s() m_iTag: %d] - leak m_nSize: %d bytes\n", info.m_szFilename,
+                        info.m_iLine, info.m_szFnname, info.m_iTag, (int)info.m_nAllocationSize);
+    }
+}
+
+// Общая таблица происхождения для слябов и TLSF-зон
+inline CMemoryDebugTable *memdebugtable()
+{
+    static CMemoryDebugTable s_DebugTable;
+    return &s_DebugTable;
+}
+
+#endif /* HAYATOLABS_MEMDEBUG_H */
@@ -0,0 +1,237 @@
+/*
+  This file associated with Hayato Labs project.
+
+  For license and copyright information please follow this link:
+  https://github.com/hayatolabs/general/blob/main/LEGAL
+*/
+
+#ifndef HAYATOLABS_MEMFRAME_H
+#define HAYATOLABS_MEMFRAME_H
+
+#include "mem.h"
+#include "memvirtual.h"
+#include <atomic>
+
+#define MEMFRAME_CHUNK_SIZE (64 * 1024) // минимальный размер куска арены
+#define MEMFRAME_DEFAULT_ALIGN 16
+
+/*
+===========================================================================
+
+   Номер текущего кадра для кадровых арен.
+   MemFrameAdvance() вызывается главным циклом вместе с common()->Frame(),
+   арены потоков замечают смену кадра при следующем выделении.
+
+===========================================================================
+*/
+inline std::atomic<uint32> &MemFrame_Counter()
+{
+    static std::atomic<uint32> s_iFrame(0);
+    return s_iFrame;
+}
+
+inline void MemFrameAdvance()
+{
+    MemFrame_Counter().fetch_add(1, std::memory_order_release);
+}
+
+/*
+===========================================================================
+
+   memoryframechunk_t
+
+===========================================================================
+*/
+struct memoryframechunk_t
+{
+    memoryframechunk_t *m_pNext;
+    memoryvirtualregion_t m_Region; // отображение, в начале которого лежит сам кусок
+};
+
+struct memoryframebuffer_t
+{
+    memoryframechunk_t *m_pChunks; // текущий кусок - первый в списке
+    ubyte *m_pCursor;
+    ubyte *m_pEnd;
+    size_t m_nUsed; // сколько байт выдано за кадр, включая выравнивание
+};
+
+/*
+===========================================================================
+
+   CFrameArena - линейная арена одного потока.
+   Память не освобождается поштучно: буфер целиком сбрасывается при
+   смене кадра. Буферов два, поэтому данные прошлого кадра живут ещё
+   один тик и их можно передать следующему кадру без копирования.
+
+   Куски берутся прямо у системы (memoryvirtualregion_t): общая зона
+   не потокобезопасна, а арены живут в рабочих потоках. Куски
+   переиспользуются, в установившемся режиме система не вызывается.
+
+===========================================================================
+*/
+class CFrameArena
+{
+  public:
+    CFrameArena() : m_iFrame(MemFrame_Counter().load(std::memory_order_acquire)), m_iCurrent(0)
+    {
+        memset(m_Buffers, 0, sizeof(m_Buffers));
+    }
+    ~CFrameArena()
+    {
+        ReleaseBuffer(m_Buffers[0]);
+        ReleaseBuffer(m_Buffers[1]);
+    }
+
+    void *Alloc(size_t nSize, size_t nAlign = MEMFRAME_DEFAULT_ALIGN);
+
+    size_t GetUsedBytes() const
+    {
+        return m_Buffers[m_iCurrent].m_nUsed;
+    }
+
+  private:
+    uint32 m_iFrame; // кадр, к которому относится m_Buffers[m_iCurrent]
+    int m_iCurrent;
+    memoryframebuffer_t m_Buffers[2];
+
+    void SyncFrame();
+    void ResetBuffer(memoryframebuffer_t &buffer);
+    void ReleaseBuffer(memoryframebuffer_t &buffer);
+    bool GrowBuffer(memoryframebuffer_t &buffer, size_t nSize);
+
+    CFrameArena(const CFrameArena &s)
+    {
+    }
+    void operator=(const CFrameArena &s)
+    {
+    }
+};
+
+inline void CFrameArena::ReleaseBuffer(memoryframebuffer_t &buffer)
+{
+    while (buffer.m_pChunks)
+    {
+        memoryframechunk_t *pChunk = buffer.m_pChunks;
+        buffer.m_pChunks = pChunk->m_pNext;
+
+        memoryvirtualregion_t region = pChunk->m_Region;
+        region.Unmap();
+    }
+    buffer.m_pCursor = buffer.m_pEnd = NULL;
+    buffer.m_nUsed = 0;
+}
+
+inline bool CFrameArena::GrowBuffer(memoryframebuffer_t &buffer, size_t nSize)
+{
+    if (nSize > SIZE_MAX - sizeof(memoryframechunk_t))
+        return false;
+
+    memoryvirtualregion_t region;
+    if (!region.Map(Max<size_t>(MEMFRAME_CHUNK_SIZE, nSize + sizeof(memoryframechunk_t))))
+        return false;
+
+    // размер округлён до страницы, хвост тоже идёт в дело
+    memoryframechunk_t *pChunk = (memoryframechunk_t *)region.m_pBase;
+    size_t nChunkSize = region.m_nSize;
+    pChunk->m_Region = region;
+    pChunk->m_pNext = buffer.m_pChunks;
+    buffer.m_pChunks = pChunk;
+    buffer.m_pCursor = (ubyte *)(pChunk + 1);
+    buffer.m_pEnd = (ubyte *)pChunk + nChunkSize;
+    return true;
+}
+
+inline void CFrameArena::ResetBuffer(memoryframebuffer_t &buffer)
+{
+    if (!buffer.m_pChunks)
+        return;
+
+    // кадр не уместился в один кусок - заменяем цепочку одним куском на весь объём
+    if (buffer.m_pChunks->m_pNext)
+    {
+        size_t nUsed = buffer.m_nUsed;
+        ReleaseBuffer(buffer);
+        GrowBuffer(buffer, nUsed);
+    }
+    else
+    {
+        buffer.m_pCursor = (ubyte *)(buffer.m_pChunks + 1);
+    }
+    buffer.m_nUsed = 0;
+}
+
+inline void CFrameArena::SyncFrame()
+{
+    uint32 iFrame = MemFrame_Counter().load(std::memory_order_acquire);
+    if (iFrame == m_iFrame)
+        return;
+
+    // прошлый кадр остаётся в соседнем буфере, позапрошлый сбрасывается
+    m_iCurrent ^= 1;
+    ResetBuffer(m_Buffers[m_iCurrent]);
+    if (iFrame - m_iFrame > 1)
+        ResetBuffer(m_Buffers[m_iCurrent ^ 1]);
+    m_iFrame = iFrame;
+}
+
+inline void *CFrameArena::Alloc(size_t nSize, size_t nAlign)
+{
+    // выравнивание считается маской
+    if (!nAlign || (nAlign & (nAlign - 1)) || nSize > SIZE_MAX - nAlign)
+        return NULL;
+
+    SyncFrame();
+
+    memoryframebuffer_t &buffer = m_Buffers[m_iCurrent];
+    ubyte *pResult = (ubyte *)(((uintptr_t)buffer.m_pCursor + nAlign - 1) & ~(uintptr_t)(nAlign - 1));
+    if (!buffer.m_pCursor || pResult + nSize > buffer.m_pEnd)
+    {
+        if (!GrowBuffer(buffer, nSize + nAlign))
+            return NULL;
+        pResult = (ubyte *)(((uintptr_t)buffer.m_pCursor + nAlign - 1) & ~(uintptr_t)(nAlign - 1));
+    }
+
+    buffer.m_nUsed += (pResult + nSize) - buffer.m_pCursor;
+    buffer.m_pCursor = pResult + nSize;
+    return pResult;
+}
+
+inline CFrameArena *MemFrame_ThreadArena()
+{
+    static thread_local CFrameArena s_Arena;
+    return &s_Arena;
+}
+
+/*
+===========================================================================
+
+   Выделения на время кадра. Освобождать не нужно, память действительна
+   до конца следующего кадра. Деструкторы объектов не вызываются.
+   Выравнивание - степень двойки, иначе возвращается NULL.
+
+===========================================================================
+*/
+inline void *FrameAlloc(size_t nSize, size_t nAlign = MEMFRAME_DEFAULT_ALIGN)
+{
+    return MemFrame_ThreadArena()->Alloc(nSize, nAlign);
+}
+
+template <typename T> T *FrameAllocArray(size_t nCount)
+{
+    // иначе произведение переполнится и вернётся короткий буфер
+    if (nCount > SIZE_MAX / sizeof(T))
+        return NULL;
+    return (T *)FrameAlloc(sizeof(T) * nCount, alignof(T) > MEMFRAME_DEFAULT_ALIGN ? alignof(T) : MEMFRAME_DEFAULT_ALIGN);
+}
+
+inline char *FrameStrdup(const char *pszSource)
+{
+    size_t nLength = strlen(pszSource) + 1;
+    char *pszResult = (char *)FrameAlloc(nLength, 1);
+    if (pszResult)
+        memcpy(pszResult, pszSource, nLength);
+    return pszResult;
+}
+
+#endif /* HAYATOLABS_MEMFRAME_H */
@@ -0,0 +1,269 @@
+/*
+  This file associated with Hayato Labs project.
+
+  For license and copyright information please follow this link:
+  https://github.com/hayatolabs/general/blob/main/LEGAL
+*/
+
+#ifndef HAYATOLABS_MEMPOOL_H
+#define HAYATOLABS_MEMPOOL_H
+
+#include "mem.h"
+#include "thread.h"
+#include <new>
+#include <utility>
+
+typedef uint32 poolhandle_t;
+
+#define POOL_HANDLE_INVALID 0
+#define POOL_INDEX_BITS 20 // до миллиона объектов в пуле
+#define POOL_GENERATION_BITS (32 - POOL_INDEX_BITS)
+#define POOL_MAX_OBJECTS (1 << POOL_INDEX_BITS)
+#define POOL_INDEX_NONE 0xFFFFFFFF
+
+inline uint32 PoolHandleIndex(poolhandle_t hObject)
+{
+    return hObject & (POOL_MAX_OBJECTS - 1);
+}
+
+inline uint32 PoolHandleGeneration(poolhandle_t hObject)
+{
+    return hObject >> POOL_INDEX_BITS;
+}
+
+/*
+===========================================================================
+
+   CObjectPool - пул объектов одного типа.
+
+   Объекты лежат в кусках по nChunkSize штук и не переезжают, пока
+   живы. Свободные ячейки связаны в список через сами ячейки.
+   Снаружи объект адресуется 32-битным хэндлом: индекс ячейки и
+   поколение. Поколение меняется при каждом создании и удалении
+   (у живого объекта оно нечётное), поэтому устаревший хэндл
+   распознаётся одним сравнением.
+
+   Живые объекты дополнительно перечислены в плотном массиве,
+   обход не просматривает пустые ячейки.
+
+   Как и зоны, пул не потокобезопасен. Память берётся из общей зоны
+   под MemGeneralZoneMutex, так что разные пулы могут жить в разных
+   потоках.
+
+===========================================================================
+*/
+template <typename T, int nChunkSize = 256> class CObjectPool
+{
+  public:
+    CObjectPool(memorytag_t iTag = TAG_GENERAL)
+        : m_pChunks(NULL), m_nChunks(0), m_pDense(NULL), m_nDenseCapacity(0), m_nCount(0), m_nSlots(0),
+          m_iFreeHead(POOL_INDEX_NONE), m_iTag(iTag)
+    {
+    }
+    ~CObjectPool()
+    {
+        Clear();
+        for (int i = 0; i < m_nChunks; i++)
+            ZoneFree(m_pChunks[i]);
+        if (m_pChunks)
+            ZoneFree(m_pChunks);
+        if (m_pDense)
+            ZoneFree(m_pDense);
+    }
+
+    template <typename... Args> poolhandle_t Create(Args &&...args);
+    void Destroy(poolhandle_t hObject);
+    void Clear(); // Удалить все объекты, память остаётся за пулом
+
+    T *Get(poolhandle_t hObject) const; // NULL, если хэндл устарел
+    bool IsValid(poolhandle_t hObject) const
+    {
+        return Get(hObject) != NULL;
+    }
+    poolhandle_t GetHandle(const T *pObject) const;
+
+    // Плотный обход: for (int i = 0; i < pool.GetCount(); i++) pool.GetDense(i)->...
+    int GetCount() const
+    {
+        return m_nCount;
+    }
+    T *GetDense(int i) const
+    {
+        return (T *)&GetSlot(m_pDense[i])->m_Data;
+    }
+    template <typename Func> void ForEach(Func func) const
+    {
+        for (int i = 0; i < m_nCount; i++)
+            func(*GetDense(i));
+    }
+
+  private:
+    struct poolslot_t
+    {
+        alignas(T) ubyte m_Data[sizeof(T)];
+        uint32 m_iGeneration;
+        uint32 m_iIndex;
+        uint32 m_iLink; // следующая свободная ячейка или место в m_pDense
+    };
+
+    poolslot_t **m_pChunks;
+    int m_nChunks;
+    uint32 *m_pDense; // индексы живых ячеек
+    int m_nDenseCapacity;
+    int m_nCount;
+    uint32 m_nSlots; // сколько ячеек уже нарезано
+    uint32 m_iFreeHead;
+    memorytag_t m_iTag;
+
+    // пул не потокобезопасен, но общая зона одна на все пулы и потоки
+    void *ZoneMalloc(size_t nSize) const
+    {
+        CScopedCriticalSection lock(MemGeneralZoneMutex());
+        return g_pMemoryManager->Malloc(nSize, m_iTag);
+    }
+    static void ZoneFree(void *ptr)
+    {
+        CScopedCriticalSection lock(MemGeneralZoneMutex());
+        g_pMemoryManager->Free(ptr);
+    }
+
+    poolslot_t *GetSlot(uint32 iIndex) const
+    {
+        return &m_pChunks[iIndex / nChunkSize][iIndex % nChunkSize];
+    }
+    poolhandle_t MakeHandle(const poolslot_t *pSlot) const
+    {
+        return pSlot->m_iIndex | ((pSlot->m_iGeneration & ((1 << POOL_GENERATION_BITS) - 1)) << POOL_INDEX_BITS);
+    }
+    bool GrowChunks();
+    bool GrowDense();
+    void Release(poolslot_t *pSlot);
+
+    CObjectPool(const CObjectPool &s)
+    {
+    }
+    void operator=(const CObjectPool &s)
+    {
+    }
+};
+
+template <typename T, int nChunkSize> bool CObjectPool<T, nChunkSize>::GrowChunks()
+{
+    if (m_nSlots + nChunkSize > POOL_MAX_OBJECTS)
+        return false;
+
+    poolslot_t *pChunk = (poolslot_t *)ZoneMalloc(sizeof(poolslot_t) * nChunkSize);
+    if (!pChunk)
+        return false;
+
+    poolslot_t **pChunks = (poolslot_t **)ZoneMalloc(sizeof(poolslot_t *) * (m_nChunks + 1));
+    if (!pChunks)
+    {
+        ZoneFree(pChunk);
+        return false;
+    }
+    if (m_pChunks)
+    {
+        memcpy(pChunks, m_pChunks, sizeof(poolslot_t *) * m_nChunks);
+        ZoneFree(m_pChunks);
+    }
+    m_pChunks = pChunks;
+    m_pChunks[m_nChunks++] = pChunk;
+
+    // новые ячейки встают в начало списка свободных по возрастанию адресов
+    for (int i = nChunkSize - 1; i >= 0; i--)
+    {
+        pChunk[i].m_iGeneration = 0;
+        pChunk[i].m_iIndex = m_nSlots + i;
+        pChunk[i].m_iLink = m_iFreeHead;
+        m_iFreeHead = m_nSlots + i;
+    }
+    m_nSlots += nChunkSize;
+    return true;
+}
+
+template <typename T, int nChunkSize> bool CObjectPool<T, nChunkSize>::GrowDense()
+{
+    int nCapacity = m_nDenseCapacity ? m_nDenseCapacity * 2 : nChunkSize;
+    uint32 *pDense = (uint32 *)ZoneMalloc(sizeof(uint32) * nCapacity);
+    if (!pDense)
+        return false;
+
+    if (m_pDense)
+    {
+        memcpy(pDense, m_pDense, sizeof(uint32) * m_nCount);
+        ZoneFree(m_pDense);
+    }
+    m_pDense = pDense;
+    m_nDenseCapacity = nCapacity;
+    return true;
+}
+
+template <typename T, int nChunkSize>
+template <typename... Args>
+poolhandle_t CObjectPool<T, nChunkSize>::Create(Args &&...args)
+{
+    if (m_iFreeHead == POOL_INDEX_NONE && !GrowChunks())
+        return POOL_HANDLE_INVALID;
+    if (m_nCount == m_nDenseCapacity && !GrowDense())
+        return POOL_HANDLE_INVALID;
+
+    poolslot_t *pSlot = GetSlot(m_iFreeHead);
+    m_iFreeHead = pSlot->m_iLink;
+
+    new (pSlot->m_Data) T(std::forward<Args>(args)...);
+    pSlot->m_iGeneration++;
+    pSlot->m_iLink = m_nCount;
+    m_pDense[m_nCount++] = pSlot->m_iIndex;
+    return MakeHandle(pSlot);
+}
+
+template <typename T, int nChunkSize> void CObjectPool<T, nChunkSize>::Release(poolslot_t *pSlot)
+{
+    ((T *)pSlot->m_Data)->~T();
+
+    // на место удалённого встаёт последний живой объект
+    uint32 iDense = pSlot->m_iLink;
+    uint32 iLast = m_pDense[--m_nCount];
+    m_pDense[iDense] = iLast;
+    GetSlot(iLast)->m_iLink = iDense;
+
+    pSlot->m_iGeneration++;
+    pSlot->m_iLink = m_iFreeHead;
+    m_iFreeHead = pSlot->m_iIndex;
+}
+
+template <typename T, int nChunkSize> void CObjectPool<T, nChunkSize>::Destroy(poolhandle_t hObject)
+{
+    if (!Get(hObject))
+        return;
+    Release(GetSlot(PoolHandleIndex(hObject)));
+}
+
+template <typename T, int nChunkSize> void CObjectPool<T, nChunkSize>::Clear()
+{
+    while (m_nCount)
+        Release(GetSlot(m_pDense[m_nCount - 1]));
+}
+
+template <typename T, int nChunkSize> T *CObjectPool<T, nChunkSize>::Get(poolhandle_t hObject) const
+{
+    uint32 iIndex = PoolHandleIndex(hObject);
+    if (iIndex >= m_nSlots)
+        return NULL;
+
+    poolslot_t *pSlot = GetSlot(iIndex);
+    if (!(pSlot->m_iGeneration & 1) ||
+        (pSlot->m_iGeneration & ((1 << POOL_GENERATION_BITS) - 1)) != PoolHandleGeneration(hObject))
+        return NULL;
+    return (T *)pSlot->m_Data;
+}
+
+template <typename T, int nChunkSize> poolhandle_t CObjectPool<T, nChunkSize>::GetHandle(const T *pObject) const
+{
+    if (!pObject)
+        return POOL_HANDLE_INVALID;
+    return MakeHandle((const poolslot_t *)pObject);
+}
+
+#endif /* HAYATOLABS_MEMPOOL_H */
@@ -0,0 +1,654 @@
+/*
+  This file associated with Hayato Labs project.
+
+  For license and copyright information please follow this link:
+  https://github.com/hayatolabs/general/blob/main/LEGAL
+*/
+
+#ifndef HAYATOLABS_MEMSLAB_H
+#define HAYATOLABS_MEMSLAB_H
+
+#include "memdebug.h"
+#include "memstats.h"
+#include <atomic>
+
+#define MEMSLAB_MAX_SIZE 4096         // наибольший размер, обслуживаемый слябом
+#define MEMSLAB_PAGE_SIZE (64 * 1024) // размер страницы, запрашиваемой у зоны
+#define MEMSLAB_NUM_CLASSES 28        // количество размерных классов
+#define MEMSLAB_CLASS_LARGE 0xFF      // выделение обслужено зоной напрямую
+#define MEMSLAB_MAGIC 0x5AB1
+#define MEMSLAB_ALIGN 16
+#define MEMSLAB_OFFSET_MASK 0x7F
+#define MEMSLAB_OFFSET_DEBUG 0x80 // происхождение записано в memdebugtable()
+
+#define MEMSLAB_MAX_THREADS 256      // потоков с собственным кэшем на один сляб
+#define MEMSLAB_MAX_INSTANCES 8      // слябов за время работы, для которых заводятся кэши потоков
+#define MEMSLAB_BATCH_BYTES (16 * 1024) // сколько байт переносится между кэшем и слябом за раз
+
+/*
+===========================================================================
+
+   memoryslot_t
+   Заголовок, стоящий перед каждым выделением слябового аллокатора
+
+===========================================================================
+*/
+struct memoryslot_t
+{
+    uint16 m_iMagic;    // MEMSLAB_MAGIC, для проверки указателя в Free
+    uint8 m_iClass;     // размерный класс или MEMSLAB_CLASS_LARGE
+    uint8 m_iOffset;    // смещение от начала блока зоны (только для больших) | MEMSLAB_OFFSET_DEBUG
+    memorytag_t m_iTag; // тэг выделения
+    uint32 m_nSize;     // запрошенный размер
+    uint32 m_iOwner;    // номер кэша потока, выдавшего слот (0 - сам сляб)
+};
+
+static_assert(sizeof(memoryslot_t) == MEMSLAB_ALIGN, "memoryslot_t must keep payload aligned");
+
+/*
+===========================================================================
+
+   memoryslabpage_t
+   Страница, из которой нарезаются слоты одного класса
+
+===========================================================================
+*/
+struct memoryslabpage_t
+{
+    memoryslabpage_t *m_pNext; // следующая страница класса
+    void *m_pBase;             // указатель, полученный от зоны
+};
+
+/*
+===========================================================================
+
+   memoryslabclass_t
+
+===========================================================================
+*/
+struct memoryslabclass_t
+{
+    size_t m_nSlotSize;         // размер слота вместе с заголовком
+    int m_nBatch;               // сколько слотов переносится в кэш потока за раз
+    memoryslot_t *m_pFree;      // список свободных слотов
+    ubyte *m_pBump;             // неразмеченный хвост текущей страницы
+    ubyte *m_pBumpEnd;          //
+    memoryslabpage_t *m_pPages; // все страницы класса
+    size_t m_nLive;             // слотов вне сляба (выдано или лежит в кэшах потоков)
+    CSystemMutex m_Mutex;
+};
+
+/*
+===========================================================================
+
+   memorythreadcache_t
+   Кэш потока: по магазину свободных слотов на каждый класс.
+   Слоты, освобождённые чужими потоками, складываются в m_RemoteFree
+   без блокировок и забираются владельцем, когда магазин опустеет.
+
+===========================================================================
+*/
+struct memorymagazine_t
+{
+    memoryslot_t *m_pHead;
+    int m_nCount;
+};
+
+struct memorythreadcache_t
+{
+    uint32 m_Idx;           // номер кэша, хранится в memoryslot_t::m_iOwner
+    volatile bool m_bActive; // кэш закреплён за живым потоком
+    memorymagazine_t m_Magazines[MEMSLAB_NUM_CLASSES];
+    CSysInterlockedPointer<memoryslot_t> m_RemoteFree;
+    std::atomic<int64> m_TagBytes[MAX_MEMORY_TAGS]; // пишет только владелец
+};
+
+class CMemorySlab;
+
+// Живые слябы, для которых потоки могут держать кэши
+inline std::atomic<CMemorySlab *> *MemSlab_Instances()
+{
+    static std::atomic<CMemorySlab *> s_Instances[MEMSLAB_MAX_INSTANCES];
+    return s_Instances;
+}
+
+// Кэши текущего потока, по одному на сляб. Возвращаются слябам при завершении потока
+struct memorythreadcacheholder_t
+{
+    memorythreadcache_t *m_pCaches[MEMSLAB_MAX_INSTANCES] = {};
+    ~memorythreadcacheholder_t();
+};
+
+inline memorythreadcacheholder_t &MemSlab_ThreadCaches()
+{
+    static thread_local memorythreadcacheholder_t s_Holder;
+    return s_Holder;
+}
+
+/*
+===========================================================================
+
+   CMemorySlab - сегрегированный по размерам аллокатор для мелких
+   выделений. Запросы до MEMSLAB_MAX_SIZE обслуживаются за O(1) из
+   списков свободных слотов своего класса, всё что больше уходит в зону.
+
+   Страницы берутся у зоны целиком и не возвращаются до Shutdown(),
+   поэтому фрагментация зоны на скорость мелких выделений не влияет.
+
+   Каждый поток работает со своим кэшем и обращается к общим спискам
+   только пачками по m_nBatch слотов. Сляб должен жить дольше потоков,
+   которые им пользуются.
+
+===========================================================================
+*/
+class CMemorySlab
+{
+  public:
+    CMemorySlab(memoryzone_t *pZone = NULL);
+    ~CMemorySlab();
+
+    void *Malloc(size_t nSize, memorytag_t iTag);
+    void *MallocDebug(size_t nSize, memorytag_t iTag, const char *pszLabel, const char *pszFilename, int iLine);
+    void Free(void *ptr);
+    void Shutdown(); // Вернуть все страницы зоне
+
+    void ReleaseThreadCache(memorythreadcache_t *pCache); // Вызывается при завершении потока
+    int64 GetTagBytes(memorytag_t iTag);                   // Сколько байт сейчас выдано под тэг
+
+    static size_t GetAllocationSize(const void *ptr); // Запрошенный размер выделения
+    static memorytag_t GetAllocationTag(const void *ptr);
+
+    int GetClassForSize(size_t nSize) const
+    {
+        return nSize <= MEMSLAB_MAX_SIZE ? m_SizeToClass[(nSize + MEMSLAB_ALIGN - 1) / MEMSLAB_ALIGN] : -1;
+    }
+    size_t GetClassSize(int iClass) const
+    {
+        return m_Classes[iClass].m_nSlotSize - sizeof(memoryslot_t);
+    }
+
+  private:
+    memoryzone_t *m_pZone; // если NULL, используется общая зона g_pMemoryManager
+    memoryslabclass_t m_Classes[MEMSLAB_NUM_CLASSES];
+    ubyte m_SizeToClass[MEMSLAB_MAX_SIZE / MEMSLAB_ALIGN + 1];
+    CSystemMutex m_ZoneMutex; // своя зона сама по себе не потокобезопасна; общую охраняет MemGeneralZoneMutex
+
+    int m_iInstance; // номер в MemSlab_Instances() или -1, если кэши потоков не используются
+    memorythreadcache_t *m_pCaches[MEMSLAB_MAX_THREADS];
+    int m_nCaches;
+    CSystemMutex m_CacheMutex;
+    std::atomic<int64> m_TagBytes[MAX_MEMORY_TAGS]; // выделения мимо кэшей потоков
+
+    void *ZoneMalloc(size_t nSize, memorytag_t iTag);
+    void ZoneFree(void *ptr);
+    bool GrowClass(memoryslabclass_t &slabClass);
+
+    memoryslot_t *PopSlot(memoryslabclass_t &slabClass);
+    void FetchBatch(int iClass, memorymagazine_t &magazine);
+    void ReturnBatch(int iClass, memorymagazine_t &magazine, int nCount);
+    void PushToCache(memorythreadcache_t *pCache, memoryslot_t *pSlot);
+    void CollectRemoteFrees(memorythreadcache_t *pCache);
+
+    memorythreadcache_t *GetThreadCache();
+    memorythreadcache_t *AcquireThreadCache();
+    void AddTagBytes(memorythreadcache_t *pCache, memorytag_t iTag, int64 nBytes);
+
+    static memoryslot_t *&NextSlot(memoryslot_t *pSlot)
+    {
+        return *(memoryslot_t **)(pSlot + 1);
+    }
+
+    CMemorySlab(const CMemorySlab &s)
+    {
+    }
+    void operator=(const CMemorySlab &s)
+    {
+    }
+};
+
+inline CMemorySlab::CMemorySlab(memoryzone_t *pZone) : m_pZone(pZone), m_iInstance(-1), m_nCaches(0)
+{
+    // 16..128 с шагом 16, дальше по четыре класса на каждую степень двойки
+    size_t nSize = 0;
+    for (int i = 0; i < MEMSLAB_NUM_CLASSES; i++)
+    {
+        if (nSize < 128)
+            nSize += 16;
+        else
+            nSize += (size_t)1 << (Log2Floor(nSize) - 2);
+
+        memoryslabclass_t &slabClass = m_Classes[i];
+        slabClass.m_nSlotSize = nSize + sizeof(memoryslot_t);
+        slabClass.m_nBatch = (int)Max<size_t>(4, Min<size_t>(64, MEMSLAB_BATCH_BYTES / nSize));
+        slabClass.m_pFree = NULL;
+        slabClass.m_pBump = slabClass.m_pBumpEnd = NULL;
+        slabClass.m_pPages = NULL;
+        slabClass.m_nLive = 0;
+    }
+
+    int iClass = 0;
+    for (int i = 0; i < (int)ARRAY_LEN(m_SizeToClass); i++)
+    {
+        while (GetClassSize(iClass) < (size_t)i * MEMSLAB_ALIGN)
+            iClass++;
+        m_SizeToClass[i] = (ubyte)iClass;
+    }
+
+    for (int i = 0; i < MAX_MEMORY_TAGS; i++)
+        m_TagBytes[i].store(0, std::memory_order_relaxed);
+
+    // номера не переиспользуются, чтобы кэши потоков не достались чужому слябу
+    static std::atomic<int> s_nInstances(0);
+    int iInstance = s_nInstances.fetch_add(1);
+    if (iInstance < MEMSLAB_MAX_INSTANCES)
+    {
+        m_iInstance = iInstance;
+        MemSlab_Instances()[iInstance].store(this);
+    }
+}
+
+inline CMemorySlab::~CMemorySlab()
+{
+    if (m_iInstance >= 0)
+        MemSlab_Instances()[m_iInstance].store(NULL);
+
+    Shutdown();
+
+    for (int i = 0; i < m_nCaches; i++)
+    {
+        m_pCaches[i]->~memorythreadcache_t();
+        ZoneFree(m_pCaches[i]);
+    }
+    m_nCaches = 0;
+}
+
+inline void *CMemorySlab::ZoneMalloc(size_t nSize, memorytag_t iTag)
+{
+    // в общую зону ходят и другие, поэтому для неё мьютекс общий
+    CScopedCriticalSection lock(m_pZone ? m_ZoneMutex : MemGeneralZoneMutex());
+    return m_pZone ? m_pZone->Malloc(nSize, iTag) : g_pMemoryManager->Malloc(nSize, iTag);
+}
+
+inline void CMemorySlab::ZoneFree(void *ptr)
+{
+    CScopedCriticalSection lock(m_pZone ? m_ZoneMutex : MemGeneralZoneMutex());
+    if (m_pZone)
+        m_pZone->Free(ptr);
+    else
+        g_pMemoryManager->Free(ptr);
+}
+
+// Вызывается под m_Mutex класса
+inline bool CMemorySlab::GrowClass(memoryslabclass_t &slabClass)
+{
+    void *pBase = ZoneMalloc(MEMSLAB_PAGE_SIZE + MEMSLAB_ALIGN, TAG_SLAB);
+    if (!pBase)
+        return false;
+
+    ubyte *pPage = (ubyte *)(((uintptr_t)pBase + MEMSLAB_ALIGN - 1) & ~(uintptr_t)(MEMSLAB_ALIGN - 1));
+    memoryslabpage_t *pHeader = (memoryslabpage_t *)pPage;
+    pHeader->m_pBase = pBase;
+    pHeader->m_pNext = slabClass.m_pPages;
+    slabClass.m_pPages = pHeader;
+
+    slabClass.m_pBump = pPage + MEMSLAB_ALIGN;
+    slabClass.m_pBumpEnd = pPage + MEMSLAB_PAGE_SIZE;
+    return true;
+}
+
+// Вызывается под m_Mutex класса
+inline memoryslot_t *CMemorySlab::PopSlot(memoryslabclass_t &slabClass)
+{
+    memoryslot_t *pSlot = slabClass.m_pFree;
+    if (pSlot)
+    {
+        slabClass.m_pFree = NextSlot(pSlot);
+    }
+    else
+    {
+        if (slabClass.m_pBump + slabClass.m_nSlotSize > slabClass.m_pBumpEnd && !GrowClass(slabClass))
+            return NULL;
+
+        pSlot = (memoryslot_t *)slabClass.m_pBump;
+        slabClass.m_pBump += slabClass.m_nSlotSize;
+    }
+    slabClass.m_nLive++;
+    return pSlot;
+}
+
+inline void CMemorySlab::FetchBatch(int iClass, memorymagazine_t &magazine)
+{
+    memoryslabclass_t &slabClass = m_Classes[iClass];
+    CScopedCriticalSection lock(slabClass.m_Mutex);
+
+    for (int i = 0; i < slabClass.m_nBatch; i++)
+    {
+        memoryslot_t *pSlot = PopSlot(slabClass);
+        if (!pSlot)
+            break;
+
+        pSlot->m_iClass = (uint8)iClass;
+        NextSlot(pSlot) = magazine.m_pHead;
+        magazine.m_pHead = pSlot;
+        magazine.m_nCount++;
+    }
+}
+
+inline void CMemorySlab::ReturnBatch(int iClass, memorymagazine_t &magazine, int nCount)
+{
+    if (!magazine.m_pHead || nCount <= 0)
+        return;
+
+    memoryslot_t *pFirst = magazine.m_pHead;
+    memoryslot_t *pLast = pFirst;
+    int nMoved = 1;
+    while (nMoved < nCount && NextSlot(pLast))
+    {
+        pLast = NextSlot(pLast);
+        nMoved++;
+    }
+    magazine.m_pHead = NextSlot(pLast);
+    magazine.m_nCount -= nMoved;
+
+    memoryslabclass_t &slabClass = m_Classes[iClass];
+    CScopedCriticalSection lock(slabClass.m_Mutex);
+    NextSlot(pLast) = slabClass.m_pFree;
+    slabClass.m_pFree = pFirst;
+    slabClass.m_nLive -= nMoved;
+}
+
+inline void CMemorySlab::PushToCache(memorythreadcache_t *pCache, memoryslot_t *pSlot)
+{
+    int iClass = pSlot->m_iClass;
+    memorymagazine_t &magazine = pCache->m_Magazines[iClass];
+    NextSlot(pSlot) = magazine.m_pHead;
+    magazine.m_pHead = pSlot;
+
+    // лишнее возвращается в сляб, чтобы другие потоки могли это забрать
+    int nBatch = m_Classes[iClass].m_nBatch;
+    if (++magazine.m_nCount > nBatch * 2)
+        ReturnBatch(iClass, magazine, nBatch);
+}
+
+inline void CMemorySlab::CollectRemoteFrees(memorythreadcache_t *pCache)
+{
+    if (!pCache->m_RemoteFree.Get())
+        return;
+
+    memoryslot_t *pSlot = pCache->m_RemoteFree.Set(NULL);
+    while (pSlot)
+    {
+        memoryslot_t *pNext = NextSlot(pSlot);
+        PushToCache(pCache, pSlot);
+        pSlot = pNext;
+    }
+}
+
+inline memorythreadcache_t *CMemorySlab::GetThreadCache()
+{
+    if (m_iInstance < 0)
+        return NULL;
+
+    memorythreadcache_t *&pCache = MemSlab_ThreadCaches().m_pCaches[m_iInstance];
+    if (!pCache)
+        pCache = AcquireThreadCache();
+    return pCache;
+}
+
+inline memorythreadcache_t *CMemorySlab::AcquireThreadCache()
+{
+    memorythreadcache_t *pCache = NULL;
+    {
+        CScopedCriticalSection lock(m_CacheMutex);
+
+        // сначала подбираем кэш завершившегося потока
+        for (int i = 0; i < m_nCaches && !pCache; i++)
+        {
+            if (!m_pCaches[i]->m_bActive)
+                pCache = m_pCaches[i];
+        }
+
+        if (!pCache)
+        {
+            if (m_nCaches == MEMSLAB_MAX_THREADS)
+                return NULL;
+
+            void *pMemory = ZoneMalloc(sizeof(memorythreadcache_t), TAG_SLAB);
+            if (!pMemory)
+                return NULL;
+
+            pCache = new (pMemory) memorythreadcache_t;
+            pCache->m_Idx = m_nCaches + 1;
+            memset(pCache->m_Magazines, 0, sizeof(pCache->m_Magazines));
+            for (int i = 0; i < MAX_MEMORY_TAGS; i++)
+                pCache->m_TagBytes[i].store(0, std::memory_order_relaxed);
+            m_pCaches[m_nCaches++] = pCache;
+        }
+        pCache->m_bActive = true;
+    }
+
+    CollectRemoteFrees(pCache);
+    return pCache;
+}
+
+inline void CMemorySlab::ReleaseThreadCache(memorythreadcache_t *pCache)
+{
+    CollectRemoteFrees(pCache);
+    for (int i = 0; i < MEMSLAB_NUM_CLASSES; i++)
+        ReturnBatch(i, pCache->m_Magazines[i], pCache->m_Magazines[i].m_nCount);
+
+    CScopedCriticalSection lock(m_CacheMutex);
+    pCache->m_bActive = false;
+}
+
+inline memorythreadcacheholder_t::~memorythreadcacheholder_t()
+{
+    for (int i = 0; i < MEMSLAB_MAX_INSTANCES; i++)
+    {
+        CMemorySlab *pSlab = MemSlab_Instances()[i].load();
+        if (m_pCaches[i] && pSlab)
+            pSlab->ReleaseThreadCache(m_pCaches[i]);
+    }
+}
+
+inline void CMemorySlab::AddTagBytes(memorythreadcache_t *pCache, memorytag_t iTag, int64 nBytes)
+{
+    // свой счётчик кэша меняет только поток-владелец, поэтому хватает load + store
+    if (pCache)
+    {
+        std::atomic<int64> &counter = pCache->m_TagBytes[MemTagIndex(iTag)];
+        counter.store(counter.load(std::memory_order_relaxed) + nBytes, std::memory_order_relaxed);
+    }
+    else
+    {
+        m_TagBytes[MemTagIndex(iTag)].fetch_add(nBytes, std::memory_order_relaxed);
+    }
+}
+
+inline int64 CMemorySlab::GetTagBytes(memorytag_t iTag)
+{
+    int iIndex = MemTagIndex(iTag);
+    int64 nBytes = m_TagBytes[iIndex].load(std::memory_order_relaxed);
+
+    CScopedCriticalSection lock(m_CacheMutex);
+    for (int i = 0; i < m_nCaches; i++)
+        nBytes += m_pCaches[i]->m_TagBytes[iIndex].load(std::memory_order_relaxed);
+    return nBytes;
+}
+
+inline void *CMemorySlab::Malloc(size_t nSize, memorytag_t iTag)
+{
+    if (nSize > UINT32_MAX)
+        return NULL;
+
+    memoryslot_t *pSlot;
+    int iClass = GetClassForSize(nSize);
+    memorythreadcache_t *pCache = NULL;
+
+    if (iClass < 0)
+    {
+        // большие выделения идут в зону как есть, но с тем же заголовком
+        ubyte *pBase = (ubyte *)ZoneMalloc(nSize + sizeof(memoryslot_t) + MEMSLAB_ALIGN, iTag);
+        if (!pBase)
+            return NULL;
+
+        pSlot = (memoryslot_t *)(((uintptr_t)pBase + MEMSLAB_ALIGN - 1) & ~(uintptr_t)(MEMSLAB_ALIGN - 1));
+        pSlot->m_iClass = MEMSLAB_CLASS_LARGE;
+        pSlot->m_iOffset = (uint8)((ubyte *)pSlot - pBase);
+        pSlot->m_iOwner = 0;
+    }
+    else if ((pCache = GetThreadCache()) != NULL)
+    {
+        memorymagazine_t &magazine = pCache->m_Magazines[iClass];
+        if (!magazine.m_pHead)
+        {
+            CollectRemoteFrees(pCache);
+            if (!magazine.m_pHead)
+                FetchBatch(iClass, magazine);
+            if (!magazine.m_pHead)
+                return NULL;
+        }
+
+        pSlot = magazine.m_pHead;
+        magazine.m_pHead = NextSlot(pSlot);
+        magazine.m_nCount--;
+
+        pSlot->m_iClass = (uint8)iClass;
+        pSlot->m_iOffset = 0;
+        pSlot->m_iOwner = pCache->m_Idx;
+    }
+    else
+    {
+        memoryslabclass_t &slabClass = m_Classes[iClass];
+        CScopedCriticalSection lock(slabClass.m_Mutex);
+
+        pSlot = PopSlot(slabClass);
+        if (!pSlot)
+            return NULL;
+
+        pSlot->m_iClass = (uint8)iClass;
+        pSlot->m_iOffset = 0;
+        pSlot->m_iOwner = 0;
+    }
+
+    pSlot->m_iMagic = MEMSLAB_MAGIC;
+    pSlot->m_iTag = iTag;
+    pSlot->m_nSize = (uint32)nSize;
+    AddTagBytes(pCache, iTag, (int64)nSize);
+    memstats()->OnMalloc(iTag, nSize);
+    return pSlot + 1;
+}
+
+inline void *CMemorySlab::MallocDebug(size_t nSize, memorytag_t iTag, const char *pszLabel, const char *pszFilename,
+                                      int iLine)
+{
+    void *ptr = Malloc(nSize, iTag);
+    if (ptr)
+    {
+        ((memoryslot_t *)ptr - 1)->m_iOffset |= MEMSLAB_OFFSET_DEBUG;
+        memdebugtable()->Insert(ptr, iTag, nSize, pszLabel, pszFilename, iLine);
+    }
+    return ptr;
+}
+
+inline void CMemorySlab::Free(void *ptr)
+{
+    if (!ptr)
+        return;
+
+    memoryslot_t *pSlot = (memoryslot_t *)ptr - 1;
+    if (pSlot->m_iMagic != MEMSLAB_MAGIC)
+    {
+        common()->FatalError("CMemorySlab::Free: bad pointer %p", ptr);
+        return;
+    }
+    pSlot->m_iMagic = 0;
+
+    if (pSlot->m_iOffset & MEMSLAB_OFFSET_DEBUG)
+        memdebugtable()->Remove(ptr);
+    memstats()->OnFree(pSlot->m_iTag, pSlot->m_nSize);
+
+    if (pSlot->m_iClass == MEMSLAB_CLASS_LARGE)
+    {
+        AddTagBytes(NULL, pSlot->m_iTag, -(int64)pSlot->m_nSize);
+        ZoneFree((ubyte *)pSlot - (pSlot->m_iOffset & MEMSLAB_OFFSET_MASK));
+        return;
+    }
+
+    memorythreadcache_t *pCache = GetThreadCache();
+    AddTagBytes(pCache, pSlot->m_iTag, -(int64)pSlot->m_nSize);
+
+    uint32 iOwner = pSlot->m_iOwner;
+    if (pCache && (iOwner == 0 || iOwner == pCache->m_Idx))
+    {
+        PushToCache(pCache, pSlot);
+        return;
+    }
+
+    memorythreadcache_t *pOwner = iOwner ? m_pCaches[iOwner - 1] : NULL;
+    if (pOwner && pOwner->m_bActive)
+    {
+        // чужой слот: возвращаем владельцу через его список без блокировок
+        memoryslot_t *pHead;
+        do
+        {
+            pHead = pOwner->m_RemoteFree.Get();
+            NextSlot(pSlot) = pHead;
+        } while (pOwner->m_RemoteFree.CompareExchange(pHead, pSlot) != pHead);
+        return;
+    }
+
+    memoryslabclass_t &slabClass = m_Classes[pSlot->m_iClass];
+    CScopedCriticalSection lock(slabClass.m_Mutex);
+    NextSlot(pSlot) = slabClass.m_pFree;
+    slabClass.m_pFree = pSlot;
+    slabClass.m_nLive--;
+}
+
+inline void CMemorySlab::Shutdown()
+{
+    {
+        // слоты в кэшах указывают на страницы, которые сейчас будут освобождены
+        CScopedCriticalSection lock(m_CacheMutex);
+        for (int i = 0; i < m_nCaches; i++)
+        {
+            memset(m_pCaches[i]->m_Magazines, 0, sizeof(m_pCaches[i]->m_Magazines));
+            m_pCaches[i]->m_RemoteFree.Set(NULL);
+        }
+    }
+
+    for (int i = 0; i < MEMSLAB_NUM_CLASSES; i++)
+    {
+        memoryslabclass_t &slabClass = m_Classes[i];
+        CScopedCriticalSection lock(slabClass.m_Mutex);
+
+        while (slabClass.m_pPages)
+        {
+            memoryslabpage_t *pPage = slabClass.m_pPages;
+            slabClass.m_pPages = pPage->m_pNext;
+            ZoneFree(pPage->m_pBase);
+        }
+        slabClass.m_pFree = NULL;
+        slabClass.m_pBump = slabClass.m_pBumpEnd = NULL;
+        slabClass.m_nLive = 0;
+    }
+}
+
+inline size_t CMemorySlab::GetAllocationSize(const void *ptr)
+{
+    return ((const memoryslot_t *)ptr - 1)->m_nSize;
+}
+
+inline memorytag_t CMemorySlab::GetAllocationTag(const void *ptr)
+{
+    return ((const memoryslot_t *)ptr - 1)->m_iTag;
+}
+
+// Слябовый аллокатор поверх общей зоны g_pMemoryManager
+inline CMemorySlab *memslab()
+{
+    static CMemorySlab s_MemorySlab;
+    return &s_MemorySlab;
+}
+
+#endif /* HAYATOLABS_MEMSLAB_H */
@@ -0,0 +1,322 @@
+/*
+  This file associated with Hayato Labs project.
+
+  For license and copyright information please follow this link:
+  https://github.com/hayatolabs/general/blob/main/LEGAL
+*/
+
+#ifndef HAYATOLABS_MEMSTATS_H
+#define HAYATOLABS_MEMSTATS_H
+
+#include "convar.h"
+#include "mem.h"
+#include "thread.h"
+#include <atomic>
+
+#define MEMSTATS_HISTOGRAM_SIZE 40 // корзины по log2 размера: 0-1, 2-3, 4-7, ...
+#define MEMSTATS_MAX_ZONES 64      // зон, которые видны в memstats
+#define MEMSTATS_NAME_LENGTH 32
+
+/*
+===========================================================================
+
+   memorystats_t - счётчики одного тэга или одной зоны.
+
+   Счётчики разбиты по потокам: поток пишет в свою полосу (по
+   строке кэша на полосу), общие строки кэша на выделении не
+   меняются. Значения собираются при чтении и между собой не
+   согласованы. Потоков больше MEMSTATS_SHARDS делят полосы по кругу.
+
+   Пик считается не на каждом выделении: когда байты полосы выросли
+   на MEMSTATS_PEAK_STEP, полосы суммируются и максимум обновляется.
+   Пропустить он может не больше MEMSTATS_PEAK_STEP на поток.
+
+===========================================================================
+*/
+#define MEMSTATS_SHARDS 16
+#define MEMSTATS_PEAK_STEP (64 * 1024)
+
+inline int MemStats_ThreadShard()
+{
+    static std::atomic<int> s_nThreads(0);
+    static thread_local int s_iShard = s_nThreads.fetch_add(1, std::memory_order_relaxed) % MEMSTATS_SHARDS;
+    return s_iShard;
+}
+
+struct alignas(64) memorystatsshard_t
+{
+    std::atomic<int64> m_nBytes;
+    std::atomic<int64> m_nCount;
+    std::atomic<int64> m_nNextPeakCheck; // байты полосы, при которых пересчитать пик
+    std::atomic<int64> m_Histogram[MEMSTATS_HISTOGRAM_SIZE];
+};
+
+struct memorystats_t
+{
+    memorystatsshard_t m_Shards[MEMSTATS_SHARDS];
+    std::atomic<int64> m_nPeakBytes;
+    char m_szName[MEMSTATS_NAME_LENGTH];
+
+    void Reset(const char *pszName);
+    void OnMalloc(size_t nSize);
+    void OnFree(size_t nSize);
+
+    int64 GetBytes() const; // живые байты
+    int64 GetCount() const; // живые выделения
+    int64 GetPeakBytes() const
+    {
+        return m_nPeakBytes.load(std::memory_order_relaxed);
+    }
+    int64 GetTotalCount() const; // выделений за всё время
+    int64 GetHistogram(int iBucket) const;
+
+  private:
+    void UpdatePeak();
+};
+
+inline void memorystats_t::Reset(const char *pszName)
+{
+    for (int i = 0; i < MEMSTATS_SHARDS; i++)
+    {
+        memorystatsshard_t &shard = m_Shards[i];
+        shard.m_nBytes.store(0, std::memory_order_relaxed);
+        shard.m_nCount.store(0, std::memory_order_relaxed);
+        shard.m_nNextPeakCheck.store(0, std::memory_order_relaxed);
+        for (int j = 0; j < MEMSTATS_HISTOGRAM_SIZE; j++)
+            shard.m_Histogram[j].store(0, std::memory_order_relaxed);
+    }
+    m_nPeakBytes.store(0, std::memory_order_relaxed);
+
+    strncpy(m_szName, pszName ? pszName : "", sizeof(m_szName) - 1);
+    m_szName[sizeof(m_szName) - 1] = '\0';
+}
+
+inline void memorystats_t::OnMalloc(size_t nSize)
+{
+    memorystatsshard_t &shard = m_Shards[MemStats_ThreadShard()];
+    int64 nBytes = shard.m_nBytes.fetch_add((int64)nSize, std::memory_order_relaxed) + (int64)nSize;
+    shard.m_nCount.fetch_add(1, std::memory_order_relaxed);
+
+    int iBucket = nSize ? Log2Floor(nSize) : 0;
+    shard.m_Histogram[Min(iBucket, MEMSTATS_HISTOGRAM_SIZE - 1)].fetch_add(1, std::memory_order_relaxed);
+
+    if (nBytes >= shard.m_nNextPeakCheck.load(std::memory_order_relaxed))
+    {
+        shard.m_nNextPeakCheck.store(nBytes + MEMSTATS_PEAK_STEP, std::memory_order_relaxed);
+        UpdatePeak();
+    }
+}
+
+inline void memorystats_t::OnFree(size_t nSize)
+{
+    // освобождение из другого потока уводит его полосу в минус, сумма остаётся верной
+    memorystatsshard_t &shard = m_Shards[MemStats_ThreadShard()];
+    shard.m_nBytes.fetch_sub((int64)nSize, std::memory_order_relaxed);
+    shard.m_nCount.fetch_sub(1, std::memory_order_relaxed);
+}
+
+inline void memorystats_t::UpdatePeak()
+{
+    int64 nBytes = GetBytes();
+    int64 nPeak = m_nPeakBytes.load(std::memory_order_relaxed);
+    while (nBytes > nPeak && !m_nPeakBytes.compare_exchange_weak(nPeak, nBytes, std::memory_order_relaxed))
+    {
+    }
+}
+
+inline int64 memorystats_t::GetBytes() const
+{
+    int64 nBytes = 0;
+    for (int i = 0; i < MEMSTATS_SHARDS; i++)
+        nBytes += m_Shards[i].m_nBytes.load(std::memory_order_relaxed);
+    return nBytes;
+}
+
+inline int64 memorystats_t::GetCount() const
+{
+    int64 nCount = 0;
+    for (int i = 0; i < MEMSTATS_SHARDS; i++)
+        nCount += m_Shards[i].m_nCount.load(std::memory_order_relaxed);
+    return nCount;
+}
+
+inline int64 memorystats_t::GetHistogram(int iBucket) const
+{
+    int64 nCount = 0;
+    for (int i = 0; i < MEMSTATS_SHARDS; i++)
+        nCount += m_Shards[i].m_Histogram[iBucket].load(std::memory_order_relaxed);
+    return nCount;
+}
+
+inline int64 memorystats_t::GetTotalCount() const
+{
+    // каждое выделение попадает ровно в одну корзину
+    int64 nCount = 0;
+    for (int i = 0; i < MEMSTATS_HISTOGRAM_SIZE; i++)
+        nCount += GetHistogram(i);
+    return nCount;
+}
+
+/*
+===========================================================================
+
+   CMemoryStats - телеметрия аллокаторов SDK по тэгам и зонам.
+
+   Учитываются выделения CMemorySlab и CMemoryZone. Память, которую
+   менеджер выдаёт напрямую через g_pMemoryManager, сюда не попадает.
+
+===========================================================================
+*/
+class CMemoryStats
+{
+  public:
+    CMemoryStats() : m_nZones(0)
+    {
+        for (int i = 0; i < MAX_MEMORY_TAGS; i++)
+            m_Tags[i].Reset(NULL);
+        memset(m_pZones, 0, sizeof(m_pZones));
+    }
+
+    void OnMalloc(memorytag_t iTag, size_t nSize)
+    {
+        m_Tags[MemTagIndex(iTag)].OnMalloc(nSize);
+    }
+    void OnFree(memorytag_t iTag, size_t nSize)
+    {
+        m_Tags[MemTagIndex(iTag)].OnFree(nSize);
+    }
+
+    const memorystats_t &GetTagStats(memorytag_t iTag) const
+    {
+        return m_Tags[MemTagIndex(iTag)];
+    }
+
+    void RegisterZone(memorystats_t *pStats); // повторная регистрация ничего не меняет
+    void UnregisterZone(memorystats_t *pStats);
+
+    void PrintTags();
+    void PrintZones();
+    void PrintHistogram(const memorystats_t &stats);
+
+  private:
+    memorystats_t m_Tags[MAX_MEMORY_TAGS];
+    memorystats_t *m_pZones[MEMSTATS_MAX_ZONES];
+    int m_nZones;
+    CSystemMutex m_ZoneMutex;
+
+    void PrintRow(const char *pszName, const memorystats_t &stats);
+
+    CMemoryStats(const CMemoryStats &s)
+    {
+    }
+    void operator=(const CMemoryStats &s)
+    {
+    }
+};
+
+inline void CMemoryStats::RegisterZone(memorystats_t *pStats)
+{
+    CScopedCriticalSection lock(m_ZoneMutex);
+    for (int i = 0; i < m_nZones; i++)
+    {
+        if (m_pZones[i] == pStats)
+            return;
+    }
+    if (m_nZones < MEMSTATS_MAX_ZONES)
+        m_pZones[m_nZones++] = pStats;
+}
+
+inline void CMemoryStats::UnregisterZone(memorystats_t *pStats)
+{
+    CScopedCriticalSection lock(m_ZoneMutex);
+    for (int i = 0; i < m_nZones; i++)
+    {
+        if (m_pZones[i] == pStats)
+        {
+            m_pZones[i] = m_pZones[--m_nZones];
+            m_pZones[m_nZones] = NULL;
+            return;
+        }
+    }
+}
+
+inline void CMemoryStats::PrintRow(const char *pszName, const memorystats_t &stats)
+{
+    common()->Print("%-24s %12lld %10lld %12lld %12lld\n", pszName, (long long)stats.GetBytes(),
+                    (long long)stats.GetCount(), (long long)stats.GetPeakBytes(), (long long)stats.GetTotalCount());
+}
+
+inline void CMemoryStats::PrintTags()
+{
+    common()->Print("%-24s %12s %10s %12s %12s\n", "tag", "bytes", "count", "peak", "total");
+    for (int i = 0; i < MAX_MEMORY_TAGS; i++)
+    {
+        if (!m_Tags[i].GetTotalCount())
+            continue;
+
+        char szName[MEMSTATS_NAME_LENGTH];
+        snprintf(szName, sizeof(szName), "%d", i);
+        PrintRow(szName, m_Tags[i]);
+    }
+}
+
+inline void CMemoryStats::PrintZones()
+{
+    CScopedCriticalSection lock(m_ZoneMutex);
+    common()->Print("%-24s %12s %10s %12s %12s\n", "zone", "bytes", "count", "peak", "total");
+    for (int i = 0; i < m_nZones; i++)
+        PrintRow(m_pZones[i]->m_szName, *m_pZones[i]);
+}
+
+inline void CMemoryStats::PrintHistogram(const memorystats_t &stats)
+{
+    for (int i = 0; i < MEMSTATS_HISTOGRAM_SIZE; i++)
+    {
+        int64 nCount = stats.GetHistogram(i);
+        if (nCount)
+            common()->Print("  < %-14llu %12lld\n", (unsigned long long)BIT(i + 1), (long long)nCount);
+    }
+}
+
+inline CMemoryStats *memstats()
+{
+    static CMemoryStats s_Stats;
+    return &s_Stats;
+}
+
+/*
+===========================================================================
+
+   Консольная команда memstats
+
+   memstats          - счётчики по тэгам
+   memstats zones    - счётчики по зонам
+   memstats <тэг>    - гистограмма размеров тэга
+
+===========================================================================
+*/
+inline void MemStats_Command(std::vector<std::string> command_line)
+{
+    if (command_line.size() < 2)
+    {
+        memstats()->PrintTags();
+        return;
+    }
+
+    if (command_line[1] == "zones")
+    {
+        memstats()->PrintZones();
+        return;
+    }
+
+    memorytag_t iTag = atoi(command_line[1].c_str());
+    common()->Print("tag %d, allocation sizes:\n", iTag);
+    memstats()->PrintHistogram(memstats()->GetTagStats(iTag));
+}
+
+inline void MemStats_RegisterCommands()
+{
+    convar()->RegisterCommand("memstats", MemStats_Command);
+}
+
+#endif /* HAYATOLABS_MEMSTATS_H */
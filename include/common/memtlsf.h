@@ -0,0 +1,586 @@
+/*
+  This file associated with Hayato Labs project.
+
+  For license and copyright information please follow this link:
+  https://github.com/hayatolabs/general/blob/main/LEGAL
+*/
+
+#ifndef HAYATOLABS_MEMTLSF_H
+#define HAYATOLABS_MEMTLSF_H
+
+#include "memdebug.h"
+#include "memstats.h"
+#include "memvirtual.h"
+
+#define TLSF_ALIGN_LOG2 4
+#define TLSF_ALIGN (1 << TLSF_ALIGN_LOG2)
+#define TLSF_SL_LOG2 5 // второй уровень: 32 подсписка на степень двойки
+#define TLSF_SL_COUNT (1 << TLSF_SL_LOG2)
+#define TLSF_FL_SHIFT (TLSF_SL_LOG2 + TLSF_ALIGN_LOG2)
+#define TLSF_FL_MAX 40 // блоки до 1 Тб
+#define TLSF_FL_COUNT (TLSF_FL_MAX - TLSF_FL_SHIFT + 1)
+#define TLSF_MAX_ALLOCATION ((uint64)1 << TLSF_FL_MAX) // больше не помещается ни в один класс
+#define TLSF_SMALL_BLOCK (1 << TLSF_FL_SHIFT)
+
+#define TLSF_BLOCK_FREE BIT(0)
+#define TLSF_BLOCK_DEBUG BIT(1)   // происхождение записано в memdebugtable()
+#define TLSF_BLOCK_TRIMMED BIT(2) // страницы свободного блока уже отданы системе
+#define TLSF_BLOCK_FLAGS (TLSF_ALIGN - 1)
+#define TLSF_TAG_SHIFT 56 // тэг хранится в старшем байте размера
+
+/*
+===========================================================================
+
+   memorytlsfblock_t
+   Заголовок блока - 16 байт. Указатели списка свободных блоков
+   живут в полезной части и существуют только у свободных блоков.
+   Отладочное происхождение в заголовке не хранится, см. memdebug.h
+
+===========================================================================
+*/
+struct memorytlsfblock_t
+{
+    memorytlsfblock_t *m_pPrevPhys; // предыдущий блок в памяти
+    uint64 m_nSize;                 // размер полезной части | тэг | флаги
+
+    memorytlsfblock_t *m_pNextFree;
+    memorytlsfblock_t *m_pPrevFree;
+
+    size_t GetSize() const
+    {
+        return (size_t)(m_nSize & ((BIT(TLSF_TAG_SHIFT) - 1) & ~(uint64)TLSF_BLOCK_FLAGS));
+    }
+    void SetSize(size_t nSize)
+    {
+        m_nSize = (m_nSize & ~((BIT(TLSF_TAG_SHIFT) - 1) & ~(uint64)TLSF_BLOCK_FLAGS)) | nSize;
+    }
+    bool IsFree() const
+    {
+        return (m_nSize & TLSF_BLOCK_FREE) != 0;
+    }
+    void SetFree(bool bFree)
+    {
+        m_nSize = bFree ? (m_nSize | TLSF_BLOCK_FREE) : (m_nSize & ~TLSF_BLOCK_FREE);
+    }
+    bool IsTrimmed() const
+    {
+        return (m_nSize & TLSF_BLOCK_TRIMMED) != 0;
+    }
+    void SetTrimmed(bool bTrimmed)
+    {
+        m_nSize = bTrimmed ? (m_nSize | TLSF_BLOCK_TRIMMED) : (m_nSize & ~TLSF_BLOCK_TRIMMED);
+    }
+    bool IsDebug() const
+    {
+        return (m_nSize & TLSF_BLOCK_DEBUG) != 0;
+    }
+    void SetDebug(bool bDebug)
+    {
+        m_nSize = bDebug ? (m_nSize | TLSF_BLOCK_DEBUG) : (m_nSize & ~TLSF_BLOCK_DEBUG);
+    }
+    memorytag_t GetTag() const
+    {
+        return (memorytag_t)(m_nSize >> TLSF_TAG_SHIFT);
+    }
+    void SetTag(memorytag_t iTag)
+    {
+        m_nSize = (m_nSize & (BIT(TLSF_TAG_SHIFT) - 1)) | ((uint64)MemTagIndex(iTag) << TLSF_TAG_SHIFT);
+    }
+    void *GetPayload()
+    {
+        return (ubyte *)this + TLSF_BLOCK_HEADER;
+    }
+    memorytlsfblock_t *GetNextPhys()
+    {
+        return (memorytlsfblock_t *)((ubyte *)GetPayload() + GetSize());
+    }
+
+    static const size_t TLSF_BLOCK_HEADER = 16;
+    static const size_t TLSF_BLOCK_MIN = 16; // в свободном блоке должны поместиться два указателя
+};
+
+/*
+===========================================================================
+
+   memorytlsf_t - Two-Level Segregated Fit поверх непрерывного участка
+   памяти. Malloc и Free выполняются за O(1) независимо от того,
+   насколько фрагментирована зона: поиск блока - два сканирования
+   битовых масок, слияние соседей - по заголовкам соседних блоков.
+
+   Как и memoryzone_t, не потокобезопасна.
+
+===========================================================================
+*/
+struct memorytlsf_t
+{
+    size_t m_nSize; // размер управляемого участка
+    size_t m_nUsed; // выдано байт вместе с заголовками
+    void *m_pMemory;
+
+    uint32 m_FLBitmap;
+    uint32 m_SLBitmap[TLSF_FL_COUNT];
+    memorytlsfblock_t *m_pBlocks[TLSF_FL_COUNT][TLSF_SL_COUNT];
+
+    bool Init(void *pMemory, size_t nSize);
+    void *Malloc(size_t nSize, memorytag_t iTag);
+    void *MallocDebug(size_t nSize, memorytag_t iTag, const char *pszLabel, const char *pszFilename, int iLine);
+    void Free(void *ptr);
+    size_t Trim(memoryvirtualregion_t &region, size_t nMinSize); // Отдать системе страницы свободных блоков
+    bool Contains(const void *ptr) const
+    {
+        return (const ubyte *)ptr >= (const ubyte *)m_pMemory && (const ubyte *)ptr < (const ubyte *)m_pMemory + m_nSize;
+    }
+    static size_t GetAllocationSize(const void *ptr)
+    {
+        return ((const memorytlsfblock_t *)((const ubyte *)ptr - memorytlsfblock_t::TLSF_BLOCK_HEADER))->GetSize();
+    }
+
+  private:
+    static void MappingInsert(size_t nSize, int &fl, int &sl);
+    static void MappingSearch(size_t nSize, int &fl, int &sl);
+    memorytlsfblock_t *FindSuitable(int &fl, int &sl);
+    void InsertFree(memorytlsfblock_t *pBlock);
+    void RemoveFree(memorytlsfblock_t *pBlock);
+};
+
+inline void memorytlsf_t::MappingInsert(size_t nSize, int &fl, int &sl)
+{
+    if (nSize < TLSF_SMALL_BLOCK)
+    {
+        fl = 0;
+        sl = (int)nSize / (TLSF_SMALL_BLOCK / TLSF_SL_COUNT);
+    }
+    else
+    {
+        fl = Log2Floor(nSize);
+        sl = (int)(nSize >> (fl - TLSF_SL_LOG2)) ^ TLSF_SL_COUNT;
+        fl -= TLSF_FL_SHIFT - 1;
+    }
+}
+
+inline void memorytlsf_t::MappingSearch(size_t nSize, int &fl, int &sl)
+{
+    // округляем вверх до следующего подсписка, чтобы любой блок из него подошёл
+    if (nSize >= TLSF_SMALL_BLOCK)
+        nSize += ((size_t)1 << (Log2Floor(nSize) - TLSF_SL_LOG2)) - 1;
+    MappingInsert(nSize, fl, sl);
+}
+
+inline memorytlsfblock_t *memorytlsf_t::FindSuitable(int &fl, int &sl)
+{
+    if (fl >= TLSF_FL_COUNT)
+        return NULL;
+
+    uint32 slMap = m_SLBitmap[fl] & (~0U << sl);
+    if (!slMap)
+    {
+        uint32 flMap = (fl + 1 < 32) ? (m_FLBitmap & (~0U << (fl + 1))) : 0;
+        if (!flMap)
+            return NULL;
+
+        fl = LowestSetBit(flMap);
+        slMap = m_SLBitmap[fl];
+    }
+    sl = LowestSetBit(slMap);
+    return m_pBlocks[fl][sl];
+}
+
+inline void memorytlsf_t::InsertFree(memorytlsfblock_t *pBlock)
+{
+    int fl, sl;
+    MappingInsert(pBlock->GetSize(), fl, sl);
+
+    memorytlsfblock_t *pHead = m_pBlocks[fl][sl];
+    pBlock->m_pNextFree = pHead;
+    pBlock->m_pPrevFree = NULL;
+    if (pHead)
+        pHead->m_pPrevFree = pBlock;
+    m_pBlocks[fl][sl] = pBlock;
+
+    m_FLBitmap |= 1U << fl;
+    m_SLBitmap[fl] |= 1U << sl;
+    pBlock->SetFree(true);
+}
+
+inline void memorytlsf_t::RemoveFree(memorytlsfblock_t *pBlock)
+{
+    int fl, sl;
+    MappingInsert(pBlock->GetSize(), fl, sl);
+
+    if (pBlock->m_pNextFree)
+        pBlock->m_pNextFree->m_pPrevFree = pBlock->m_pPrevFree;
+    if (pBlock->m_pPrevFree)
+        pBlock->m_pPrevFree->m_pNextFree = pBlock->m_pNextFree;
+
+    if (m_pBlocks[fl][sl] == pBlock)
+    {
+        m_pBlocks[fl][sl] = pBlock->m_pNextFree;
+        if (!m_pBlocks[fl][sl])
+        {
+            m_SLBitmap[fl] &= ~(1U << sl);
+            if (!m_SLBitmap[fl])
+                m_FLBitmap &= ~(1U << fl);
+        }
+    }
+    pBlock->SetFree(false);
+    pBlock->SetTrimmed(false);
+}
+
+inline bool memorytlsf_t::Init(void *pMemory, size_t nSize)
+{
+    memset(this, 0, sizeof(*this));
+
+    ubyte *pStart = (ubyte *)(((uintptr_t)pMemory + TLSF_ALIGN - 1) & ~(uintptr_t)(TLSF_ALIGN - 1));
+    size_t nUsable = (nSize - (pStart - (ubyte *)pMemory)) & ~(size_t)(TLSF_ALIGN - 1);
+
+    // первый блок на весь участок и замыкающий занятый блок нулевого размера
+    const size_t nOverhead = memorytlsfblock_t::TLSF_BLOCK_HEADER * 2;
+    if (nSize < (size_t)(pStart - (ubyte *)pMemory) + nOverhead + memorytlsfblock_t::TLSF_BLOCK_MIN)
+        return false;
+
+    m_pMemory = pStart;
+    m_nSize = nUsable;
+
+    memorytlsfblock_t *pBlock = (memorytlsfblock_t *)pStart;
+    pBlock->m_pPrevPhys = NULL;
+    pBlock->m_nSize = 0;
+    pBlock->SetSize(nUsable - nOverhead);
+
+    memorytlsfblock_t *pSentinel = pBlock->GetNextPhys();
+    pSentinel->m_pPrevPhys = pBlock;
+    pSentinel->m_nSize = 0;
+
+    InsertFree(pBlock);
+    m_nUsed = nOverhead;
+    return true;
+}
+
+inline void *memorytlsf_t::Malloc(size_t nSize, memorytag_t iTag)
+{
+    // до округления, иначе размер у SIZE_MAX переполнится в маленький
+    if ((uint64)nSize > TLSF_MAX_ALLOCATION)
+        return NULL;
+
+    size_t nAdjusted = (nSize + TLSF_ALIGN - 1) & ~(size_t)(TLSF_ALIGN - 1);
+    if (nAdjusted < memorytlsfblock_t::TLSF_BLOCK_MIN)
+        nAdjusted = memorytlsfblock_t::TLSF_BLOCK_MIN;
+
+    int fl, sl;
+    MappingSearch(nAdjusted, fl, sl);
+    memorytlsfblock_t *pBlock = FindSuitable(fl, sl);
+    if (!pBlock)
+        return NULL;
+    RemoveFree(pBlock);
+
+    // отрезаем остаток, если в нём помещается хотя бы минимальный блок
+    size_t nBlockSize = pBlock->GetSize();
+    if (nBlockSize >= nAdjusted + memorytlsfblock_t::TLSF_BLOCK_HEADER + memorytlsfblock_t::TLSF_BLOCK_MIN)
+    {
+        pBlock->SetSize(nAdjusted);
+        memorytlsfblock_t *pRemainder = pBlock->GetNextPhys();
+        pRemainder->m_pPrevPhys = pBlock;
+        pRemainder->m_nSize = 0;
+        pRemainder->SetSize(nBlockSize - nAdjusted - memorytlsfblock_t::TLSF_BLOCK_HEADER);
+        pRemainder->GetNextPhys()->m_pPrevPhys = pRemainder;
+        InsertFree(pRemainder);
+    }
+
+    pBlock->SetTag(iTag);
+    m_nUsed += pBlock->GetSize() + memorytlsfblock_t::TLSF_BLOCK_HEADER;
+    return pBlock->GetPayload();
+}
+
+inline void memorytlsf_t::Free(void *ptr)
+{
+    if (!ptr)
+        return;
+
+    memorytlsfblock_t *pBlock = (memorytlsfblock_t *)((ubyte *)ptr - memorytlsfblock_t::TLSF_BLOCK_HEADER);
+    m_nUsed -= pBlock->GetSize() + memorytlsfblock_t::TLSF_BLOCK_HEADER;
+
+    if (pBlock->IsDebug())
+    {
+        memdebugtable()->Remove(ptr);
+        pBlock->SetDebug(false);
+    }
+
+    memorytlsfblock_t *pPrev = pBlock->m_pPrevPhys;
+    if (pPrev && pPrev->IsFree())
+    {
+        RemoveFree(pPrev);
+        pPrev->SetSize(pPrev->GetSize() + memorytlsfblock_t::TLSF_BLOCK_HEADER + pBlock->GetSize());
+        pBlock = pPrev;
+        pBlock->GetNextPhys()->m_pPrevPhys = pBlock;
+    }
+
+    memorytlsfblock_t *pNext = pBlock->GetNextPhys();
+    if (pNext->IsFree())
+    {
+        RemoveFree(pNext);
+        pBlock->SetSize(pBlock->GetSize() + memorytlsfblock_t::TLSF_BLOCK_HEADER + pNext->GetSize());
+        pBlock->GetNextPhys()->m_pPrevPhys = pBlock;
+    }
+
+    pBlock->SetTag(TAG_NONE);
+    InsertFree(pBlock);
+}
+
+inline void *memorytlsf_t::MallocDebug(size_t nSize, memorytag_t iTag, const char *pszLabel, const char *pszFilename,
+                                       int iLine)
+{
+    void *ptr = Malloc(nSize, iTag);
+    if (ptr)
+    {
+        ((memorytlsfblock_t *)((ubyte *)ptr - memorytlsfblock_t::TLSF_BLOCK_HEADER))->SetDebug(true);
+        memdebugtable()->Insert(ptr, iTag, nSize, pszLabel, pszFilename, iLine);
+    }
+    return ptr;
+}
+
+inline size_t memorytlsf_t::Trim(memoryvirtualregion_t &region, size_t nMinSize)
+{
+    size_t nTrimmed = 0;
+    for (uint32 flMap = m_FLBitmap; flMap; flMap &= flMap - 1)
+    {
+        int fl = LowestSetBit(flMap);
+        for (uint32 slMap = m_SLBitmap[fl]; slMap; slMap &= slMap - 1)
+        {
+            for (memorytlsfblock_t *pBlock = m_pBlocks[fl][LowestSetBit(slMap)]; pBlock; pBlock = pBlock->m_pNextFree)
+            {
+                if (pBlock->IsTrimmed() || pBlock->GetSize() < nMinSize)
+                    continue;
+
+                // указатели списка свободных блоков должны остаться на месте
+                ubyte *pStart = (ubyte *)pBlock->GetPayload() + sizeof(memorytlsfblock_t *) * 2;
+                nTrimmed += region.Decommit(pStart, (ubyte *)pBlock->GetNextPhys() - pStart);
+                pBlock->SetTrimmed(true);
+            }
+        }
+    }
+    return nTrimmed;
+}
+
+#define MEMZONE_TRIM_MIN_SIZE (256 * 1024) // свободные блоки меньше этого Trim не трогает
+
+enum memoryzonepolicy_t
+{
+    MEMZONE_POLICY_ROVER, // штатный first-fit поиск memoryzone_t
+    MEMZONE_POLICY_TLSF,  // Two-Level Segregated Fit, O(1) на Malloc и Free
+};
+
+/*
+===========================================================================
+
+   CMemoryZone - зона из MallocZoneMemory с выбираемой политикой
+   выделения. В режиме TLSF всё место зоны забирается одним блоком
+   и дальше распределяется через memorytlsf_t
+
+   CreateVirtual берёт память у системы напрямую (по возможности
+   большими страницами) и всегда работает через TLSF. Такая зона
+   умеет возвращать системе страницы свободных блоков через Trim()
+
+   Зона видна в memstats от Create до Destroy; повторный Create и
+   деструктор сначала освобождают прежнюю память зоны
+
+===========================================================================
+*/
+class CMemoryZone
+{
+  public:
+    CMemoryZone() : m_pZone(NULL), m_pRegion(NULL), m_Policy(MEMZONE_POLICY_ROVER)
+    {
+        memset(&m_Virtual, 0, sizeof(m_Virtual));
+        m_Stats.Reset("zone");
+    }
+    ~CMemoryZone()
+    {
+        Destroy();
+    }
+
+    bool Create(size_t nSize, memoryzonepolicy_t policy = MEMZONE_POLICY_ROVER);
+    bool CreateVirtual(size_t nSize, int iPageFlags = MEMPAGE_NORMAL);
+    void Destroy();
+    size_t Trim(size_t nMinSize = MEMZONE_TRIM_MIN_SIZE); // Сколько байт отдано системе
+
+    void *Malloc(size_t nSize, memorytag_t iTag);
+    void *MallocDebug(size_t nSize, memorytag_t iTag, const char *pszLabel, const char *pszFilename, int iLine);
+    void Free(void *ptr);
+    size_t GetAvailableMemory();
+
+    memoryzone_t *GetZone()
+    {
+        return m_pZone;
+    }
+    memoryzonepolicy_t GetPolicy() const
+    {
+        return m_Policy;
+    }
+    const memorystats_t &GetStats() const
+    {
+        return m_Stats;
+    }
+    void SetName(const char *pszName) // Имя зоны в memstats zones
+    {
+        m_Stats.Reset(pszName);
+    }
+
+  private:
+    memoryzone_t *m_pZone;
+    void *m_pRegion; // блок зоны, отданный TLSF
+    memoryvirtualregion_t m_Virtual;
+    memorytlsf_t m_Tlsf;
+    memoryzonepolicy_t m_Policy;
+    memorystats_t m_Stats;
+
+    void OnMalloc(void *ptr, memorytag_t iTag);
+    void OnFree(void *ptr);
+
+    CMemoryZone(const CMemoryZone &s)
+    {
+    }
+    void operator=(const CMemoryZone &s)
+    {
+    }
+};
+
+inline bool CMemoryZone::Create(size_t nSize, memoryzonepolicy_t policy)
+{
+    Destroy();
+    m_pZone = g_pMemoryManager->MallocZoneMemory(nSize);
+    if (!m_pZone)
+        return false;
+
+    m_Policy = policy;
+    memstats()->RegisterZone(&m_Stats);
+    if (policy == MEMZONE_POLICY_ROVER)
+        return true;
+
+    // зоне нужно место под собственный memoryblock_t, точный размер нам неизвестен
+    size_t nAvailable = g_pMemoryManager->GetAvailableZoneMemory(m_pZone);
+    size_t nRegionSize = 0;
+    for (int i = 1; i <= 4 && !m_pRegion; i++)
+    {
+        size_t nReserve = sizeof(memoryblock_t) * 4 * i;
+        if (nAvailable <= nReserve)
+            break;
+
+        nRegionSize = nAvailable - nReserve;
+        m_pRegion = m_pZone->Malloc(nRegionSize, TAG_NONE);
+    }
+
+    if (!m_pRegion || !m_Tlsf.Init(m_pRegion, nRegionSize))
+    {
+        Destroy();
+        return false;
+    }
+    return true;
+}
+
+inline bool CMemoryZone::CreateVirtual(size_t nSize, int iPageFlags)
+{
+    Destroy();
+    if (!m_Virtual.Map(nSize, iPageFlags))
+        return false;
+
+    m_Policy = MEMZONE_POLICY_TLSF;
+    m_pRegion = m_Virtual.m_pBase;
+    memstats()->RegisterZone(&m_Stats);
+    if (!m_Tlsf.Init(m_pRegion, m_Virtual.m_nSize))
+    {
+        Destroy();
+        return false;
+    }
+    return true;
+}
+
+inline void CMemoryZone::Destroy()
+{
+    if (m_pZone)
+        g_pMemoryManager->ReleaseZoneMemory(m_pZone);
+    m_Virtual.Unmap();
+    m_pZone = NULL;
+    m_pRegion = NULL;
+    m_Policy = MEMZONE_POLICY_ROVER;
+
+    char szName[MEMSTATS_NAME_LENGTH];
+    strcpy(szName, m_Stats.m_szName);
+    memstats()->UnregisterZone(&m_Stats);
+    m_Stats.Reset(szName);
+}
+
+inline size_t CMemoryZone::Trim(size_t nMinSize)
+{
+    // страницы зон из MallocZoneMemory принадлежат менеджеру памяти
+    if (!m_Virtual.IsMapped())
+        return 0;
+    return m_Tlsf.Trim(m_Virtual, nMinSize);
+}
+
+inline void CMemoryZone::OnMalloc(void *ptr, memorytag_t iTag)
+{
+    // для штатной зоны считаем блок целиком, заголовок memoryblock_t стоит прямо перед ptr
+    size_t nSize =
+        m_Policy == MEMZONE_POLICY_TLSF ? memorytlsf_t::GetAllocationSize(ptr) : ((memoryblock_t *)ptr - 1)->m_nSize;
+    m_Stats.OnMalloc(nSize);
+    memstats()->OnMalloc(iTag, nSize);
+}
+
+inline void CMemoryZone::OnFree(void *ptr)
+{
+    size_t nSize;
+    memorytag_t iTag;
+    if (m_Policy == MEMZONE_POLICY_TLSF)
+    {
+        const memorytlsfblock_t *pBlock =
+            (const memorytlsfblock_t *)((ubyte *)ptr - memorytlsfblock_t::TLSF_BLOCK_HEADER);
+        nSize = pBlock->GetSize();
+        iTag = pBlock->GetTag();
+    }
+    else
+    {
+        const memoryblock_t *pBlock = (const memoryblock_t *)ptr - 1;
+        nSize = pBlock->m_nSize;
+        iTag = pBlock->m_iTag;
+    }
+    m_Stats.OnFree(nSize);
+    memstats()->OnFree(iTag, nSize);
+}
+
+inline void *CMemoryZone::Malloc(size_t nSize, memorytag_t iTag)
+{
+    void *ptr = m_Policy == MEMZONE_POLICY_TLSF ? m_Tlsf.Malloc(nSize, iTag) : m_pZone->Malloc(nSize, iTag);
+    if (ptr)
+        OnMalloc(ptr, iTag);
+    return ptr;
+}
+
+inline void *CMemoryZone::MallocDebug(size_t nSize, memorytag_t iTag, const char *pszLabel, const char *pszFilename,
+                                      int iLine)
+{
+    void *ptr = m_Policy == MEMZONE_POLICY_TLSF ? m_Tlsf.MallocDebug(nSize, iTag, pszLabel, pszFilename, iLine)
+                                                 : m_pZone->Malloc(nSize, iTag, pszLabel, pszFilename, iLine);
+    if (ptr)
+        OnMalloc(ptr, iTag);
+    return ptr;
+}
+
+inline void CMemoryZone::Free(void *ptr)
+{
+    if (!ptr)
+        return;
+
+    OnFree(ptr);
+    if (m_Policy == MEMZONE_POLICY_TLSF)
+        m_Tlsf.Free(ptr);
+    else
+        m_pZone->Free(ptr);
+}
+
+inline size_t CMemoryZone::GetAvailableMemory()
+{
+    if (m_Policy == MEMZONE_POLICY_TLSF)
+        return m_Tlsf.m_nSize - m_Tlsf.m_nUsed;
+    return g_pMemoryManager->GetAvailableZoneMemory(m_pZone);
+}
+
+#endif /* HAYATOLABS_MEMTLSF_H */
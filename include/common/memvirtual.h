@@ -0,0 +1,192 @@
+/*
+  This file associated with Hayato Labs project.
+
+  For license and copyright information please follow this link:
+  https://github.com/hayatolabs/general/blob/main/LEGAL
+*/
+
+#ifndef HAYATOLABS_MEMVIRTUAL_H
+#define HAYATOLABS_MEMVIRTUAL_H
+
+#include "public.h"
+#include "platform.h"
+
+#if !defined(_WIN32)
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+#define MEMVIRTUAL_HUGE_PAGE_SIZE (2 * 1024 * 1024)
+
+enum memorypageflags_t
+{
+    MEMPAGE_NORMAL = 0,
+    MEMPAGE_HUGE_TRANSPARENT = BIT(0), // попросить ядро собрать участок из больших страниц (THP)
+    MEMPAGE_HUGE_EXPLICIT = BIT(1),    // явные большие страницы, при неудаче - обычные
+};
+
+/*
+===========================================================================
+
+   memoryvirtualregion_t - участок адресного пространства, взятый
+   напрямую у системы в обход кучи. Неиспользуемые страницы можно
+   вернуть системе через Decommit, адреса при этом остаются за нами:
+   при следующем обращении страница снова появится (содержимое не
+   сохраняется).
+
+===========================================================================
+*/
+struct memoryvirtualregion_t
+{
+    void *m_pBase;
+    size_t m_nSize;
+    size_t m_nPageSize; // гранулярность Decommit
+    bool m_bHugePages;
+    bool m_bLocked; // страницы нельзя вернуть системе (большие страницы Windows)
+
+    bool Map(size_t nSize, int iFlags = MEMPAGE_NORMAL);
+    void Unmap();
+    size_t Decommit(void *ptr, size_t nSize); // Вернуть системе целые страницы внутри участка
+
+    bool IsMapped() const
+    {
+        return m_pBase != NULL;
+    }
+
+    static size_t GetSystemPageSize();
+};
+
+inline size_t memoryvirtualregion_t::GetSystemPageSize()
+{
+#if defined(_WIN32)
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return info.dwPageSize;
+#else
+    return (size_t)sysconf(_SC_PAGESIZE);
+#endif
+}
+
+inline bool memoryvirtualregion_t::Map(size_t nSize, int iFlags)
+{
+    memset(this, 0, sizeof(*this));
+    m_nPageSize = GetSystemPageSize();
+
+#if defined(_WIN32)
+    if (iFlags & (MEMPAGE_HUGE_TRANSPARENT | MEMPAGE_HUGE_EXPLICIT))
+    {
+        // требует привилегии SeLockMemoryPrivilege, такие страницы не выгружаются
+        size_t nLargePage = GetLargePageMinimum();
+        if (nLargePage)
+        {
+            size_t nLargeSize = (nSize + nLargePage - 1) & ~(nLargePage - 1);
+            m_pBase = VirtualAlloc(NULL, nLargeSize, MEM_RESERVE | MEM_COMMIT | MEM_LARGE_PAGES, PAGE_READWRITE);
+            if (m_pBase)
+            {
+                m_nSize = nLargeSize;
+                m_nPageSize = nLargePage;
+                m_bHugePages = true;
+                m_bLocked = true;
+                return true;
+            }
+        }
+    }
+
+    nSize = (nSize + m_nPageSize - 1) & ~(m_nPageSize - 1);
+    m_pBase = VirtualAlloc(NULL, nSize, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+    if (!m_pBase)
+        return false;
+#else
+#if defined(MAP_HUGETLB)
+    if (iFlags & MEMPAGE_HUGE_EXPLICIT)
+    {
+        size_t nHugeSize = (nSize + MEMVIRTUAL_HUGE_PAGE_SIZE - 1) & ~(size_t)(MEMVIRTUAL_HUGE_PAGE_SIZE - 1);
+        void *pBase = mmap(NULL, nHugeSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        if (pBase != MAP_FAILED)
+        {
+            m_pBase = pBase;
+            m_nSize = nHugeSize;
+            m_nPageSize = MEMVIRTUAL_HUGE_PAGE_SIZE;
+            m_bHugePages = true;
+            return true;
+        }
+    }
+#endif
+
+    if (iFlags & (MEMPAGE_HUGE_TRANSPARENT | MEMPAGE_HUGE_EXPLICIT))
+    {
+        // выравниваем на большую страницу, иначе ядро не сможет её собрать
+        size_t nHugeSize = (nSize + MEMVIRTUAL_HUGE_PAGE_SIZE - 1) & ~(size_t)(MEMVIRTUAL_HUGE_PAGE_SIZE - 1);
+        size_t nMapSize = nHugeSize + MEMVIRTUAL_HUGE_PAGE_SIZE;
+        ubyte *pMap = (ubyte *)mmap(NULL, nMapSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (pMap == (ubyte *)MAP_FAILED)
+            return false;
+
+        ubyte *pBase = (ubyte *)(((uintptr_t)pMap + MEMVIRTUAL_HUGE_PAGE_SIZE - 1) &
+                                 ~(uintptr_t)(MEMVIRTUAL_HUGE_PAGE_SIZE - 1));
+        if (pBase > pMap)
+            munmap(pMap, pBase - pMap);
+        if (pMap + nMapSize > pBase + nHugeSize)
+            munmap(pBase + nHugeSize, (pMap + nMapSize) - (pBase + nHugeSize));
+
+#if defined(MADV_HUGEPAGE)
+        m_bHugePages = madvise(pBase, nHugeSize, MADV_HUGEPAGE) == 0;
+#endif
+        m_pBase = pBase;
+        m_nSize = nHugeSize;
+        // возвращаем памяти большими страницами, чтобы не дробить их
+        if (m_bHugePages)
+            m_nPageSize = MEMVIRTUAL_HUGE_PAGE_SIZE;
+        return true;
+    }
+
+    nSize = (nSize + m_nPageSize - 1) & ~(m_nPageSize - 1);
+    void *pBase = mmap(NULL, nSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (pBase == MAP_FAILED)
+        return false;
+    m_pBase = pBase;
+#endif
+
+    m_nSize = nSize;
+    return true;
+}
+
+inline void memoryvirtualregion_t::Unmap()
+{
+    if (!m_pBase)
+        return;
+
+#if defined(_WIN32)
+    VirtualFree(m_pBase, 0, MEM_RELEASE);
+#else
+    munmap(m_pBase, m_nSize);
+#endif
+    m_pBase = NULL;
+    m_nSize = 0;
+}
+
+inline size_t memoryvirtualregion_t::Decommit(void *ptr, size_t nSize)
+{
+    if (!m_pBase || m_bLocked)
+        return 0;
+
+    // только страницы, целиком лежащие внутри [ptr, ptr + nSize)
+    ubyte *pStart = (ubyte *)(((uintptr_t)ptr + m_nPageSize - 1) & ~(uintptr_t)(m_nPageSize - 1));
+    ubyte *pEnd = (ubyte *)(((uintptr_t)ptr + nSize) & ~(uintptr_t)(m_nPageSize - 1));
+    if (pEnd <= pStart)
+        return 0;
+
+    size_t nBytes = pEnd - pStart;
+#if defined(_WIN32)
+    // MEM_RESET оставляет страницы за процессом, VirtualUnlock выкидывает их из рабочего набора
+    if (!VirtualAlloc(pStart, nBytes, MEM_RESET, PAGE_READWRITE))
+        return 0;
+    VirtualUnlock(pStart, nBytes);
+#else
+    if (madvise(pStart, nBytes, MADV_DONTNEED) != 0)
+        return 0;
+#endif
+    return nBytes;
+}
+
+#endif /* HAYATOLABS_MEMVIRTUAL_H */
@@ -14,6 +14,15 @@ typedef int memorytag_t;
 #define TAG_GENERAL 1 // malloc, free
 #define TAG_NEW 2     // new, delete
 #define TAG_THREAD 3
+#define TAG_SLAB 4    // страницы слябового аллокатора (memslab.h)
+#define TAG_PACKAGE 6 // сегменты пакетов (binary_segments.h)
+
+#define MAX_MEMORY_TAGS 32 // тэги выше попадают в последний слот статистики
+
+inline int MemTagIndex(memorytag_t iTag)
+{
+    return (iTag >= 0 && iTag < MAX_MEMORY_TAGS) ? iTag : MAX_MEMORY_TAGS - 1;
+}
 
 /*
 ===========================================================================
@@ -14,11 +14,19 @@
 //
 // Msg.cpp
 //
+typedef enum
+{
+    MSGCODER_HUFFMAN, // adaptive huffman, Huff_Compress/Huff_Decompress
+    MSGCODER_RANS,    // static table rANS, see rans.h
+} msgcoder_t;
+
 typedef struct
 {
     bool bAllowOverflow; // if false, do a Com_Error
     bool bOverflowed;    // bSet to true if the szBuffer nSize failed (with bAllowOverflow bSet)
     bool oob;            // raw out-of-band operation, no static huffman encoding/decoding
+    ubyte iCoder;        // msgcoder_t for MSG_Compress/MSG_Decompress, cleared by MSG_Init
+    ubyte iCoderTable;   // rANS frequency table, see RansTable
     ubyte *pData;
     int nMaxsize;
     int nMaxbits; // nMaxsize in bits, for overflow checks
@@ -55,6 +63,8 @@ void MSG_WriteBounds2(msg_t *sb, const bounds2d_t &bounds);
 void MSG_BeginReading(msg_t *sb);
 void MSG_BeginReadingOOB(msg_t *sb);
 
+void MSG_pReadData(msg_t *sb, void *pData, int nLength);
+
 int MSG_ReadChar(msg_t *sb);
 int MSG_ReadByte(msg_t *sb);
 int MSG_ReadShort(msg_t *sb);
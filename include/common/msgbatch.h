@@ -0,0 +1,654 @@
+/*
+  This file associated with Hayato Labs project.
+
+  For license and copyright information please follow this link:
+  https://github.com/hayatolabs/general/blob/main/LEGAL
+*/
+
+#ifndef HAYATOLABS_MSGBATCH_H
+#define HAYATOLABS_MSGBATCH_H
+
+#include "rans.h"
+#include "thread.h"
+#include <thread>
+
+#define HUFF_NYT 256           // ещё не встречавшийся символ
+#define HUFF_INTERNAL_NODE 257 // внутренний узел дерева
+#define HUFF_MAX_NODES 768
+#define HUFF_MAX_SYMBOL_BYTES 64 // с запасом на NYT и 8 бит символа в самом глубоком дереве
+
+#define MSGBATCH_MIN_PARALLEL 2 // меньше сообщений сжимаем в вызывающем потоке
+
+#define MSGBATCH_JOB_PENDING 0
+#define MSGBATCH_JOB_SKIPPED 1    // не прошло проверку в вызывающем потоке, ошибка уже сообщена
+#define MSGBATCH_JOB_OVERFLOWED 2 // результат не влез, сообщается после завершения рабочих
+
+/*
+===========================================================================
+
+   CHuffmanAdaptive - адаптивный Хаффман, побитно совместимый с
+   Huff_Compress/Huff_Decompress.
+
+   Библиотечная реализация держит позицию в потоке бит в глобальной
+   переменной, поэтому из нескольких потоков её звать нельзя. Здесь всё
+   состояние - дерево и буфер - в объекте: один объект на поток.
+
+   Формат: 2 байта размера исходных данных (старший первым), затем
+   коды символов; новый символ передаётся кодом NYT и 8 битами,
+   старшим вперёд.
+
+   Encode - то же, что Compress, но без обращений к common(), для
+   рабочих потоков: размер проверяет вызывающий, переполнение только
+   выставляет bOverflowed.
+
+===========================================================================
+*/
+struct huffnode_t
+{
+    huffnode_t *m_pLeft;
+    huffnode_t *m_pRight;
+    huffnode_t *m_pParent;
+    huffnode_t *m_pNext; // список узлов по весу
+    huffnode_t *m_pPrev;
+    huffnode_t **m_ppHead; // первый узел с таким же весом
+    int m_nWeight;
+    int m_iSymbol;
+};
+
+class CHuffmanAdaptive
+{
+  public:
+    CHuffmanAdaptive()
+    {
+        m_nBlocNode = HUFF_MAX_NODES;
+        m_nBlocPtrs = HUFF_MAX_NODES;
+    }
+
+    void Compress(msg_t *msg, int offset);
+    bool Encode(msg_t *msg, int offset);     // false, если не влезло в сообщение
+    bool Decompress(msg_t *msg, int offset); // false, если поток оборвался
+
+  private:
+    int m_nBlocNode;
+    int m_nBlocPtrs;
+    huffnode_t *m_pTree;
+    huffnode_t *m_pHead;
+    huffnode_t *m_pLoc[HUFF_NYT + 1];
+    huffnode_t **m_ppFreeList;
+    huffnode_t m_Nodes[HUFF_MAX_NODES];
+    huffnode_t *m_pNodePtrs[HUFF_MAX_NODES];
+
+    ubyte m_Sequence[MSGCODER_MAX_SIZE + 1 + HUFF_MAX_SYMBOL_BYTES];
+    ubyte *m_pStream;
+    int m_iBit;
+
+    void Reset();
+    huffnode_t **AllocHead();
+    void FreeHead(huffnode_t **ppHead);
+    void Swap(huffnode_t *pNode1, huffnode_t *pNode2);
+    void SwapList(huffnode_t *pNode1, huffnode_t *pNode2);
+    void Increment(huffnode_t *pNode);
+    void AddRef(ubyte iSymbol);
+
+    void PutBit(int iBit);
+    int GetBit();
+    void Send(huffnode_t *pNode, huffnode_t *pChild);
+    void Transmit(int iSymbol);
+
+    CHuffmanAdaptive(const CHuffmanAdaptive &s)
+    {
+    }
+    void operator=(const CHuffmanAdaptive &s)
+    {
+    }
+};
+
+inline void CHuffmanAdaptive::Reset()
+{
+    // чистим только то, что занял прошлый вызов: на коротких сообщениях это малая часть дерева
+    memset(m_Nodes, 0, m_nBlocNode * sizeof(huffnode_t));
+    memset(m_pNodePtrs, 0, m_nBlocPtrs * sizeof(huffnode_t *));
+    memset(m_pLoc, 0, sizeof(m_pLoc));
+    m_nBlocNode = 0;
+    m_nBlocPtrs = 0;
+    m_ppFreeList = NULL;
+
+    m_pTree = m_pHead = m_pLoc[HUFF_NYT] = &m_Nodes[m_nBlocNode++];
+    m_pTree->m_iSymbol = HUFF_NYT;
+}
+
+inline huffnode_t **CHuffmanAdaptive::AllocHead()
+{
+    if (!m_ppFreeList)
+        return &m_pNodePtrs[m_nBlocPtrs++];
+
+    huffnode_t **ppHead = m_ppFreeList;
+    m_ppFreeList = (huffnode_t **)*ppHead;
+    return ppHead;
+}
+
+inline void CHuffmanAdaptive::FreeHead(huffnode_t **ppHead)
+{
+    *ppHead = (huffnode_t *)m_ppFreeList;
+    m_ppFreeList = ppHead;
+}
+
+// поменять два узла местами в дереве
+inline void CHuffmanAdaptive::Swap(huffnode_t *pNode1, huffnode_t *pNode2)
+{
+    huffnode_t *pParent1 = pNode1->m_pParent;
+    huffnode_t *pParent2 = pNode2->m_pParent;
+
+    if (pParent1)
+    {
+        if (pParent1->m_pLeft == pNode1)
+            pParent1->m_pLeft = pNode2;
+        else
+            pParent1->m_pRight = pNode2;
+    }
+    else
+        m_pTree = pNode2;
+
+    if (pParent2)
+    {
+        if (pParent2->m_pLeft == pNode2)
+            pParent2->m_pLeft = pNode1;
+        else
+            pParent2->m_pRight = pNode1;
+    }
+    else
+        m_pTree = pNode1;
+
+    pNode1->m_pParent = pParent2;
+    pNode2->m_pParent = pParent1;
+}
+
+// поменять два узла местами в списке по весу
+inline void CHuffmanAdaptive::SwapList(huffnode_t *pNode1, huffnode_t *pNode2)
+{
+    huffnode_t *pTemp = pNode1->m_pNext;
+    pNode1->m_pNext = pNode2->m_pNext;
+    pNode2->m_pNext = pTemp;
+
+    pTemp = pNode1->m_pPrev;
+    pNode1->m_pPrev = pNode2->m_pPrev;
+    pNode2->m_pPrev = pTemp;
+
+    if (pNode1->m_pNext == pNode1)
+        pNode1->m_pNext = pNode2;
+    if (pNode2->m_pNext == pNode2)
+        pNode2->m_pNext = pNode1;
+    if (pNode1->m_pNext)
+        pNode1->m_pNext->m_pPrev = pNode1;
+    if (pNode2->m_pNext)
+        pNode2->m_pNext->m_pPrev = pNode2;
+    if (pNode1->m_pPrev)
+        pNode1->m_pPrev->m_pNext = pNode1;
+    if (pNode2->m_pPrev)
+        pNode2->m_pPrev->m_pNext = pNode2;
+}
+
+inline void CHuffmanAdaptive::Increment(huffnode_t *pNode)
+{
+    if (!pNode)
+        return;
+
+    if (pNode->m_pNext && pNode->m_pNext->m_nWeight == pNode->m_nWeight)
+    {
+        huffnode_t *pLeader = *pNode->m_ppHead;
+        if (pLeader != pNode->m_pParent)
+            Swap(pLeader, pNode);
+        SwapList(pLeader, pNode);
+    }
+
+    if (pNode->m_pPrev && pNode->m_pPrev->m_nWeight == pNode->m_nWeight)
+        *pNode->m_ppHead = pNode->m_pPrev;
+    else
+    {
+        *pNode->m_ppHead = NULL;
+        FreeHead(pNode->m_ppHead);
+    }
+
+    pNode->m_nWeight++;
+    if (pNode->m_pNext && pNode->m_pNext->m_nWeight == pNode->m_nWeight)
+        pNode->m_ppHead = pNode->m_pNext->m_ppHead;
+    else
+    {
+        pNode->m_ppHead = AllocHead();
+        *pNode->m_ppHead = pNode;
+    }
+
+    if (pNode->m_pParent)
+    {
+        Increment(pNode->m_pParent);
+        if (pNode->m_pPrev == pNode->m_pParent)
+        {
+            SwapList(pNode, pNode->m_pParent);
+            if (*pNode->m_ppHead == pNode)
+                *pNode->m_ppHead = pNode->m_pParent;
+        }
+    }
+}
+
+inline void CHuffmanAdaptive::AddRef(ubyte iSymbol)
+{
+    if (m_pLoc[iSymbol])
+    {
+        Increment(m_pLoc[iSymbol]);
+        return;
+    }
+
+    // первая встреча символа: NYT расщепляется на новый NYT и лист символа
+    huffnode_t *pLeaf = &m_Nodes[m_nBlocNode++];
+    huffnode_t *pInternal = &m_Nodes[m_nBlocNode++];
+
+    pInternal->m_iSymbol = HUFF_INTERNAL_NODE;
+    pInternal->m_nWeight = 1;
+    pInternal->m_pNext = m_pHead->m_pNext;
+    if (m_pHead->m_pNext)
+    {
+        m_pHead->m_pNext->m_pPrev = pInternal;
+        if (m_pHead->m_pNext->m_nWeight == 1)
+            pInternal->m_ppHead = m_pHead->m_pNext->m_ppHead;
+        else
+        {
+            pInternal->m_ppHead = AllocHead();
+            *pInternal->m_ppHead = pInternal;
+        }
+    }
+    else
+    {
+        pInternal->m_ppHead = AllocHead();
+        *pInternal->m_ppHead = pInternal;
+    }
+    m_pHead->m_pNext = pInternal;
+    pInternal->m_pPrev = m_pHead;
+
+    pLeaf->m_iSymbol = iSymbol;
+    pLeaf->m_nWeight = 1;
+    pLeaf->m_pNext = m_pHead->m_pNext;
+    if (m_pHead->m_pNext)
+    {
+        m_pHead->m_pNext->m_pPrev = pLeaf;
+        if (m_pHead->m_pNext->m_nWeight == 1)
+            pLeaf->m_ppHead = m_pHead->m_pNext->m_ppHead;
+        else
+        {
+            // не должно случаться, но повторяем Huff_addRef как есть
+            pLeaf->m_ppHead = AllocHead();
+            *pLeaf->m_ppHead = pInternal;
+        }
+    }
+    else
+    {
+        pLeaf->m_ppHead = AllocHead();
+        *pLeaf->m_ppHead = pLeaf;
+    }
+    m_pHead->m_pNext = pLeaf;
+    pLeaf->m_pPrev = m_pHead;
+    pLeaf->m_pLeft = pLeaf->m_pRight = NULL;
+
+    if (m_pHead->m_pParent)
+    {
+        if (m_pHead->m_pParent->m_pLeft == m_pHead)
+            m_pHead->m_pParent->m_pLeft = pInternal;
+        else
+            m_pHead->m_pParent->m_pRight = pInternal;
+    }
+    else
+        m_pTree = pInternal;
+
+    pInternal->m_pRight = pLeaf;
+    pInternal->m_pLeft = m_pHead;
+    pInternal->m_pParent = m_pHead->m_pParent;
+    m_pHead->m_pParent = pLeaf->m_pParent = pInternal;
+
+    m_pLoc[iSymbol] = pLeaf;
+    Increment(pInternal->m_pParent);
+}
+
+inline void CHuffmanAdaptive::PutBit(int iBit)
+{
+    if (!(m_iBit & 7))
+        m_pStream[m_iBit >> 3] = 0;
+    m_pStream[m_iBit >> 3] |= iBit << (m_iBit & 7);
+    m_iBit++;
+}
+
+inline int CHuffmanAdaptive::GetBit()
+{
+    int iBit = (m_pStream[m_iBit >> 3] >> (m_iBit & 7)) & 1;
+    m_iBit++;
+    return iBit;
+}
+
+// код узла: путь от корня, поэтому сначала код родителя
+inline void CHuffmanAdaptive::Send(huffnode_t *pNode, huffnode_t *pChild)
+{
+    if (pNode->m_pParent)
+        Send(pNode->m_pParent, pNode);
+    if (pChild)
+        PutBit(pNode->m_pRight == pChild);
+}
+
+inline void CHuffmanAdaptive::Transmit(int iSymbol)
+{
+    if (m_pLoc[iSymbol])
+    {
+        Send(m_pLoc[iSymbol], NULL);
+        return;
+    }
+
+    Transmit(HUFF_NYT);
+    for (int i = 7; i >= 0; i--)
+        PutBit((iSymbol >> i) & 1);
+}
+
+inline void CHuffmanAdaptive::Compress(msg_t *msg, int offset)
+{
+    int nSize = msg->nCursize - offset;
+    if (nSize > MSGCODER_MAX_SIZE)
+    {
+        common()->Error("CHuffmanAdaptive::Compress: %d bytes", nSize);
+        return;
+    }
+
+    if (!Encode(msg, offset) && !msg->bAllowOverflow)
+        common()->Error("CHuffmanAdaptive::Compress: overflow");
+}
+
+inline bool CHuffmanAdaptive::Encode(msg_t *msg, int offset)
+{
+    int nSize = msg->nCursize - offset;
+    if (nSize <= 0)
+        return true;
+
+    Reset();
+    const ubyte *pData = msg->pData + offset;
+    m_pStream = m_Sequence;
+    m_pStream[0] = (ubyte)(nSize >> 8);
+    m_pStream[1] = (ubyte)nSize;
+    m_iBit = 16;
+
+    for (int i = 0; i < nSize; i++)
+    {
+        // сжатое может не влезть в сообщение, а буфер кончиться раньше, чем данные
+        if ((m_iBit >> 3) + HUFF_MAX_SYMBOL_BYTES > (int)sizeof(m_Sequence) || offset + (m_iBit >> 3) > msg->nMaxsize)
+        {
+            msg->bOverflowed = true;
+            return false;
+        }
+        Transmit(pData[i]);
+        AddRef(pData[i]);
+    }
+
+    // Huff_Compress добавляет байт в конце; он может быть не тронут PutBit
+    if (!(m_iBit & 7))
+        m_pStream[m_iBit >> 3] = 0;
+    m_iBit += 8;
+
+    int nBytes = m_iBit >> 3;
+    if (offset + nBytes > msg->nMaxsize)
+    {
+        msg->bOverflowed = true;
+        return false;
+    }
+    memcpy(msg->pData + offset, m_pStream, nBytes);
+    msg->nCursize = offset + nBytes;
+    return true;
+}
+
+inline bool CHuffmanAdaptive::Decompress(msg_t *msg, int offset)
+{
+    int nSize = msg->nCursize - offset;
+    if (nSize <= 0)
+        return true;
+
+    Reset();
+    m_pStream = msg->pData + offset;
+    m_iBit = 16;
+
+    int nDecoded = nSize >= 2 ? (m_pStream[0] << 8) | m_pStream[1] : 0;
+    nDecoded = Min(nDecoded, msg->nMaxsize - offset);
+
+    // код символа целиком должен лежать в сообщении, иначе обрыв
+    int nMaxBits = nSize * 8;
+    bool bComplete = true;
+    for (int i = 0; i < nDecoded; i++)
+    {
+        huffnode_t *pNode = m_pTree;
+        while (pNode && pNode->m_iSymbol == HUFF_INTERNAL_NODE && m_iBit < nMaxBits)
+            pNode = GetBit() ? pNode->m_pRight : pNode->m_pLeft;
+
+        int iSymbol = pNode ? pNode->m_iSymbol : 0;
+        if (iSymbol == HUFF_NYT && m_iBit + 8 <= nMaxBits)
+        {
+            iSymbol = 0;
+            for (int iBit = 0; iBit < 8; iBit++)
+                iSymbol = (iSymbol << 1) | GetBit();
+        }
+        if (iSymbol >= HUFF_NYT || (m_iBit >> 3) > nSize)
+        {
+            memset(m_Sequence + i, 0, nDecoded - i);
+            bComplete = false;
+            break;
+        }
+
+        m_Sequence[i] = (ubyte)iSymbol;
+        AddRef((ubyte)iSymbol);
+    }
+
+    memcpy(msg->pData + offset, m_Sequence, nDecoded);
+    msg->nCursize = offset + nDecoded;
+    return bComplete;
+}
+
+/*
+===========================================================================
+
+   CMsgBatchCoder - сжатие и распаковка пачки сообщений пулом потоков.
+
+   Конец тика сервера: одно сообщение на клиента, каждое сжимается
+   независимо. Потоки разбирают сообщения по общему счётчику, у каждого
+   свой CHuffmanAdaptive, так что общего изменяемого состояния нет.
+   Вызывающий поток работает наравне с остальными.
+
+   Сообщения с msg->iCoder == MSGCODER_RANS идут через
+   MSG_CompressRans/MSG_DecompressRans: буфер thread_local, таблицы
+   только читаются. Регистрировать таблицы во время обработки пачки
+   нельзя.
+
+   Рабочие потоки не зовут common(). Размеры и таблицы проверяются в
+   вызывающем потоке до запуска рабочих, такие сообщения не трогаются.
+   Переполнение помечается bOverflowed, а для сообщений без
+   bAllowOverflow ошибка выдаётся в вызывающем потоке, когда пачка
+   обработана. Битые сообщения при распаковке - через pResults.
+
+      CMsgBatchCoder coder(0);         // потоков по числу ядер
+      coder.Compress(pMessages, nClients, 4);
+
+   Compress/Decompress вызываются из одного потока за раз.
+
+===========================================================================
+*/
+class CMsgBatchCoder
+{
+  public:
+    CMsgBatchCoder(int nThreads = 0); // 0 - по числу ядер, считая вызывающий поток
+    ~CMsgBatchCoder();
+
+    void Compress(msg_t **ppMessages, int nCount, int offset);
+
+    // pResults, если задан, получает результат по каждому сообщению
+    int Decompress(msg_t **ppMessages, int nCount, int offset, bool *pResults = NULL); // число ошибок
+
+    int GetNumThreads() const
+    {
+        return (int)m_Workers.size() + 1;
+    }
+
+  private:
+    class CWorker : public CSystemThread
+    {
+      public:
+        CMsgBatchCoder *m_pOwner;
+        CHuffmanAdaptive m_Huffman;
+
+      protected:
+        virtual int Run()
+        {
+            m_pOwner->RunJobs(m_Huffman);
+            return 0;
+        }
+    };
+
+    std::vector<CWorker *> m_Workers;
+    CHuffmanAdaptive *m_pHuffman; // для вызывающего потока
+
+    msg_t **m_ppMessages;
+    int m_nCount;
+    int m_iOffset;
+    bool m_bDecompress;
+    bool *m_pResults;
+    std::vector<ubyte> m_Jobs; // MSGBATCH_JOB_*, каждый элемент пишет только свой поток
+    CSysInterlockedInteger m_iNext;
+    CSysInterlockedInteger m_nFailed;
+
+    void Run(msg_t **ppMessages, int nCount, int offset, bool bDecompress, bool *pResults);
+    void RunJobs(CHuffmanAdaptive &huffman);
+
+    CMsgBatchCoder(const CMsgBatchCoder &s)
+    {
+    }
+    void operator=(const CMsgBatchCoder &s)
+    {
+    }
+};
+
+inline CMsgBatchCoder::CMsgBatchCoder(int nThreads)
+{
+    if (nThreads <= 0)
+        nThreads = Max((int)std::thread::hardware_concurrency(), 1);
+
+    m_pHuffman = new CHuffmanAdaptive;
+    for (int i = 1; i < nThreads; i++)
+    {
+        CWorker *pWorker = new CWorker;
+        pWorker->m_pOwner = this;
+
+        char szName[32];
+        snprintf(szName, sizeof(szName), "msgbatch%d", i);
+        if (!pWorker->StartWorkerThread(szName, CORE_ANY))
+        {
+            delete pWorker;
+            break;
+        }
+        m_Workers.push_back(pWorker);
+    }
+}
+
+inline CMsgBatchCoder::~CMsgBatchCoder()
+{
+    for (size_t i = 0; i < m_Workers.size(); i++)
+    {
+        m_Workers[i]->StopThread();
+        delete m_Workers[i];
+    }
+    delete m_pHuffman;
+}
+
+inline void CMsgBatchCoder::RunJobs(CHuffmanAdaptive &huffman)
+{
+    for (;;)
+    {
+        int i = m_iNext.Increment() - 1;
+        if (i >= m_nCount)
+            return;
+
+        if (m_Jobs[i] == MSGBATCH_JOB_SKIPPED)
+            continue;
+
+        msg_t *msg = m_ppMessages[i];
+        bool bOverflowed = msg->bOverflowed;
+        bool bResult;
+        if (!m_bDecompress)
+        {
+            if (msg->iCoder == MSGCODER_RANS)
+                bResult = MSG_CompressRans(msg, m_iOffset, RansTable(msg->iCoderTable));
+            else
+                bResult = huffman.Encode(msg, m_iOffset);
+        }
+        else if (msg->iCoder == MSGCODER_RANS)
+            bResult = MSG_DecompressRans(msg, m_iOffset);
+        else
+            bResult = huffman.Decompress(msg, m_iOffset);
+
+        if (msg->bOverflowed && !bOverflowed)
+            m_Jobs[i] = MSGBATCH_JOB_OVERFLOWED;
+        if (!m_bDecompress)
+            continue;
+
+        if (m_pResults)
+            m_pResults[i] = bResult;
+        if (!bResult)
+            m_nFailed.Increment();
+    }
+}
+
+inline void CMsgBatchCoder::Run(msg_t **ppMessages, int nCount, int offset, bool bDecompress, bool *pResults)
+{
+    m_ppMessages = ppMessages;
+    m_nCount = nCount;
+    m_iOffset = offset;
+    m_bDecompress = bDecompress;
+    m_pResults = pResults;
+    m_iNext.SetValue(0);
+    m_nFailed.SetValue(0);
+
+    // всё, что требует common(), проверяем здесь, пока рабочие спят
+    m_Jobs.assign(nCount, MSGBATCH_JOB_PENDING);
+    for (int i = 0; i < nCount && !bDecompress; i++)
+    {
+        msg_t *msg = ppMessages[i];
+        int nSize = msg->nCursize - offset;
+        if (nSize > MSGCODER_MAX_SIZE)
+        {
+            common()->Error("CMsgBatchCoder::Compress: %d bytes", nSize);
+            m_Jobs[i] = MSGBATCH_JOB_SKIPPED;
+        }
+        else if (msg->iCoder == MSGCODER_RANS && !RansTable(msg->iCoderTable))
+        {
+            common()->Error("CMsgBatchCoder::Compress: rANS table %d is not registered", msg->iCoderTable);
+            m_Jobs[i] = MSGBATCH_JOB_SKIPPED;
+        }
+    }
+
+    // на паре сообщений будить потоки дороже, чем сжать самим
+    int nWorkers = nCount < MSGBATCH_MIN_PARALLEL ? 0 : Min((int)m_Workers.size(), nCount - 1);
+    for (int i = 0; i < nWorkers; i++)
+        m_Workers[i]->SignalWork();
+
+    RunJobs(*m_pHuffman);
+
+    for (int i = 0; i < nWorkers; i++)
+        m_Workers[i]->WaitForThread();
+
+    for (int i = 0; i < nCount; i++)
+    {
+        if (m_Jobs[i] == MSGBATCH_JOB_OVERFLOWED && !ppMessages[i]->bAllowOverflow)
+            common()->Error("CMsgBatchCoder: message %d overflowed", i);
+    }
+}
+
+inline void CMsgBatchCoder::Compress(msg_t **ppMessages, int nCount, int offset)
+{
+    Run(ppMessages, nCount, offset, false, NULL);
+}
+
+inline int CMsgBatchCoder::Decompress(msg_t **ppMessages, int nCount, int offset, bool *pResults)
+{
+    Run(ppMessages, nCount, offset, true, pResults);
+    return m_nFailed.GetValue();
+}
+
+#endif /* HAYATOLABS_MSGBATCH_H */
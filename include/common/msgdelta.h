@@ -0,0 +1,261 @@
+/*
+  This file associated with Hayato Labs project.
+
+  For license and copyright information please follow this link:
+  https://github.com/hayatolabs/general/blob/main/LEGAL
+*/
+
+#ifndef HAYATOLABS_MSGDELTA_H
+#define HAYATOLABS_MSGDELTA_H
+
+#include "huffman.h"
+
+#define NETFIELD_MAX_FIELDS 256
+#define NETFIELD_FLOAT_INT_BITS 13 // целые float пишутся короче
+#define NETFIELD_FLOAT_INT_BIAS (1 << (NETFIELD_FLOAT_INT_BITS - 1))
+
+/*
+===========================================================================
+
+   Дельта-сжатие структур по таблице полей
+
+   Структура описывается массивом netfield_t. Запись относительно
+   базовой версии:
+
+      lc            - номер последнего изменённого поля + 1
+      для полей < lc:
+         1 бит      - поле изменилось
+         1 бит      - новое значение ненулевое
+         значение   - m_nBits бит, для float см. ниже
+
+   float: 0 - целое число в NETFIELD_FLOAT_INT_BITS бит со смещением,
+   1 - полные 32 бита. Неизменённые поля и поля после lc при чтении
+   копируются из базы. Байты структуры вне таблицы не трогаются.
+
+   Пример:
+
+      static const netfield_t s_EntityFields[] = {
+          NETFIELD(entitystate_t, m_Origin.x, 0, NETFIELD_FLOAT),
+          NETFIELD(entitystate_t, m_iModel, 10, NETFIELD_UINT),
+      };
+
+   Поля, которые меняются чаще, стоит ставить в начало таблицы: тогда
+   lc меньше и пропускается больше флагов.
+
+===========================================================================
+*/
+enum netfieldtype_t
+{
+    NETFIELD_INT,   // знаковое, m_nBits бит
+    NETFIELD_UINT,  // беззнаковое, m_nBits бит
+    NETFIELD_FLOAT, // float, m_nBits не используется
+};
+
+struct netfield_t
+{
+    const char *m_pszName;
+    uint16 m_nOffset;
+    uint8 m_nSize; // 1, 2 или 4 байта
+    uint8 m_nBits; // от 1 до 32
+    netfieldtype_t m_iType;
+};
+
+#define NETFIELD(type, field, bits, fieldtype)                                                                         \
+    {                                                                                                                  \
+        #field, (uint16)offsetof(type, field), (uint8)sizeof(((type *)0)->field), bits, fieldtype                      \
+    }
+
+inline uint32 NetField_Load(const void *pStruct, const netfield_t *pField)
+{
+    const ubyte *p = (const ubyte *)pStruct + pField->m_nOffset;
+    switch (pField->m_nSize)
+    {
+    case 1:
+        return *p;
+    case 2: {
+        uint16 value;
+        memcpy(&value, p, 2);
+        return value;
+    }
+    case 4: {
+        uint32 value;
+        memcpy(&value, p, 4);
+        return value;
+    }
+    default:
+        // 8-байтные и прочие поля в 32-битное значение не помещаются
+        common()->Error("NetField_Load: field '%s' has size %d", pField->m_pszName, pField->m_nSize);
+        return 0;
+    }
+}
+
+inline void NetField_Store(void *pStruct, const netfield_t *pField, uint32 iValue)
+{
+    ubyte *p = (ubyte *)pStruct + pField->m_nOffset;
+    switch (pField->m_nSize)
+    {
+    case 1:
+        *p = (ubyte)iValue;
+        break;
+    case 2: {
+        uint16 value = (uint16)iValue;
+        memcpy(p, &value, 2);
+        break;
+    }
+    case 4:
+        memcpy(p, &iValue, 4);
+        break;
+    default:
+        common()->Error("NetField_Store: field '%s' has size %d", pField->m_pszName, pField->m_nSize);
+        break;
+    }
+}
+
+// ширина lc для таблицы из nFields полей, для пустой таблицы - 1 бит
+inline int NetField_CountBits(int nFields)
+{
+    return nFields > 0 ? Log2Floor((uint64)nFields) + 1 : 1;
+}
+
+/*
+===========================================================================
+
+   MSG_WriteDeltaFields - записать pTo относительно pFrom.
+   Возвращает false, если поля не изменились (в поток тогда уходит
+   только нулевой lc).
+
+===========================================================================
+*/
+inline bool MSG_WriteDeltaFields(CMsgBitWriter &writer, const netfield_t *pFields, int nFields, const void *pFrom,
+                                 const void *pTo)
+{
+    if (nFields > NETFIELD_MAX_FIELDS)
+    {
+        common()->Error("MSG_WriteDeltaFields: %d fields", nFields);
+        return false;
+    }
+
+    // значения грузим один раз, заодно находим lc
+    uint32 values[NETFIELD_MAX_FIELDS];
+    int lc = 0;
+    for (int i = 0; i < nFields; i++)
+    {
+        values[i] = NetField_Load(pTo, &pFields[i]);
+        if (values[i] != NetField_Load(pFrom, &pFields[i]))
+            lc = i + 1;
+    }
+
+    writer.WriteBits(lc, NetField_CountBits(nFields));
+
+    for (int i = 0; i < lc; i++)
+    {
+        const netfield_t *pField = &pFields[i];
+        uint32 iValue = values[i];
+
+        if (iValue == NetField_Load(pFrom, pField))
+        {
+            writer.WriteBits(0, 1);
+            continue;
+        }
+        writer.WriteBits(1, 1);
+
+        // у 0 и 0.0f одинаковые нулевые биты
+        if (!iValue)
+        {
+            writer.WriteBits(0, 1);
+            continue;
+        }
+        writer.WriteBits(1, 1);
+
+        if (pField->m_iType != NETFIELD_FLOAT)
+        {
+            writer.WriteBits((int)iValue, pField->m_nBits);
+            continue;
+        }
+
+        float flValue;
+        memcpy(&flValue, &iValue, 4);
+
+        // сравнения с границами заодно отсекают NaN, -0.0f уходит полным float
+        if (flValue >= -NETFIELD_FLOAT_INT_BIAS && flValue < NETFIELD_FLOAT_INT_BIAS &&
+            flValue == (float)(int)flValue && iValue != 0x80000000)
+        {
+            writer.WriteBits(0, 1);
+            writer.WriteBits((int)flValue + NETFIELD_FLOAT_INT_BIAS, NETFIELD_FLOAT_INT_BITS);
+        }
+        else
+        {
+            writer.WriteBits(1, 1);
+            writer.WriteBits((int)iValue, 32);
+        }
+    }
+    return lc != 0;
+}
+
+inline bool MSG_WriteDeltaFields(msg_t *msg, const netfield_t *pFields, int nFields, const void *pFrom,
+                                 const void *pTo)
+{
+    CMsgBitWriter writer(msg);
+    bool bChanged = MSG_WriteDeltaFields(writer, pFields, nFields, pFrom, pTo);
+    writer.End();
+    return bChanged;
+}
+
+/*
+===========================================================================
+
+   MSG_ReadDeltaFields - прочитать pTo относительно pFrom.
+   pFrom и pTo могут совпадать.
+
+===========================================================================
+*/
+inline void MSG_ReadDeltaFields(CMsgBitReader &reader, const netfield_t *pFields, int nFields, const void *pFrom,
+                                void *pTo)
+{
+    int lc = reader.ReadBits(NetField_CountBits(nFields));
+    if (lc > nFields)
+    {
+        common()->Error("MSG_ReadDeltaFields: bad field count %d", lc);
+        return;
+    }
+
+    for (int i = 0; i < nFields; i++)
+    {
+        const netfield_t *pField = &pFields[i];
+        if (i >= lc || !reader.ReadBits(1))
+        {
+            if (pTo != pFrom)
+                NetField_Store(pTo, pField, NetField_Load(pFrom, pField));
+            continue;
+        }
+
+        uint32 iValue = 0;
+        if (!reader.ReadBits(1))
+            iValue = 0;
+        else if (pField->m_iType != NETFIELD_FLOAT)
+        {
+            // читаем без знака: знаковое чтение msg_t расширяет знак не по полной ширине
+            iValue = (uint32)reader.ReadBits(pField->m_nBits);
+            if (pField->m_iType == NETFIELD_INT && pField->m_nBits < 32 && (iValue & BIT(pField->m_nBits - 1)))
+                iValue |= ~BitMask32(pField->m_nBits);
+        }
+        else if (!reader.ReadBits(1))
+        {
+            float flValue = (float)(reader.ReadBits(NETFIELD_FLOAT_INT_BITS) - NETFIELD_FLOAT_INT_BIAS);
+            memcpy(&iValue, &flValue, 4);
+        }
+        else
+            iValue = (uint32)reader.ReadBits(32);
+
+        NetField_Store(pTo, pField, iValue);
+    }
+}
+
+inline void MSG_ReadDeltaFields(msg_t *msg, const netfield_t *pFields, int nFields, const void *pFrom, void *pTo)
+{
+    CMsgBitReader reader(msg);
+    MSG_ReadDeltaFields(reader, pFields, nFields, pFrom, pTo);
+    reader.End();
+}
+
+#endif /* HAYATOLABS_MSGDELTA_H */
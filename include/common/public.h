@@ -128,6 +128,34 @@ template <class T> T Min(T x, T y)
 #define NUMBITS(_type_) (sizeof(_type_) * 8)
 #endif
 
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+// Номер старшего единичного бита, x не должен быть нулём
+inline int Log2Floor(uint64 x)
+{
+#ifdef _MSC_VER
+    unsigned long iIndex;
+    _BitScanReverse64(&iIndex, x);
+    return (int)iIndex;
+#else
+    return 63 - __builtin_clzll(x);
+#endif
+}
+
+// Номер младшего единичного бита, x не должен быть нулём
+inline int LowestSetBit(uint64 x)
+{
+#ifdef _MSC_VER
+    unsigned long iIndex;
+    _BitScanForward64(&iIndex, x);
+    return (int)iIndex;
+#else
+    return __builtin_ctzll(x);
+#endif
+}
+
 // filesystem.hpp
 #define INVALID_HANDLE -1
 using File_t = int16;
@@ -0,0 +1,394 @@
+/*
+  This file associated with Hayato Labs project.
+
+  For license and copyright information please follow this link:
+  https://github.com/hayatolabs/general/blob/main/LEGAL
+*/
+
+#ifndef HAYATOLABS_RANS_H
+#define HAYATOLABS_RANS_H
+
+#include "huffman.h"
+
+#define RANS_PROB_BITS 12
+#define RANS_PROB_SCALE (1 << RANS_PROB_BITS)
+#define RANS_BYTE_L (1u << 23) // нижняя граница состояния
+#define RANS_MAX_TABLES 16     // номер таблицы занимает 4 бита заголовка
+#define RANS_STATE_BYTES 8     // два состояния в начале потока
+
+#define MSGCODER_HEADER_STORED 0x00 // данные без сжатия
+#define MSGCODER_HEADER_RANS 0x10   // rANS, формат 1, младшие 4 бита - номер таблицы
+#define MSGCODER_HEADER_MASK 0xF0
+#define MSGCODER_MAX_SIZE 65535 // размер пишется двумя байтами
+
+/*
+===========================================================================
+
+   Статические таблицы частот для rANS
+
+   Частоты нормированы к 4096, у каждого байта не меньше 1, так что
+   кодируется любой поток. Запись декодера по слоту состояния:
+      биты 0..7   - символ
+      биты 8..19  - частота - 1
+      биты 20..31 - слот - начало символа
+
+===========================================================================
+*/
+struct ranstable_t
+{
+    uint16 m_Freq[256];
+    uint16 m_Start[256];
+    uint32 m_Decode[RANS_PROB_SCALE];
+
+    void Build(const uint32 *pCounts);
+};
+
+inline void ranstable_t::Build(const uint32 *pCounts)
+{
+    uint64 nTotal = 0;
+    for (int i = 0; i < 256; i++)
+        nTotal += pCounts[i];
+
+    int nSum = 0;
+    for (int i = 0; i < 256; i++)
+    {
+        uint64 nFreq = nTotal ? (uint64)pCounts[i] * RANS_PROB_SCALE / nTotal : 1;
+        m_Freq[i] = (uint16)Max<uint64>(nFreq, 1);
+        nSum += m_Freq[i];
+    }
+
+    // остаток от округления снимаем с самых частых символов или добавляем им
+    while (nSum != RANS_PROB_SCALE)
+    {
+        int iBest = 0;
+        for (int i = 1; i < 256; i++)
+        {
+            if (m_Freq[i] > m_Freq[iBest])
+                iBest = i;
+        }
+
+        int nDelta = Min(abs(RANS_PROB_SCALE - nSum), Max(m_Freq[iBest] / 16, 1));
+        if (nSum > RANS_PROB_SCALE)
+        {
+            nDelta = Min(nDelta, m_Freq[iBest] - 1);
+            m_Freq[iBest] -= nDelta;
+            nSum -= nDelta;
+        }
+        else
+        {
+            m_Freq[iBest] += nDelta;
+            nSum += nDelta;
+        }
+    }
+
+    uint32 iStart = 0;
+    for (int i = 0; i < 256; i++)
+    {
+        m_Start[i] = (uint16)iStart;
+        for (uint32 iSlot = iStart; iSlot < iStart + m_Freq[i]; iSlot++)
+            m_Decode[iSlot] = i | ((m_Freq[i] - 1) << 8) | ((iSlot - iStart) << 20);
+        iStart += m_Freq[i];
+    }
+}
+
+/*
+===========================================================================
+
+   RansTable - таблица по номеру из заголовка.
+
+   Таблица 0 строится из длин кодов статического Хаффмана: это та же
+   модель, что у MSG_WriteBits, но без округления до целого бита.
+   Таблицы 1..15 регистрирует приложение, например сгенерированные
+   по записи трафика. Регистрировать нужно до начала обмена, обе
+   стороны должны иметь одинаковые таблицы под одинаковыми номерами.
+
+===========================================================================
+*/
+struct ranstableregistry_t
+{
+    ranstable_t m_Default;
+    const ranstable_t *m_pTables[RANS_MAX_TABLES];
+
+    ranstableregistry_t()
+    {
+        uint32 counts[256];
+        const huffmantables_t *pHuffman = HuffmanTables();
+        for (int i = 0; i < 256; i++)
+            counts[i] = 1u << (HUFFMAN_MAX_CODE_BITS - pHuffman->m_Lengths[i]);
+
+        m_Default.Build(counts);
+        memset(m_pTables, 0, sizeof(m_pTables));
+        m_pTables[0] = &m_Default;
+    }
+};
+
+inline ranstableregistry_t *RansTableRegistry()
+{
+    static ranstableregistry_t s_Registry;
+    return &s_Registry;
+}
+
+inline const ranstable_t *RansTable(int iTable)
+{
+    if (iTable < 0 || iTable >= RANS_MAX_TABLES)
+        return NULL;
+    return RansTableRegistry()->m_pTables[iTable];
+}
+
+inline void RansRegisterTable(int iTable, const ranstable_t *pTable)
+{
+    if (iTable <= 0 || iTable >= RANS_MAX_TABLES)
+    {
+        common()->Error("RansRegisterTable: bad table %d", iTable);
+        return;
+    }
+    RansTableRegistry()->m_pTables[iTable] = pTable;
+}
+
+/*
+===========================================================================
+
+   RansEncode - сжать nCount байт. Два чередующихся состояния: чётные
+   символы идут через первое, нечётные через второе, что позволяет
+   декодеру считать их параллельно. Поток пишется с конца pOut и
+   затем сдвигается в начало.
+
+   Возвращает размер результата или -1, если он не влезает в nOutSize.
+
+===========================================================================
+*/
+inline bool Rans_EncodeSymbol(uint32 &x, ubyte *&pOut, ubyte *pBegin, const ranstable_t *pTable, int iSymbol)
+{
+    uint32 nFreq = pTable->m_Freq[iSymbol];
+    uint32 xMax = ((RANS_BYTE_L >> RANS_PROB_BITS) << 8) * nFreq;
+    while (x >= xMax)
+    {
+        if (pOut == pBegin)
+            return false;
+        *--pOut = (ubyte)x;
+        x >>= 8;
+    }
+    x = ((x / nFreq) << RANS_PROB_BITS) + (x % nFreq) + pTable->m_Start[iSymbol];
+    return true;
+}
+
+inline int RansEncode(ubyte *pOut, int nOutSize, const ubyte *pIn, int nCount, const ranstable_t *pTable)
+{
+    if (nOutSize < RANS_STATE_BYTES)
+        return -1;
+
+    ubyte *pBegin = pOut + RANS_STATE_BYTES;
+    ubyte *pCursor = pOut + nOutSize;
+    uint32 x[2] = {RANS_BYTE_L, RANS_BYTE_L};
+
+    for (int i = nCount - 1; i >= 0; i--)
+    {
+        if (!Rans_EncodeSymbol(x[i & 1], pCursor, pBegin, pTable, pIn[i]))
+            return -1;
+    }
+
+    int nStream = (int)(pOut + nOutSize - pCursor);
+    memcpy(pOut, &x[0], 4);
+    memcpy(pOut + 4, &x[1], 4);
+    memmove(pBegin, pCursor, nStream);
+    return RANS_STATE_BYTES + nStream;
+}
+
+/*
+===========================================================================
+
+   RansDecode - восстановить nCount байт. Возвращает false, если поток
+   кончился раньше времени или не сошлись конечные состояния.
+
+===========================================================================
+*/
+inline uint32 Rans_DecodeSymbol(uint32 &x, const ranstable_t *pTable)
+{
+    uint32 entry = pTable->m_Decode[x & (RANS_PROB_SCALE - 1)];
+    x = (((entry >> 8) & 0xFFF) + 1) * (x >> RANS_PROB_BITS) + (entry >> 20);
+    return entry & 0xFF;
+}
+
+inline bool Rans_Renormalize(uint32 &x, const ubyte *&pIn, const ubyte *pEnd)
+{
+    while (x < RANS_BYTE_L)
+    {
+        if (pIn == pEnd)
+            return false;
+        x = (x << 8) | *pIn++;
+    }
+    return true;
+}
+
+inline bool RansDecode(ubyte *pOut, int nCount, const ubyte *pIn, int nInSize, const ranstable_t *pTable)
+{
+    if (nInSize < RANS_STATE_BYTES)
+        return false;
+
+    uint32 x0, x1;
+    memcpy(&x0, pIn, 4);
+    memcpy(&x1, pIn + 4, 4);
+
+    const ubyte *pEnd = pIn + nInSize;
+    pIn += RANS_STATE_BYTES;
+
+    int i = 0;
+    for (; i + 1 < nCount; i += 2)
+    {
+        pOut[i] = (ubyte)Rans_DecodeSymbol(x0, pTable);
+        pOut[i + 1] = (ubyte)Rans_DecodeSymbol(x1, pTable);
+        if (!Rans_Renormalize(x0, pIn, pEnd) || !Rans_Renormalize(x1, pIn, pEnd))
+            return false;
+    }
+    if (i < nCount)
+    {
+        pOut[i] = (ubyte)Rans_DecodeSymbol(x0, pTable);
+        if (!Rans_Renormalize(x0, pIn, pEnd))
+            return false;
+    }
+
+    return x0 == RANS_BYTE_L && x1 == RANS_BYTE_L && pIn == pEnd;
+}
+
+/*
+===========================================================================
+
+   MSG_Compress/MSG_Decompress - сжатие сообщения с байта offset
+   способом, выбранным в msg->iCoder.
+
+   MSGCODER_HUFFMAN вызывает Huff_Compress/Huff_Decompress без
+   изменений формата. MSGCODER_RANS пишет байт заголовка:
+
+      0x00          - данные как есть, если сжатие не помогло
+      0x10 | таблица - rANS формата 1, дальше размер (2 байта) и поток
+
+   Неизвестный заголовок, чужая таблица или битый поток - MSG_Decompress
+   возвращает false, содержимое сообщения при этом не меняется.
+   Результат, не влезающий в nMaxsize, в обе стороны помечает
+   bOverflowed, а без bAllowOverflow это ошибка, как у MSG_WriteData.
+
+   MSG_CompressRans/MSG_DecompressRans - то же для MSGCODER_RANS без
+   обращений к common(), их можно звать из рабочих потоков. Размер и
+   таблицу проверяет вызывающий, false при выставленном bOverflowed -
+   результат не влез в сообщение.
+
+===========================================================================
+*/
+inline ubyte *MSG_CoderScratch()
+{
+    static thread_local ubyte s_Scratch[MSGCODER_MAX_SIZE + 16];
+    return s_Scratch;
+}
+
+inline bool MSG_CompressRans(msg_t *msg, int offset, const ranstable_t *pTable)
+{
+    int nSize = msg->nCursize - offset;
+    if (nSize <= 0)
+        return true;
+
+    ubyte *pData = msg->pData + offset;
+    ubyte *pScratch = MSG_CoderScratch();
+
+    // сжатое длиннее исходного не нужно: отдаём данные как есть
+    int nEncoded = RansEncode(pScratch + 3, nSize - 3, pData, nSize, pTable);
+    if (nEncoded < 0)
+    {
+        if (offset + nSize + 1 > msg->nMaxsize)
+        {
+            msg->bOverflowed = true;
+            return false;
+        }
+        memmove(pData + 1, pData, nSize);
+        pData[0] = MSGCODER_HEADER_STORED;
+        msg->nCursize = offset + nSize + 1;
+        return true;
+    }
+
+    pScratch[0] = (ubyte)(MSGCODER_HEADER_RANS | msg->iCoderTable);
+    pScratch[1] = (ubyte)nSize;
+    pScratch[2] = (ubyte)(nSize >> 8);
+    memcpy(pData, pScratch, nEncoded + 3);
+    msg->nCursize = offset + nEncoded + 3;
+    return true;
+}
+
+inline bool MSG_DecompressRans(msg_t *msg, int offset)
+{
+    int nSize = msg->nCursize - offset;
+    if (nSize <= 0)
+        return false;
+
+    ubyte *pData = msg->pData + offset;
+    if (pData[0] == MSGCODER_HEADER_STORED)
+    {
+        memmove(pData, pData + 1, nSize - 1);
+        msg->nCursize--;
+        return true;
+    }
+
+    const ranstable_t *pTable = RansTable(pData[0] & ~MSGCODER_HEADER_MASK);
+    if ((pData[0] & MSGCODER_HEADER_MASK) != MSGCODER_HEADER_RANS || !pTable || nSize < 3)
+        return false;
+
+    int nDecoded = pData[1] | (pData[2] << 8);
+    if (offset + nDecoded > msg->nMaxsize)
+    {
+        msg->bOverflowed = true;
+        return false;
+    }
+
+    ubyte *pScratch = MSG_CoderScratch();
+    if (!RansDecode(pScratch, nDecoded, pData + 3, nSize - 3, pTable))
+        return false;
+
+    memcpy(pData, pScratch, nDecoded);
+    msg->nCursize = offset + nDecoded;
+    return true;
+}
+
+inline void MSG_Compress(msg_t *msg, int offset)
+{
+    if (msg->iCoder != MSGCODER_RANS)
+    {
+        Huff_Compress(msg, offset);
+        return;
+    }
+
+    int nSize = msg->nCursize - offset;
+    if (nSize <= 0)
+        return;
+    if (nSize > MSGCODER_MAX_SIZE)
+    {
+        common()->Error("MSG_Compress: %d bytes", nSize);
+        return;
+    }
+
+    const ranstable_t *pTable = RansTable(msg->iCoderTable);
+    if (!pTable)
+    {
+        common()->Error("MSG_Compress: rANS table %d is not registered", msg->iCoderTable);
+        return;
+    }
+
+    if (!MSG_CompressRans(msg, offset, pTable) && !msg->bAllowOverflow)
+        common()->Error("MSG_Compress: can't write %d bytes", nSize + 1);
+}
+
+inline bool MSG_Decompress(msg_t *msg, int offset)
+{
+    if (msg->iCoder != MSGCODER_RANS)
+    {
+        Huff_Decompress(msg, offset);
+        return true;
+    }
+
+    bool bOverflowed = msg->bOverflowed;
+    if (MSG_DecompressRans(msg, offset))
+        return true;
+
+    if (msg->bOverflowed && !bOverflowed && !msg->bAllowOverflow)
+        common()->Error("MSG_Decompress: overflow");
+    return false;
+}
+
+#endif /* HAYATOLABS_RANS_H */
@@ -0,0 +1,528 @@
+/*
+  This file associated with Hayato Labs project.
+
+  For license and copyright information please follow this link:
+  https://github.com/hayatolabs/general/blob/main/LEGAL
+*/
+
+#ifndef HAYATOLABS_RESOURCECACHE_H
+#define HAYATOLABS_RESOURCECACHE_H
+
+#include "filesystem_public.h"
+#include "resourcefile.h"
+#include "string.h"
+
+#include <atomic>
+
+#if !defined(_WIN32)
+#include <unistd.h>
+#endif
+
+/*
+===========================================================================
+
+   Кеш разобранных файлов ресурсов
+
+   Для каждого исходника в IFileSystem::GameGetCacheDirectory() лежит
+   <хеш пути>.rfc с уже готовыми данными CResourceFile:
+
+      resourcecacheheader_t
+      resourcecacheblock_t[m_nBlocks]  - блоки: имя в таблице строк и диапазон пар
+      resourcecachepair_t[m_nPairs]    - пары с уже выведенными типами и числами,
+                                         сначала глобальные, потом блоков по порядку
+      resourceindexslot_t[m_nSlots]    - хеш-индекс CResourceFile
+      char[m_nStrings]                 - строки без повторов: путь к исходнику,
+                                         имена блоков, имена и значения переменных
+
+   Каждая часть выровнена на 8 байт. Кеш годен, если путь, размер и время
+   записи исходника совпадают. При другом времени, но том же размере
+   сравнивается хеш содержимого (копирование, checkout); если он прежний,
+   в кеше обновляется только время.
+
+   Пара в кеше занимает 16 байт вместо 140 у ScriptVariablePair_t: имя
+   и значение - ссылки в таблицу строк, где одинаковые строки хранятся
+   один раз. При загрузке пары собираются обратно без разбора текста.
+
+===========================================================================
+*/
+#define RESOURCECACHE_MAGIC (('R') | ('F' << 8) | ('C' << 16) | ('1' << 24))
+#define RESOURCECACHE_VERSION 1
+#define RESOURCECACHE_EXTENSION ".rfc"
+
+struct resourcecacheheader_t
+{
+    uint32 m_iMagic;
+    uint32 m_iVersion;
+    uint32 m_nSlotSize; // sizeof(resourceindexslot_t) сборки, записавшей кеш
+    uint32 m_nReserved;
+
+    uint64 m_nSourceSize;
+    uint64 m_iSourceTime;
+    resourcehash_t m_iSourceHash;
+
+    uint32 m_nPath; // путь к исходнику - первые m_nPath байт таблицы строк
+    uint32 m_nGlobals;
+    uint32 m_nBlocks;
+    uint32 m_nPairs;
+    uint32 m_nSlots;
+    uint32 m_nStrings;
+};
+
+struct resourcecacheblock_t
+{
+    uint32 m_iName; // смещение в таблице строк
+    uint32 m_nName;
+    uint32 m_iFirstPair;
+    uint32 m_nPairs;
+};
+
+struct resourcecachepair_t
+{
+    uint32 m_iName;  // смещения в таблице строк
+    uint32 m_iValue;
+    ubyte m_nName;   // не больше размера массивов ScriptVariablePair_t
+    ubyte m_nValue;
+    ubyte m_iType;   // VariableType_t
+    ubyte m_bValue;  // значение bool, уже разобранное
+    int32 m_iNumber; // значение int32 и uint16, уже разобранное
+};
+
+// смещения частей файла кеша, считаются по числам из заголовка
+struct resourcecachelayout_t
+{
+    uint64 m_iBlocks;
+    uint64 m_iPairs;
+    uint64 m_iSlots;
+    uint64 m_iStrings;
+    uint64 m_nSize;
+
+    explicit resourcecachelayout_t(const resourcecacheheader_t &header)
+    {
+        m_iBlocks = Align(sizeof(resourcecacheheader_t));
+        m_iPairs = Align(m_iBlocks + (uint64)header.m_nBlocks * sizeof(resourcecacheblock_t));
+        m_iSlots = Align(m_iPairs + (uint64)header.m_nPairs * sizeof(resourcecachepair_t));
+        m_iStrings = Align(m_iSlots + (uint64)header.m_nSlots * sizeof(resourceindexslot_t));
+        m_nSize = m_iStrings + header.m_nStrings;
+    }
+
+    static uint64 Align(uint64 iOffset)
+    {
+        return (iOffset + 7) & ~7ull;
+    }
+};
+
+/*
+===========================================================================
+
+   CResourceCache
+
+   Всё, что Load берёт у filesystem() и common(), лежит в
+   resourcecacheenv_t. Load без него заполняет его сам, а загрузчик с
+   потоками - один раз на своём потоке, и рабочие потоки к
+   filesystem() и common() не обращаются.
+
+===========================================================================
+*/
+struct resourcecacheenv_t
+{
+    Path_t m_CacheDirectory; // со слешем в конце, пустой - без кеша
+    bool m_bCreateDirectory; // создать каталог, если кеш не записался
+    CResourceLog *m_pLog;    // NULL - сообщения сразу в common()
+};
+
+class CResourceCache
+{
+  public:
+    // Содержимое file заменяется: из свежего кеша без разбора, иначе
+    // разбором исходника с записью нового кеша. Без каталога кеша
+    // просто разбирает файл.
+    static bool Load(CResourceFile &file, const char *pszFilepath)
+    {
+        return Load(file, pszFilepath, DefaultEnv());
+    }
+    static bool Load(CResourceFile &file, const char *pszFilepath, const resourcecacheenv_t &env);
+
+    // каталог кеша из filesystem(), сообщения в common()
+    static resourcecacheenv_t DefaultEnv();
+
+    // пустой путь, если каталог кеша не задан
+    static Path_t CachePath(const char *pszFilepath)
+    {
+        return CachePath(pszFilepath, DefaultEnv().m_CacheDirectory);
+    }
+    static Path_t CachePath(const char *pszFilepath, const Path_t &cacheDirectory);
+
+    static bool Write(CResourceFile &file, const char *pszFilepath, uint64 nSourceSize, uint64 iSourceTime,
+                      resourcehash_t iSourceHash, const Path_t &cachePath,
+                      const resourcecacheenv_t &env = DefaultEnv());
+
+  private:
+    static const resourcecacheheader_t *Validate(const filemapping_t &cache, std::string_view filepath);
+    static void Adopt(CResourceFile &file, const filemapping_t &cache);
+    static void Touch(const Path_t &cachePath, uint64 iSourceTime);
+};
+
+inline resourcecacheenv_t CResourceCache::DefaultEnv()
+{
+    resourcecacheenv_t env;
+    env.m_CacheDirectory = filesystem()->GameGetCacheDirectory();
+    env.m_bCreateDirectory = true;
+    env.m_pLog = NULL;
+
+    char slash = filesystem()->GetSlash();
+    if (!env.m_CacheDirectory.empty() && env.m_CacheDirectory.back() != slash && env.m_CacheDirectory.back() != '/')
+        env.m_CacheDirectory += slash;
+    return env;
+}
+
+inline Path_t CResourceCache::CachePath(const char *pszFilepath, const Path_t &cacheDirectory)
+{
+    if (cacheDirectory.empty())
+        return cacheDirectory;
+
+    char szName[32];
+    snprintf(szName, sizeof(szName), "%016llx" RESOURCECACHE_EXTENSION,
+             (unsigned long long)ResourceHash(pszFilepath));
+    return cacheDirectory + szName;
+}
+
+inline bool CResourceCache::Load(CResourceFile &file, const char *pszFilepath, const resourcecacheenv_t &env)
+{
+    file.m_bValidated = false;
+    file.m_GlobalPairs.clear();
+    file.m_Blocks.clear();
+
+    uint64 nSourceSize, iSourceTime;
+    if (!FileQueryInfo(pszFilepath, nSourceSize, iSourceTime))
+    {
+        ResourceLog(env.m_pLog, RESOURCELOG_WARNING, "Failed to open file '%s'", pszFilepath);
+        return false;
+    }
+
+    Path_t cachePath = CachePath(pszFilepath, env.m_CacheDirectory);
+    filemapping_t source = {};
+    filemapping_t cache;
+
+    if (!cachePath.empty() && cache.Open(cachePath.c_str()))
+    {
+        const resourcecacheheader_t *pHeader = Validate(cache, pszFilepath);
+        bool bFresh = pHeader && pHeader->m_nSourceSize == nSourceSize && pHeader->m_iSourceTime == iSourceTime;
+        bool bTouch = false;
+
+        if (pHeader && !bFresh && pHeader->m_nSourceSize == nSourceSize && source.Open(pszFilepath))
+        {
+            bFresh = ResourceHash(std::string_view(source.m_pData, source.m_nSize)) == pHeader->m_iSourceHash;
+            bTouch = bFresh;
+        }
+
+        if (bFresh)
+        {
+            Adopt(file, cache);
+            cache.Close();
+            source.Close();
+            if (bTouch)
+                Touch(cachePath, iSourceTime);
+
+            ResourceLog(env.m_pLog, RESOURCELOG_PRINT, "Loaded %d global vars and %d m_Blocks",
+                        (int)file.m_GlobalPairs.size(), (int)file.m_Blocks.size());
+            return true;
+        }
+        cache.Close();
+    }
+
+    if (!source.IsOpen() && !source.Open(pszFilepath))
+    {
+        ResourceLog(env.m_pLog, RESOURCELOG_WARNING, "Failed to map file '%s'", pszFilepath);
+        return false;
+    }
+
+    bool bResult = file.CreateFromMemory(source.m_pData, source.m_nSize, env.m_pLog);
+    if (bResult && !cachePath.empty())
+    {
+        resourcehash_t iSourceHash = ResourceHash(std::string_view(source.m_pData, source.m_nSize));
+        Write(file, pszFilepath, nSourceSize, iSourceTime, iSourceHash, cachePath, env);
+    }
+    source.Close();
+    return bResult;
+}
+
+inline const resourcecacheheader_t *CResourceCache::Validate(const filemapping_t &cache, std::string_view filepath)
+{
+    if (cache.m_nSize < sizeof(resourcecacheheader_t))
+        return NULL;
+
+    const resourcecacheheader_t *pHeader = (const resourcecacheheader_t *)cache.m_pData;
+    if (pHeader->m_iMagic != RESOURCECACHE_MAGIC || pHeader->m_iVersion != RESOURCECACHE_VERSION ||
+        pHeader->m_nSlotSize != sizeof(resourceindexslot_t))
+        return NULL;
+
+    resourcecachelayout_t layout(*pHeader);
+    if (layout.m_nSize != cache.m_nSize || pHeader->m_nGlobals > pHeader->m_nPairs ||
+        pHeader->m_nPath > pHeader->m_nStrings)
+        return NULL;
+
+    // хеш пути в имени файла может совпасть у разных путей
+    const char *pStrings = cache.m_pData + layout.m_iStrings;
+    if (std::string_view(pStrings, pHeader->m_nPath) != filepath)
+        return NULL;
+
+    // дальше проверяется всё, по чему Adopt пойдёт без проверок
+    const resourcecacheblock_t *pBlocks = (const resourcecacheblock_t *)(cache.m_pData + layout.m_iBlocks);
+    for (uint32 i = 0; i < pHeader->m_nBlocks; i++)
+    {
+        const resourcecacheblock_t &block = pBlocks[i];
+        if ((uint64)block.m_iName + block.m_nName > pHeader->m_nStrings || block.m_iFirstPair < pHeader->m_nGlobals ||
+            (uint64)block.m_iFirstPair + block.m_nPairs > pHeader->m_nPairs)
+            return NULL;
+    }
+
+    const resourcecachepair_t *pPairs = (const resourcecachepair_t *)(cache.m_pData + layout.m_iPairs);
+    for (uint32 i = 0; i < pHeader->m_nPairs; i++)
+    {
+        const resourcecachepair_t &pair = pPairs[i];
+        if (pair.m_nName > sizeof(ScriptVariablePair_t::m_strValue) ||
+            pair.m_nValue > sizeof(ScriptDeclaredVariable_t::m_strValue) || pair.m_iType > VARTYPE_INVALID ||
+            (uint64)pair.m_iName + pair.m_nName > pHeader->m_nStrings ||
+            (uint64)pair.m_iValue + pair.m_nValue > pHeader->m_nStrings)
+            return NULL;
+    }
+
+    uint32 nSlots = pHeader->m_nSlots;
+    if (nSlots < 16 || (nSlots & (nSlots - 1)))
+        return NULL;
+
+    const resourceindexslot_t *pSlots = (const resourceindexslot_t *)(cache.m_pData + layout.m_iSlots);
+    for (uint32 i = 0; i < nSlots; i++)
+    {
+        const resourceindexslot_t &slot = pSlots[i];
+        if (slot.m_iItem < 0)
+            continue;
+
+        uint32 nItems;
+        if (slot.m_iScope == RESOURCEINDEX_BLOCKS)
+            nItems = pHeader->m_nBlocks;
+        else if (slot.m_iScope == RESOURCEINDEX_GLOBALS)
+            nItems = pHeader->m_nGlobals;
+        else if (slot.m_iScope >= 0 && (uint32)slot.m_iScope < pHeader->m_nBlocks)
+            nItems = pBlocks[slot.m_iScope].m_nPairs;
+        else
+            return NULL;
+
+        if ((uint32)slot.m_iItem >= nItems)
+            return NULL;
+    }
+
+    return pHeader;
+}
+
+inline void CResourceCache::Adopt(CResourceFile &file, const filemapping_t &cache)
+{
+    const resourcecacheheader_t *pHeader = (const resourcecacheheader_t *)cache.m_pData;
+    resourcecachelayout_t layout(*pHeader);
+
+    const resourcecacheblock_t *pBlocks = (const resourcecacheblock_t *)(cache.m_pData + layout.m_iBlocks);
+    const resourcecachepair_t *pPairs = (const resourcecachepair_t *)(cache.m_pData + layout.m_iPairs);
+    const resourceindexslot_t *pSlots = (const resourceindexslot_t *)(cache.m_pData + layout.m_iSlots);
+    const char *pStrings = cache.m_pData + layout.m_iStrings;
+
+    // пары собираются на месте, без конструктора ScriptVariablePair_t
+    auto Unpack = [&](std::vector<ScriptVariablePair_t> &pairs, uint32 iFirst, uint32 nPairs) {
+        pairs.resize(nPairs, ScriptVariablePair_t("", "", VARTYPE_INVALID));
+        for (uint32 i = 0; i < nPairs; i++)
+        {
+            const resourcecachepair_t &packed = pPairs[iFirst + i];
+            ScriptVariablePair_t &pair = pairs[i];
+            memset((void *)&pair, 0, sizeof(pair));
+            memcpy(pair.m_strValue, pStrings + packed.m_iName, packed.m_nName);
+            memcpy(pair.m_sdvVar.m_strValue, pStrings + packed.m_iValue, packed.m_nValue);
+            pair.m_sdvVar.m_bValue = packed.m_bValue != 0;
+            pair.m_sdvVar.m_iValue = packed.m_iNumber;
+            pair.m_sdvVar.m_iValueType = (VariableType_t)packed.m_iType;
+        }
+    };
+
+    Unpack(file.m_GlobalPairs, 0, pHeader->m_nGlobals);
+    file.m_Blocks.resize(pHeader->m_nBlocks);
+    for (uint32 i = 0; i < pHeader->m_nBlocks; i++)
+    {
+        const resourcecacheblock_t &block = pBlocks[i];
+        file.m_Blocks[i].m_pszNametag.assign(pStrings + block.m_iName, block.m_nName);
+        Unpack(file.m_Blocks[i].m_Pairs, block.m_iFirstPair, block.m_nPairs);
+    }
+
+    file.m_Index.Assign(pSlots, pHeader->m_nSlots, file.m_Blocks, file.m_GlobalPairs);
+    file.m_bValidated = true;
+}
+
+inline void CResourceCache::Touch(const Path_t &cachePath, uint64 iSourceTime)
+{
+    FILE *f = fopen(cachePath.c_str(), "r+b");
+    if (!f)
+        return;
+    if (fseek(f, offsetof(resourcecacheheader_t, m_iSourceTime), SEEK_SET) == 0)
+        fwrite(&iSourceTime, sizeof(iSourceTime), 1, f);
+    fclose(f);
+}
+
+/*
+===========================================================================
+
+   Запись идёт во временный файл рядом с кешем и заменяет кеш
+   переименованием, так что читатель не увидит его недописанным.
+
+===========================================================================
+*/
+inline bool CResourceCache::Write(CResourceFile &file, const char *pszFilepath, uint64 nSourceSize,
+                                  uint64 iSourceTime, resourcehash_t iSourceHash, const Path_t &cachePath,
+                                  const resourcecacheenv_t &env)
+{
+    file.UpdateIndex();
+
+    size_t nPairs = file.m_GlobalPairs.size();
+    for (size_t i = 0; i < file.m_Blocks.size(); i++)
+        nPairs += file.m_Blocks[i].m_Pairs.size();
+
+    // таблица строк: путь, затем остальные строки без повторов; повтор
+    // ищется открытой адресацией по хешу, в слоте смещение и длина
+    struct internslot_t
+    {
+        resourcehash_t m_iHash;
+        uint32 m_iOffset;
+        uint32 m_nLength; // 0 - пустой слот, пустые строки не хранятся
+    };
+
+    size_t nInternSlots = 16;
+    while (nInternSlots < (nPairs * 2 + file.m_Blocks.size()) * 2)
+        nInternSlots <<= 1;
+    std::vector<internslot_t> interned(nInternSlots);
+    memset(interned.data(), 0, nInternSlots * sizeof(internslot_t));
+
+    std::string strings(pszFilepath);
+    auto Intern = [&](std::string_view text) -> uint32 {
+        if (text.empty())
+            return 0;
+
+        resourcehash_t iHash = ResourceHash(text);
+        for (size_t i = iHash & (nInternSlots - 1);; i = (i + 1) & (nInternSlots - 1))
+        {
+            internslot_t &slot = interned[i];
+            if (!slot.m_nLength)
+            {
+                slot.m_iHash = iHash;
+                slot.m_iOffset = (uint32)strings.size();
+                slot.m_nLength = (uint32)text.size();
+                strings += text;
+                return slot.m_iOffset;
+            }
+            if (slot.m_iHash == iHash && std::string_view(strings.data() + slot.m_iOffset, slot.m_nLength) == text)
+                return slot.m_iOffset;
+        }
+    };
+
+    std::vector<resourcecachepair_t> pairs;
+    pairs.reserve(nPairs);
+    auto Pack = [&](const std::vector<ScriptVariablePair_t> &source) {
+        for (size_t i = 0; i < source.size(); i++)
+        {
+            const ScriptDeclaredVariable_t &var = source[i].m_sdvVar;
+            std::string_view name = ResourceVariableName(source[i]);
+            std::string_view value(var.m_strValue, strnlen(var.m_strValue, sizeof(var.m_strValue)));
+
+            // числа и bool разбираются здесь, как их разобрал бы ConvertValue
+            char szValue[sizeof(var.m_strValue) + 1];
+            memcpy(szValue, value.data(), value.size());
+            szValue[value.size()] = 0;
+
+            resourcecachepair_t packed;
+            packed.m_iName = Intern(name);
+            packed.m_iValue = Intern(value);
+            packed.m_nName = (ubyte)name.size();
+            packed.m_nValue = (ubyte)value.size();
+            packed.m_iType = (ubyte)var.m_iValueType;
+            packed.m_bValue = var.m_iValueType == VARTYPE_BOOLEAN && ResourceBooleanValue(szValue);
+            packed.m_iNumber = (var.m_iValueType == VARTYPE_INT32 || var.m_iValueType == VARTYPE_UINT16)
+                                   ? atoi(szValue)
+                                   : 0;
+            pairs.push_back(packed);
+        }
+    };
+
+    std::vector<resourcecacheblock_t> blocks(file.m_Blocks.size());
+    Pack(file.m_GlobalPairs);
+    for (size_t i = 0; i < file.m_Blocks.size(); i++)
+    {
+        const ScriptBlock_t &block = file.m_Blocks[i];
+        blocks[i].m_iName = Intern(block.m_pszNametag);
+        blocks[i].m_nName = (uint32)block.m_pszNametag.size();
+        blocks[i].m_iFirstPair = (uint32)pairs.size();
+        blocks[i].m_nPairs = (uint32)block.m_Pairs.size();
+        Pack(block.m_Pairs);
+    }
+
+    const std::vector<resourceindexslot_t> &slots = file.m_Index.GetSlots();
+
+    resourcecacheheader_t header;
+    memset(&header, 0, sizeof(header));
+    header.m_iMagic = RESOURCECACHE_MAGIC;
+    header.m_iVersion = RESOURCECACHE_VERSION;
+    header.m_nSlotSize = sizeof(resourceindexslot_t);
+    header.m_nSourceSize = nSourceSize;
+    header.m_iSourceTime = iSourceTime;
+    header.m_iSourceHash = iSourceHash;
+    header.m_nPath = (uint32)strlen(pszFilepath);
+    header.m_nGlobals = (uint32)file.m_GlobalPairs.size();
+    header.m_nBlocks = (uint32)blocks.size();
+    header.m_nPairs = (uint32)pairs.size();
+    header.m_nSlots = (uint32)slots.size();
+    header.m_nStrings = (uint32)strings.size();
+
+    static std::atomic<uint32> s_iTemporary(0);
+#if defined(_WIN32)
+    uint32 iProcess = (uint32)GetCurrentProcessId();
+#else
+    uint32 iProcess = (uint32)getpid();
+#endif
+    char szSuffix[32];
+    snprintf(szSuffix, sizeof(szSuffix), ".%u.%u.tmp", iProcess, s_iTemporary.fetch_add(1));
+    Path_t temporaryPath = cachePath + szSuffix;
+
+    FILE *f = fopen(temporaryPath.c_str(), "wb");
+    if (!f && env.m_bCreateDirectory)
+    {
+        // каталога кеша может ещё не быть
+        filesystem()->DirectoryCreate(filesystem()->PathStripFilename(cachePath));
+        f = fopen(temporaryPath.c_str(), "wb");
+    }
+    if (!f)
+        return false;
+
+    resourcecachelayout_t layout(header);
+    static const ubyte s_Padding[8] = {0};
+    uint64 iOffset = 0;
+    auto Put = [&](uint64 iAt, const void *pData, size_t nSize) {
+        size_t nPadding = (size_t)(iAt - iOffset);
+        iOffset = iAt + nSize;
+        return fwrite(s_Padding, 1, nPadding, f) == nPadding && (!nSize || fwrite(pData, nSize, 1, f) == 1);
+    };
+
+    bool bOk = Put(0, &header, sizeof(header)) &&
+               Put(layout.m_iBlocks, blocks.data(), blocks.size() * sizeof(resourcecacheblock_t)) &&
+               Put(layout.m_iPairs, pairs.data(), pairs.size() * sizeof(resourcecachepair_t)) &&
+               Put(layout.m_iSlots, slots.data(), slots.size() * sizeof(resourceindexslot_t)) &&
+               Put(layout.m_iStrings, strings.data(), strings.size());
+    bOk = fclose(f) == 0 && bOk;
+
+#if defined(_WIN32)
+    bOk = bOk && MoveFileExA(temporaryPath.c_str(), cachePath.c_str(), MOVEFILE_REPLACE_EXISTING);
+#else
+    bOk = bOk && rename(temporaryPath.c_str(), cachePath.c_str()) == 0;
+#endif
+    if (!bOk)
+    {
+        remove(temporaryPath.c_str());
+        ResourceLog(env.m_pLog, RESOURCELOG_WARNING, "Failed to write resource cache '%s'", cachePath.c_str());
+    }
+    return bOk;
+}
+
+#endif /* HAYATOLABS_RESOURCECACHE_H */
@@ -8,7 +8,16 @@
 #ifndef NFCXX_RESOURCEFILE_HPP
 #define NFCXX_RESOURCEFILE_HPP
 
+#include "filemapping.h"
 #include "public.h"
+#include "string.h"
+
+#include <string_view>
+
+#if defined(__SSE2__) || defined(_M_X64) || defined(_M_AMD64)
+#include <emmintrin.h>
+#define RESOURCE_SCAN_SSE2
+#endif
 
 enum VariableType_t
 {
@@ -48,9 +57,296 @@ struct ScriptBlock_t
     std::vector<ScriptVariablePair_t> m_Pairs; // Переменные
     ScriptDeclaredVariable_t *Search(std::string pszNametag, VariableType_t iValueType = VARTYPE_STRING,
                                      std::string strDefaultValue = "");
+    // без выделения памяти, но перебором; по индексу ищет CResourceFile::Search.
+    // При промахе - значение по умолчанию до следующего промаха в потоке
+    ScriptDeclaredVariable_t *Search(std::string_view name, VariableType_t iValueType = VARTYPE_STRING,
+                                     std::string_view defaultValue = "");
+    ScriptDeclaredVariable_t *Search(const char *pszName, VariableType_t iValueType = VARTYPE_STRING,
+                                     const char *pszDefaultValue = "")
+    {
+        return Search(std::string_view(pszName), iValueType, std::string_view(pszDefaultValue));
+    }
     ScriptBlock_t() = default;
 };
 
+/*
+===========================================================================
+
+   Хеш-индекс CResourceFile
+
+   ResourceHash - FNV-1a имени, считается и во время компиляции:
+
+      static constexpr resourcehash_t s_hWeapon = ResourceHash("weapon");
+      static constexpr resourcehash_t s_hDamage = ResourceHash("damage");
+      pFile->Search(s_hWeapon, "weapon", s_hDamage, "damage", VARTYPE_INT32);
+
+   Одна таблица с открытой адресацией на блоки, глобальные переменные
+   и переменные блоков; ключ - хеш и область (номер блока). Совпадение
+   хеша проверяется сравнением имени, из повторяющихся имён находится
+   первое, как и при переборе.
+
+===========================================================================
+*/
+typedef uint64 resourcehash_t;
+
+#define RESOURCEINDEX_BLOCKS -2  // область имён блоков
+#define RESOURCEINDEX_GLOBALS -1 // область глобальных переменных
+
+constexpr resourcehash_t ResourceHash(std::string_view name)
+{
+    resourcehash_t iHash = 0xCBF29CE484222325ull;
+    for (size_t i = 0; i < name.size(); i++)
+    {
+        iHash ^= (ubyte)name[i];
+        iHash *= 0x100000001B3ull;
+    }
+    return iHash;
+}
+
+// имя переменной лежит в массиве на 64 байта и может быть не закрыто нулём
+inline std::string_view ResourceVariableName(const ScriptVariablePair_t &pair)
+{
+    return std::string_view(pair.m_strValue, strnlen(pair.m_strValue, sizeof(pair.m_strValue)));
+}
+
+struct resourceindexslot_t
+{
+    resourcehash_t m_iHash;
+    int32 m_iScope;
+    int32 m_iItem; // -1 - пустой слот
+};
+
+class CResourceIndex
+{
+  public:
+    CResourceIndex() : m_nMask(0), m_pBlocks(NULL), m_nBlocks(0), m_pGlobals(NULL), m_nGlobals(0)
+    {
+    }
+
+    void Build(const std::vector<ScriptBlock_t> &blocks, const std::vector<ScriptVariablePair_t> &globals);
+    void Clear();
+    // индекс построен для этих векторов и числа элементов в них не менялись
+    bool IsBuiltFor(const std::vector<ScriptBlock_t> &blocks, const std::vector<ScriptVariablePair_t> &globals) const
+    {
+        return !m_Slots.empty() && m_pBlocks == blocks.data() && m_nBlocks == blocks.size() &&
+               m_pGlobals == globals.data() && m_nGlobals == globals.size();
+    }
+
+    // номер первого элемента области с этим хешем, для которого match(номер) истинно, или -1
+    template <typename Match> int Find(int iScope, resourcehash_t iHash, Match match) const;
+
+    // готовая таблица, например из кеша (см. CResourceCache); nSlots - степень двойки
+    void Assign(const resourceindexslot_t *pSlots, size_t nSlots, const std::vector<ScriptBlock_t> &blocks,
+                const std::vector<ScriptVariablePair_t> &globals);
+    const std::vector<resourceindexslot_t> &GetSlots() const
+    {
+        return m_Slots;
+    }
+
+  private:
+    std::vector<resourceindexslot_t> m_Slots;
+    uint32 m_nMask;
+
+    const ScriptBlock_t *m_pBlocks;
+    size_t m_nBlocks;
+    const ScriptVariablePair_t *m_pGlobals;
+    size_t m_nGlobals;
+
+    static uint32 Slot(int iScope, resourcehash_t iHash)
+    {
+        uint64 iKey = iHash ^ ((uint64)(uint32)iScope * 0x9E3779B97F4A7C15ull);
+        return (uint32)(iKey ^ (iKey >> 29));
+    }
+    void Insert(int iScope, resourcehash_t iHash, int iItem);
+};
+
+/*
+===========================================================================
+
+   CResourceScanner - поиск '\n' и '"' в тексте файла ресурсов.
+
+   Маска этих байт считается сразу на 64 байта (с SSE2 - по 16 за
+   сравнение), дальше разбор только снимает с неё биты, так что каждый
+   байт файла просматривается один раз. Позиции, с которых ищет Next,
+   не должны убывать.
+
+===========================================================================
+*/
+class CResourceScanner
+{
+  public:
+    CResourceScanner(const char *pData, size_t nSize) : m_pData(pData), m_nSize(nSize), m_nBlock(0)
+    {
+        m_iMask = BlockMask(0);
+    }
+
+    // первый '\n' или '"' не раньше nPos, или размер буфера
+    size_t Next(size_t nPos)
+    {
+        while (nPos < m_nSize)
+        {
+            if (nPos - m_nBlock >= 64)
+            {
+                m_nBlock = nPos & ~(size_t)63;
+                m_iMask = BlockMask(m_nBlock);
+            }
+
+            uint64 iMask = m_iMask & (~0ull << (nPos - m_nBlock));
+            if (iMask)
+                return m_nBlock + LowestSetBit(iMask);
+            nPos = m_nBlock + 64;
+        }
+        return m_nSize;
+    }
+
+  private:
+    const char *m_pData;
+    size_t m_nSize;
+    size_t m_nBlock; // начало 64 байт, для которых посчитана m_iMask
+    uint64 m_iMask;
+
+    uint64 BlockMask(size_t nBlock) const;
+};
+
+inline uint64 CResourceScanner::BlockMask(size_t nBlock) const
+{
+    const char *p = m_pData + nBlock;
+    uint64 iMask = 0;
+
+#if defined(RESOURCE_SCAN_SSE2)
+    if (nBlock + 64 <= m_nSize)
+    {
+        const __m128i newline = _mm_set1_epi8('\n');
+        const __m128i quote = _mm_set1_epi8('"');
+        for (int i = 0; i < 4; i++)
+        {
+            __m128i chunk = _mm_loadu_si128((const __m128i *)(p + i * 16));
+            __m128i hits = _mm_or_si128(_mm_cmpeq_epi8(chunk, newline), _mm_cmpeq_epi8(chunk, quote));
+            iMask |= (uint64)(uint32)_mm_movemask_epi8(hits) << (i * 16);
+        }
+        return iMask;
+    }
+#endif
+
+    size_t nCount = Min(m_nSize - nBlock, (size_t)64);
+    for (size_t i = 0; i < nCount; i++)
+    {
+        if (p[i] == '\n' || p[i] == '"')
+            iMask |= 1ull << i;
+    }
+    return iMask;
+}
+
+// строка файла без перевода строки и начальных пробелов
+struct resourceline_t
+{
+    const char *m_pStart;
+    const char *m_pEnd;
+    const char *m_pQuotes[4]; // первые кавычки строки
+    int m_nQuotes;            // всего кавычек
+};
+
+// слово типа перед именем переменной; int64 библиотека тоже хранит как int32
+inline VariableType_t ResourceVariableType(std::string_view name)
+{
+    if (name == "bool")
+        return VARTYPE_BOOLEAN;
+    if (name == "string")
+        return VARTYPE_STRING;
+    if (name == "int32" || name == "int64")
+        return VARTYPE_INT32;
+    if (name == "uint16")
+        return VARTYPE_UINT16;
+    return VARTYPE_INVALID;
+}
+
+// истинность значения bool так, как её определяет ConvertValue<bool>
+inline bool ResourceBooleanValue(const char *pszValue)
+{
+    return !CStringTools::icmp(pszValue, "true") || !CStringTools::icmp(pszValue, "1") ||
+           !CStringTools::icmp(pszValue, "yes");
+}
+
+/*
+===========================================================================
+
+   CResourceLog - сообщения разбора и загрузки ресурсов.
+
+   Функции разбора принимают CResourceLog *pLog: без журнала сообщения
+   сразу уходят в common(), с журналом копятся и выводятся Flush на
+   том потоке, который его завёл. Так рабочие потоки загрузки не
+   обращаются к common().
+
+===========================================================================
+*/
+enum resourceloglevel_t
+{
+    RESOURCELOG_PRINT,
+    RESOURCELOG_WARNING,
+    RESOURCELOG_ERROR,
+};
+
+class CResourceLog
+{
+  public:
+    void Add(resourceloglevel_t iLevel, const char *pszText)
+    {
+        m_Messages.push_back({iLevel, pszText});
+    }
+    void Flush(); // вывести накопленное через common() и очистить
+
+    bool IsEmpty() const
+    {
+        return m_Messages.empty();
+    }
+
+  private:
+    struct message_t
+    {
+        resourceloglevel_t m_iLevel;
+        std::string m_Text;
+    };
+
+    std::vector<message_t> m_Messages;
+};
+
+inline void ResourceLogOutput(resourceloglevel_t iLevel, const char *pszText)
+{
+    switch (iLevel)
+    {
+    case RESOURCELOG_PRINT:
+        common()->Print("%s", pszText);
+        break;
+    case RESOURCELOG_WARNING:
+        common()->Warning("%s", pszText);
+        break;
+    default:
+        common()->Error("%s", pszText);
+        break;
+    }
+}
+
+inline void CResourceLog::Flush()
+{
+    for (size_t i = 0; i < m_Messages.size(); i++)
+        ResourceLogOutput(m_Messages[i].m_iLevel, m_Messages[i].m_Text.c_str());
+    m_Messages.clear();
+}
+
+inline void ResourceLog(CResourceLog *pLog, resourceloglevel_t iLevel, const char *pszFormat, ...)
+{
+    char szText[1024];
+    va_list args;
+    va_start(args, pszFormat);
+    vsnprintf(szText, sizeof(szText), pszFormat, args);
+    va_end(args);
+
+    if (pLog)
+        pLog->Add(iLevel, szText);
+    else
+        ResourceLogOutput(iLevel, szText);
+}
+
 /*
 ===========================================================================
 
@@ -66,6 +362,11 @@ class CResourceFile
     std::vector<ScriptBlock_t> m_Blocks;             // Блоки данных
 
     bool CreateFromFile(std::string filepath);
+    // Без построчного чтения: файл отображается в память и разбирается
+    // за один проход, имена и значения берутся прямо из отображения.
+    // Как и CreateFromFile, добавляет к уже загруженному.
+    bool CreateFromMappedFile(const char *pszFilepath);
+    bool CreateFromMemory(const char *pData, size_t nSize, CResourceLog *pLog = NULL);
     void Destroy();
     ScriptBlock_t *SearchBlock(std::string strBlockNametag);
     ScriptDeclaredVariable_t *Search(std::string strBlockNametag, std::string strVariableNametag,
@@ -73,10 +374,435 @@ class CResourceFile
     ScriptDeclaredVariable_t *Search(std::string strVariableNametag, VariableType_t iValueType = VARTYPE_STRING,
                                      std::string strDefaultValue = "");
 
+    // Поиск по индексу. Вызовы со строковыми литералами попадают сюда,
+    // с std::string - в старые функции с перебором. При промахе
+    // возвращается значение по умолчанию из ResourceDefaultVariable:
+    // оно живёт только до следующего промаха в этом потоке, поэтому
+    // нужное из него копируется сразу.
+    void BuildIndex();
+    ScriptBlock_t *SearchBlock(resourcehash_t iBlockHash, std::string_view blockName);
+    ScriptBlock_t *SearchBlock(std::string_view blockName)
+    {
+        return SearchBlock(ResourceHash(blockName), blockName);
+    }
+    ScriptBlock_t *SearchBlock(const char *pszBlockName)
+    {
+        return SearchBlock(std::string_view(pszBlockName));
+    }
+
+    ScriptDeclaredVariable_t *Search(resourcehash_t iBlockHash, std::string_view blockName,
+                                     resourcehash_t iVariableHash, std::string_view variableName,
+                                     VariableType_t iValueType = VARTYPE_STRING, std::string_view defaultValue = "");
+    ScriptDeclaredVariable_t *Search(std::string_view blockName, std::string_view variableName,
+                                     VariableType_t iValueType = VARTYPE_STRING, std::string_view defaultValue = "")
+    {
+        return Search(ResourceHash(blockName), blockName, ResourceHash(variableName), variableName, iValueType,
+                      defaultValue);
+    }
+    ScriptDeclaredVariable_t *Search(const char *pszBlockName, const char *pszVariableName,
+                                     VariableType_t iValueType = VARTYPE_STRING, const char *pszDefaultValue = "")
+    {
+        return Search(std::string_view(pszBlockName), std::string_view(pszVariableName), iValueType,
+                      std::string_view(pszDefaultValue));
+    }
+
+    ScriptDeclaredVariable_t *Search(resourcehash_t iVariableHash, std::string_view variableName,
+                                     VariableType_t iValueType = VARTYPE_STRING, std::string_view defaultValue = "");
+    ScriptDeclaredVariable_t *Search(std::string_view variableName, VariableType_t iValueType = VARTYPE_STRING,
+                                     std::string_view defaultValue = "")
+    {
+        return Search(ResourceHash(variableName), variableName, iValueType, defaultValue);
+    }
+    ScriptDeclaredVariable_t *Search(const char *pszVariableName, VariableType_t iValueType = VARTYPE_STRING,
+                                     const char *pszDefaultValue = "")
+    {
+        return Search(std::string_view(pszVariableName), iValueType, std::string_view(pszDefaultValue));
+    }
+
     CResourceFile() = default;
 
   private:
+    friend class CResourceCache;
+
     ScriptVariablePair_t ParseVariable(std::string strToParse);
+
+    // после полей, о которых знает библиотека
+    CResourceIndex m_Index;
+
+    void UpdateIndex()
+    {
+        if (!m_Index.IsBuiltFor(m_Blocks, m_GlobalPairs))
+            BuildIndex();
+    }
+    int FindVariable(int iScope, const std::vector<ScriptVariablePair_t> &pairs, resourcehash_t iHash,
+                     std::string_view name) const
+    {
+        // m_Pairs блока индекс не отслеживает, поэтому номер проверяется
+        return m_Index.Find(iScope, iHash, [&](int iItem) {
+            return (size_t)iItem < pairs.size() && ResourceVariableName(pairs[iItem]) == name;
+        });
+    }
 };
 
-#endif
\ No newline at end of file
+/*
+===========================================================================
+
+   Если переменной нет, старые Search отдают статическую переменную,
+   созданную при первом промахе. Здесь значение по умолчанию своё у
+   каждого потока, но одно на все промахи: следующий промах в том же
+   потоке перезаписывает его, и прежний указатель видит уже новое
+   значение.
+
+      int32 a = pFile->Search("a", VARTYPE_INT32, "1")->m_iValue; // верно
+      ScriptDeclaredVariable_t *pA = pFile->Search("a", VARTYPE_INT32, "1");
+      ScriptDeclaredVariable_t *pB = pFile->Search("b", VARTYPE_INT32, "2");
+      // если обеих нет, pA == pB и в нём "2"
+
+===========================================================================
+*/
+inline ScriptDeclaredVariable_t *ResourceDefaultVariable(VariableType_t iValueType, std::string_view defaultValue)
+{
+    static thread_local ScriptDeclaredVariable_t s_Default;
+
+    // библиотечный конструктор тип не сохраняет (остаётся VARTYPE_INVALID),
+    // поэтому поля заполняются здесь так же, как их разбирает CResourceCache
+    size_t nLength = Min(defaultValue.size(), sizeof(s_Default.m_strValue) - 1);
+    memset((void *)&s_Default, 0, sizeof(s_Default));
+    memcpy(s_Default.m_strValue, defaultValue.data(), nLength);
+    s_Default.m_bValue = iValueType == VARTYPE_BOOLEAN && ResourceBooleanValue(s_Default.m_strValue);
+    s_Default.m_iValue = (iValueType == VARTYPE_INT32 || iValueType == VARTYPE_UINT16) ? atoi(s_Default.m_strValue) : 0;
+    s_Default.m_iValueType = iValueType;
+    return &s_Default;
+}
+
+inline ScriptDeclaredVariable_t *ScriptBlock_t::Search(std::string_view name, VariableType_t iValueType,
+                                                       std::string_view defaultValue)
+{
+    for (size_t i = 0; i < m_Pairs.size(); i++)
+    {
+        if (ResourceVariableName(m_Pairs[i]) == name)
+            return &m_Pairs[i].m_sdvVar;
+    }
+    return ResourceDefaultVariable(iValueType, defaultValue);
+}
+
+inline void CResourceIndex::Clear()
+{
+    m_Slots.clear();
+    m_nMask = 0;
+    m_pBlocks = NULL;
+    m_nBlocks = 0;
+    m_pGlobals = NULL;
+    m_nGlobals = 0;
+}
+
+inline void CResourceIndex::Assign(const resourceindexslot_t *pSlots, size_t nSlots,
+                                   const std::vector<ScriptBlock_t> &blocks,
+                                   const std::vector<ScriptVariablePair_t> &globals)
+{
+    m_Slots.assign(pSlots, pSlots + nSlots);
+    m_nMask = (uint32)(nSlots - 1);
+
+    m_pBlocks = blocks.data();
+    m_nBlocks = blocks.size();
+    m_pGlobals = globals.data();
+    m_nGlobals = globals.size();
+}
+
+inline void CResourceIndex::Insert(int iScope, resourcehash_t iHash, int iItem)
+{
+    uint32 i = Slot(iScope, iHash) & m_nMask;
+    while (m_Slots[i].m_iItem >= 0)
+        i = (i + 1) & m_nMask;
+
+    m_Slots[i].m_iHash = iHash;
+    m_Slots[i].m_iScope = iScope;
+    m_Slots[i].m_iItem = iItem;
+}
+
+inline void CResourceIndex::Build(const std::vector<ScriptBlock_t> &blocks,
+                                  const std::vector<ScriptVariablePair_t> &globals)
+{
+    size_t nItems = blocks.size() + globals.size();
+    for (size_t i = 0; i < blocks.size(); i++)
+        nItems += blocks[i].m_Pairs.size();
+
+    // заполнение не больше половины, чтобы цепочки оставались короткими
+    size_t nSlots = 16;
+    while (nSlots < nItems * 2)
+        nSlots <<= 1;
+
+    resourceindexslot_t empty = {0, 0, -1};
+    m_Slots.assign(nSlots, empty);
+    m_nMask = (uint32)(nSlots - 1);
+
+    // порядок вставки сохраняет первенство первого из одинаковых имён
+    for (size_t i = 0; i < blocks.size(); i++)
+        Insert(RESOURCEINDEX_BLOCKS, ResourceHash(blocks[i].m_pszNametag), (int)i);
+    for (size_t i = 0; i < globals.size(); i++)
+        Insert(RESOURCEINDEX_GLOBALS, ResourceHash(ResourceVariableName(globals[i])), (int)i);
+    for (size_t i = 0; i < blocks.size(); i++)
+    {
+        const std::vector<ScriptVariablePair_t> &pairs = blocks[i].m_Pairs;
+        for (size_t j = 0; j < pairs.size(); j++)
+            Insert((int)i, ResourceHash(ResourceVariableName(pairs[j])), (int)j);
+    }
+
+    m_pBlocks = blocks.data();
+    m_nBlocks = blocks.size();
+    m_pGlobals = globals.data();
+    m_nGlobals = globals.size();
+}
+
+template <typename Match> inline int CResourceIndex::Find(int iScope, resourcehash_t iHash, Match match) const
+{
+    if (m_Slots.empty())
+        return -1;
+
+    for (uint32 i = Slot(iScope, iHash) & m_nMask;; i = (i + 1) & m_nMask)
+    {
+        const resourceindexslot_t &slot = m_Slots[i];
+        if (slot.m_iItem < 0)
+            return -1;
+        if (slot.m_iHash == iHash && slot.m_iScope == iScope && match(slot.m_iItem))
+            return slot.m_iItem;
+    }
+}
+
+/*
+===========================================================================
+
+   Индекс строится один раз после CreateFromFile - явно через
+   BuildIndex или при первом поиске. Перестройка нужна после правки
+   m_Blocks и m_GlobalPairs, если число элементов осталось прежним
+   (например, переименования или изменений внутри m_Pairs блока).
+
+===========================================================================
+*/
+inline void CResourceFile::BuildIndex()
+{
+    m_Index.Build(m_Blocks, m_GlobalPairs);
+}
+
+inline ScriptBlock_t *CResourceFile::SearchBlock(resourcehash_t iBlockHash, std::string_view blockName)
+{
+    UpdateIndex();
+
+    int iBlock = m_Index.Find(RESOURCEINDEX_BLOCKS, iBlockHash,
+                              [&](int iItem) { return m_Blocks[iItem].m_pszNametag == blockName; });
+    return iBlock >= 0 ? &m_Blocks[iBlock] : NULL;
+}
+
+inline ScriptDeclaredVariable_t *CResourceFile::Search(resourcehash_t iBlockHash, std::string_view blockName,
+                                                       resourcehash_t iVariableHash, std::string_view variableName,
+                                                       VariableType_t iValueType, std::string_view defaultValue)
+{
+    ScriptBlock_t *pBlock = SearchBlock(iBlockHash, blockName);
+    if (pBlock)
+    {
+        int iBlock = (int)(pBlock - m_Blocks.data());
+        int iPair = FindVariable(iBlock, pBlock->m_Pairs, iVariableHash, variableName);
+        if (iPair >= 0)
+            return &pBlock->m_Pairs[iPair].m_sdvVar;
+    }
+    return ResourceDefaultVariable(iValueType, defaultValue);
+}
+
+inline ScriptDeclaredVariable_t *CResourceFile::Search(resourcehash_t iVariableHash, std::string_view variableName,
+                                                       VariableType_t iValueType, std::string_view defaultValue)
+{
+    UpdateIndex();
+
+    int iPair = FindVariable(RESOURCEINDEX_GLOBALS, m_GlobalPairs, iVariableHash, variableName);
+    if (iPair >= 0)
+        return &m_GlobalPairs[iPair].m_sdvVar;
+    return ResourceDefaultVariable(iValueType, defaultValue);
+}
+
+/*
+===========================================================================
+
+   Разбор текста файла ресурсов. Синтаксис тот же, что у CreateFromFile:
+
+      // комментарий
+      .int32 "name" "value"      - глобальная переменная
+      $weapon                    - имя следующего блока
+      {
+          string "model" "gun"   - переменная блока
+      }
+
+   Строки режутся по позициям от CResourceScanner, отдельных std::string
+   на строку нет. Что делать с найденным, решает handler:
+
+      void Variable(bool bInBlock, VariableType_t iType, std::string_view name, std::string_view value);
+      void BeginBlock();
+      void EndBlock(std::string_view blockName);
+
+   Имена и значения передаются как есть, без обрезки до 64 байт.
+   Переменные незакрытого в конце файла блока уже переданы, но
+   EndBlock для него не будет.
+
+===========================================================================
+*/
+inline bool ResourceParseVariable(const resourceline_t &line, VariableType_t &iType, std::string_view &name,
+                                  std::string_view &value, CResourceLog *pLog = NULL)
+{
+    // тип - первое слово, точка перед ним необязательна
+    const char *pType = line.m_pStart;
+    if (*pType == '.')
+        pType++;
+    const char *pTypeEnd = pType;
+    while (pTypeEnd < line.m_pEnd && *pTypeEnd != ' ' && *pTypeEnd != '\t')
+        pTypeEnd++;
+    if (pTypeEnd == line.m_pEnd)
+        return false;
+
+    std::string_view typeName(pType, pTypeEnd - pType);
+    iType = ResourceVariableType(typeName);
+    if (iType == VARTYPE_INVALID || (line.m_nQuotes && line.m_pQuotes[0] < pTypeEnd))
+    {
+        std::string strType(typeName);
+        ResourceLog(pLog, RESOURCELOG_ERROR, "Failed to convert variable: %s", strType.c_str());
+        return false;
+    }
+
+    // "имя" "значение", всё после второй пары кавычек не читается
+    if (line.m_nQuotes == 1 || line.m_nQuotes == 3)
+    {
+        ResourceLog(pLog, RESOURCELOG_ERROR, "Failed to parse script: \"Is Not Present");
+        return false;
+    }
+    if (line.m_nQuotes < 4)
+        return false;
+
+    name = std::string_view(line.m_pQuotes[0] + 1, line.m_pQuotes[1] - line.m_pQuotes[0] - 1);
+    value = std::string_view(line.m_pQuotes[2] + 1, line.m_pQuotes[3] - line.m_pQuotes[2] - 1);
+    return true;
+}
+
+template <typename Handler>
+inline void ResourceParseText(const char *pData, size_t nSize, Handler &handler, CResourceLog *pLog = NULL)
+{
+    CResourceScanner scanner(pData, nSize);
+    std::string_view blockName;
+    bool bInBlock = false;
+
+    size_t nPos = 0;
+    while (nPos < nSize)
+    {
+        resourceline_t line;
+        line.m_nQuotes = 0;
+
+        size_t nEnd = scanner.Next(nPos);
+        while (nEnd < nSize && pData[nEnd] == '"')
+        {
+            if (line.m_nQuotes < 4)
+                line.m_pQuotes[line.m_nQuotes] = pData + nEnd;
+            line.m_nQuotes++;
+            nEnd = scanner.Next(nEnd + 1);
+        }
+
+        line.m_pStart = pData + nPos;
+        line.m_pEnd = pData + nEnd;
+        nPos = nEnd + 1;
+
+        // файл может прийти с переводами строк Windows
+        if (line.m_pEnd > line.m_pStart && line.m_pEnd[-1] == '\r')
+            line.m_pEnd--;
+        while (line.m_pStart < line.m_pEnd && (*line.m_pStart == ' ' || *line.m_pStart == '\t'))
+            line.m_pStart++;
+
+        size_t nLength = line.m_pEnd - line.m_pStart;
+        if (!nLength || (nLength >= 2 && line.m_pStart[0] == '/' && line.m_pStart[1] == '/'))
+            continue;
+
+        if (bInBlock && line.m_pStart[0] == '}')
+        {
+            handler.EndBlock(blockName);
+            bInBlock = false;
+        }
+        else if (!bInBlock && line.m_pStart[0] == '$')
+            blockName = std::string_view(line.m_pStart + 1, nLength - 1);
+        else if (!bInBlock && line.m_pStart[0] == '{')
+        {
+            handler.BeginBlock();
+            bInBlock = true;
+        }
+        else
+        {
+            VariableType_t iType;
+            std::string_view name, value;
+            if (ResourceParseVariable(line, iType, name, value, pLog))
+                handler.Variable(bInBlock, iType, name, value);
+        }
+    }
+
+    if (bInBlock)
+        ResourceLog(pLog, RESOURCELOG_ERROR, "Failed to parse script: Required }");
+}
+
+inline bool CResourceFile::CreateFromMappedFile(const char *pszFilepath)
+{
+    m_bValidated = false;
+
+    filemapping_t file;
+    if (!file.Open(pszFilepath))
+    {
+        common()->Warning("Failed to map file '%s'", pszFilepath);
+        return false;
+    }
+
+    bool bResult = CreateFromMemory(file.m_pData, file.m_nSize);
+    file.Close();
+    return bResult;
+}
+
+inline bool CResourceFile::CreateFromMemory(const char *pData, size_t nSize, CResourceLog *pLog)
+{
+    m_bValidated = false;
+
+    struct handler_t
+    {
+        CResourceFile *m_pFile;
+        std::vector<ScriptVariablePair_t> m_BlockPairs;
+
+        void Variable(bool bInBlock, VariableType_t iType, std::string_view name, std::string_view value)
+        {
+            // остальное обрежет конструктор пары
+            char szName[sizeof(ScriptVariablePair_t::m_strValue) + 1];
+            char szValue[sizeof(ScriptDeclaredVariable_t::m_strValue) + 1];
+            size_t nName = Min(name.size(), sizeof(szName) - 1);
+            size_t nValue = Min(value.size(), sizeof(szValue) - 1);
+            memcpy(szName, name.data(), nName);
+            memcpy(szValue, value.data(), nValue);
+            szName[nName] = 0;
+            szValue[nValue] = 0;
+
+            (bInBlock ? m_BlockPairs : m_pFile->m_GlobalPairs).emplace_back(szName, szValue, iType);
+        }
+        void BeginBlock()
+        {
+            m_BlockPairs.clear();
+        }
+        void EndBlock(std::string_view blockName)
+        {
+            m_pFile->m_Blocks.emplace_back();
+            m_pFile->m_Blocks.back().m_pszNametag.assign(blockName.data(), blockName.size());
+            // буфер блока переиспользуется, в блок уходит вектор точного размера
+            m_pFile->m_Blocks.back().m_Pairs.assign(m_BlockPairs.begin(), m_BlockPairs.end());
+            m_BlockPairs.clear();
+        }
+    };
+
+    handler_t handler;
+    handler.m_pFile = this;
+    ResourceParseText(pData, nSize, handler, pLog);
+
+    ResourceLog(pLog, RESOURCELOG_PRINT, "Loaded %d global vars and %d m_Blocks", (int)m_GlobalPairs.size(),
+                (int)m_Blocks.size());
+    BuildIndex();
+    m_bValidated = true;
+    return true;
+}
+
+#endif
@@ -0,0 +1,342 @@
+/*
+  This file associated with Hayato Labs project.
+
+  For license and copyright information please follow this link:
+  https://github.com/hayatolabs/general/blob/main/LEGAL
+*/
+
+#ifndef HAYATOLABS_RESOURCELOADER_H
+#define HAYATOLABS_RESOURCELOADER_H
+
+#include "resourcecache.h"
+#include "thread.h"
+#include <algorithm>
+#include <thread>
+
+#if !defined(_WIN32)
+#include <dirent.h>
+#endif
+
+/*
+===========================================================================
+
+   Шаблоны путей: '*' и '?' допускаются только в имени файла,
+   каталог указывается как есть.
+
+      ResourceExpandPattern("scripts/weapons/weapon_*.txt")
+
+   Совпавшие пути возвращаются отсортированными, чтобы порядок
+   загрузки не зависел от файловой системы.
+
+===========================================================================
+*/
+inline bool ResourceIsPattern(std::string_view filepath)
+{
+    return filepath.find_first_of("*?") != std::string_view::npos;
+}
+
+inline bool ResourceMatchPattern(const char *pszPattern, const char *pszName)
+{
+    // после '*' запоминаем, откуда продолжать при несовпадении
+    const char *pStar = NULL;
+    const char *pResume = NULL;
+    while (*pszName)
+    {
+        if (*pszPattern == '*')
+        {
+            pStar = ++pszPattern;
+            pResume = pszName;
+        }
+        else if (*pszPattern == '?' || *pszPattern == *pszName)
+        {
+            pszPattern++;
+            pszName++;
+        }
+        else if (pStar)
+        {
+            pszPattern = pStar;
+            pszName = ++pResume;
+        }
+        else
+            return false;
+    }
+
+    while (*pszPattern == '*')
+        pszPattern++;
+    return !*pszPattern;
+}
+
+inline std::vector<Path_t> ResourceExpandPattern(const Path_t &pattern)
+{
+    std::vector<Path_t> filepaths;
+
+    size_t nSlash = pattern.find_last_of("/\\");
+    Path_t directory = nSlash == Path_t::npos ? Path_t() : pattern.substr(0, nSlash + 1);
+    Path_t name = nSlash == Path_t::npos ? pattern : pattern.substr(nSlash + 1);
+
+#if defined(_WIN32)
+    WIN32_FIND_DATAA data;
+    HANDLE hFind = FindFirstFileA(pattern.c_str(), &data);
+    if (hFind == INVALID_HANDLE_VALUE)
+        return filepaths;
+    do
+    {
+        // FindFirstFile понимает маски иначе (короткие имена 8.3), поэтому проверяем сами
+        if (!(data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) &&
+            ResourceMatchPattern(name.c_str(), data.cFileName))
+            filepaths.push_back(directory + data.cFileName);
+    } while (FindNextFileA(hFind, &data));
+    FindClose(hFind);
+#else
+    DIR *pDirectory = opendir(directory.empty() ? "." : directory.c_str());
+    if (!pDirectory)
+        return filepaths;
+    while (struct dirent *pEntry = readdir(pDirectory))
+    {
+        if (pEntry->d_name[0] == '.' && name[0] != '.')
+            continue;
+        if (!ResourceMatchPattern(name.c_str(), pEntry->d_name))
+            continue;
+
+        Path_t filepath = directory + pEntry->d_name;
+        struct stat info;
+        if (stat(filepath.c_str(), &info) == 0 && S_ISREG(info.st_mode))
+            filepaths.push_back(filepath);
+    }
+    closedir(pDirectory);
+#endif
+
+    std::sort(filepaths.begin(), filepaths.end());
+    return filepaths;
+}
+
+/*
+===========================================================================
+
+   CResourceBatchLoader - загрузка набора файлов ресурсов пулом потоков.
+
+   Каждый файл грузится через CResourceCache::Load в свой CResourceFile,
+   потоки разбирают файлы по общему счётчику, крупные - первыми, чтобы
+   в конце не ждать одного длинного файла. Результаты лежат в порядке
+   входного списка, шаблоны в нём раскрываются по месту.
+
+      CResourceBatchLoader loader(0);  // потоков по числу ядер
+      loader.Start(filepaths, [](const resourceloadresult_t &result) { ... });
+      ...                              // вызывающий поток свободен
+      int nFailed = loader.Wait();     // догружает вместе с потоками
+
+   onLoaded вызывается из того потока, который загрузил файл, сразу
+   после загрузки, и должен быть потокобезопасным. Start/Wait
+   вызываются из одного потока; результаты читать после Wait (или
+   в onLoaded - только свой).
+
+   К filesystem() и common() рабочие потоки не обращаются: каталог
+   кеша Start узнаёт и создаёт сам, а сообщения загрузки копятся в
+   m_Log каждого файла и выводятся в Wait в порядке входного списка.
+
+===========================================================================
+*/
+struct resourceloadresult_t
+{
+    Path_t m_Filepath;
+    CResourceFile m_File;
+    CResourceLog m_Log; // выводится и очищается в Wait
+    bool m_bLoaded;
+};
+
+class CResourceBatchLoader
+{
+  public:
+    typedef std::function<void(const resourceloadresult_t &result)> loadcallback_t;
+
+    CResourceBatchLoader(int nThreads = 0); // 0 - по числу ядер, считая вызывающий поток
+    ~CResourceBatchLoader();
+
+    void Start(const std::vector<Path_t> &filepaths, loadcallback_t onLoaded = NULL);
+    int Wait(); // число незагруженных файлов
+
+    int Load(const std::vector<Path_t> &filepaths, loadcallback_t onLoaded = NULL)
+    {
+        Start(filepaths, onLoaded);
+        return Wait();
+    }
+
+    std::vector<resourceloadresult_t> &GetResults()
+    {
+        return m_Results;
+    }
+    std::vector<Path_t> GetFailed() const;
+
+    int GetNumThreads() const
+    {
+        return (int)m_Workers.size() + 1;
+    }
+
+  private:
+    class CWorker : public CSystemThread
+    {
+      public:
+        CResourceBatchLoader *m_pOwner;
+
+      protected:
+        virtual int Run()
+        {
+            m_pOwner->RunJobs();
+            return 0;
+        }
+    };
+
+    std::vector<CWorker *> m_Workers;
+    int m_nSignaled; // потоки, которых разбудил Start
+
+    std::vector<resourceloadresult_t> m_Results;
+    std::vector<int> m_Order; // номера результатов, крупные файлы первыми
+    resourcecacheenv_t m_Env; // без журнала, его RunJobs подставляет свой
+    loadcallback_t m_OnLoaded;
+    CSysInterlockedInteger m_iNext;
+    CSysInterlockedInteger m_nFailed;
+
+    void RunJobs();
+
+    CResourceBatchLoader(const CResourceBatchLoader &s)
+    {
+    }
+    void operator=(const CResourceBatchLoader &s)
+    {
+    }
+};
+
+inline CResourceBatchLoader::CResourceBatchLoader(int nThreads) : m_nSignaled(0)
+{
+    if (nThreads <= 0)
+        nThreads = Max((int)std::thread::hardware_concurrency(), 1);
+
+    for (int i = 1; i < nThreads; i++)
+    {
+        CWorker *pWorker = new CWorker;
+        pWorker->m_pOwner = this;
+
+        char szName[32];
+        snprintf(szName, sizeof(szName), "resourceloader%d", i);
+        if (!pWorker->StartWorkerThread(szName, CORE_ANY))
+        {
+            delete pWorker;
+            break;
+        }
+        m_Workers.push_back(pWorker);
+    }
+}
+
+inline CResourceBatchLoader::~CResourceBatchLoader()
+{
+    Wait();
+    for (size_t i = 0; i < m_Workers.size(); i++)
+    {
+        m_Workers[i]->StopThread();
+        delete m_Workers[i];
+    }
+}
+
+inline void CResourceBatchLoader::Start(const std::vector<Path_t> &filepaths, loadcallback_t onLoaded)
+{
+    // предыдущий набор должен быть догружен, пока потоки его читают
+    Wait();
+
+    std::vector<Path_t> expanded;
+    for (size_t i = 0; i < filepaths.size(); i++)
+    {
+        if (!ResourceIsPattern(filepaths[i]))
+        {
+            expanded.push_back(filepaths[i]);
+            continue;
+        }
+
+        std::vector<Path_t> matched = ResourceExpandPattern(filepaths[i]);
+        if (matched.empty())
+            common()->Warning("No resource files match '%s'", filepaths[i].c_str());
+        expanded.insert(expanded.end(), matched.begin(), matched.end());
+    }
+
+    m_Results.clear();
+    m_Results.resize(expanded.size());
+
+    std::vector<uint64> sizes(expanded.size(), 0);
+    m_Order.resize(expanded.size());
+    for (size_t i = 0; i < expanded.size(); i++)
+    {
+        m_Results[i].m_Filepath = expanded[i];
+        m_Results[i].m_File.m_bValidated = false;
+        m_Results[i].m_bLoaded = false;
+
+        uint64 iModifyTime;
+        FileQueryInfo(expanded[i].c_str(), sizes[i], iModifyTime);
+        m_Order[i] = (int)i;
+    }
+    std::stable_sort(m_Order.begin(), m_Order.end(), [&](int a, int b) { return sizes[a] > sizes[b]; });
+
+    // каталог кеша создаётся здесь один раз, а не рабочими потоками в Write
+    m_Env = CResourceCache::DefaultEnv();
+    if (!m_Env.m_CacheDirectory.empty())
+        filesystem()->DirectoryCreate(m_Env.m_CacheDirectory);
+    m_Env.m_bCreateDirectory = false;
+
+    m_OnLoaded = onLoaded;
+    m_iNext.SetValue(0);
+    m_nFailed.SetValue(0);
+
+    // один файл вызывающий поток загрузит сам в Wait
+    m_nSignaled = Min((int)m_Workers.size(), (int)m_Results.size() - 1);
+    for (int i = 0; i < m_nSignaled; i++)
+        m_Workers[i]->SignalWork();
+}
+
+inline int CResourceBatchLoader::Wait()
+{
+    RunJobs();
+
+    for (int i = 0; i < m_nSignaled; i++)
+        m_Workers[i]->WaitForThread();
+    m_nSignaled = 0;
+
+    for (size_t i = 0; i < m_Results.size(); i++)
+        m_Results[i].m_Log.Flush();
+
+    int nFailed = m_nFailed.GetValue();
+    if (nFailed)
+        common()->Warning("Failed to load %d of %d resource files", nFailed, (int)m_Results.size());
+    m_nFailed.SetValue(0);
+    m_OnLoaded = NULL;
+    return nFailed;
+}
+
+inline void CResourceBatchLoader::RunJobs()
+{
+    for (;;)
+    {
+        int i = m_iNext.Increment() - 1;
+        if (i >= (int)m_Order.size())
+            return;
+
+        resourceloadresult_t &result = m_Results[m_Order[i]];
+        resourcecacheenv_t env = m_Env;
+        env.m_pLog = &result.m_Log;
+        result.m_bLoaded = CResourceCache::Load(result.m_File, result.m_Filepath.c_str(), env);
+        if (!result.m_bLoaded)
+            m_nFailed.Increment();
+        if (m_OnLoaded)
+            m_OnLoaded(result);
+    }
+}
+
+inline std::vector<Path_t> CResourceBatchLoader::GetFailed() const
+{
+    std::vector<Path_t> failed;
+    for (size_t i = 0; i < m_Results.size(); i++)
+    {
+        if (!m_Results[i].m_bLoaded)
+            failed.push_back(m_Results[i].m_Filepath);
+    }
+    return failed;
+}
+
+#endif /* HAYATOLABS_RESOURCELOADER_H */
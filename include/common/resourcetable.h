@@ -0,0 +1,529 @@
+/*
+  This file associated with Hayato Labs project.
+
+  For license and copyright information please follow this link:
+  https://github.com/hayatolabs/general/blob/main/LEGAL
+*/
+
+#ifndef HAYATOLABS_RESOURCETABLE_H
+#define HAYATOLABS_RESOURCETABLE_H
+
+#include "resourcefile.h"
+
+/*
+===========================================================================
+
+   CResourceStringPool - строки без повторов, одним массивом.
+
+   Строка задаётся смещением в массиве (resourcestring_t), пустая
+   строка - 0. Одинаковые имена и значения хранятся один раз, поэтому
+   сравнение строк пула - сравнение смещений. Как и в
+   ScriptDeclaredVariable_t, строка обрывается на первом нуле.
+
+===========================================================================
+*/
+typedef uint32 resourcestring_t;
+
+#define RESOURCESTRING_NONE 0xFFFFFFFFu // такой строки в пуле нет
+
+class CResourceStringPool
+{
+  public:
+    CResourceStringPool()
+    {
+        Clear();
+    }
+
+    void Clear();
+    resourcestring_t Intern(std::string_view text);
+    resourcestring_t Find(std::string_view text) const;
+
+    const char *Get(resourcestring_t iString) const
+    {
+        return m_Data.data() + iString;
+    }
+    size_t GetNumStrings() const
+    {
+        return m_nStrings;
+    }
+
+    void Compact()
+    {
+        m_Data.shrink_to_fit();
+    }
+    size_t GetMemoryUsage() const
+    {
+        return m_Data.capacity() + m_Slots.capacity() * sizeof(resourcestring_t);
+    }
+
+  private:
+    std::vector<char> m_Data;              // строки подряд, каждая закрыта нулём
+    std::vector<resourcestring_t> m_Slots; // открытая адресация по ResourceHash
+    size_t m_nStrings;
+
+    static std::string_view Terminate(std::string_view text)
+    {
+        const char *pNull = (const char *)memchr(text.data(), 0, text.size());
+        return pNull ? text.substr(0, pNull - text.data()) : text;
+    }
+    bool Equals(resourcestring_t iString, std::string_view text) const
+    {
+        // в text нулей нет, поэтому strncmp не выйдет за строку пула
+        const char *pString = Get(iString);
+        return !strncmp(pString, text.data(), text.size()) && !pString[text.size()];
+    }
+    void Grow();
+};
+
+inline void CResourceStringPool::Clear()
+{
+    m_Data.assign(1, 0);
+    m_Slots.assign(16, RESOURCESTRING_NONE);
+    m_nStrings = 0;
+}
+
+inline resourcestring_t CResourceStringPool::Intern(std::string_view text)
+{
+    text = Terminate(text);
+    if (text.empty())
+        return 0;
+
+    if ((m_nStrings + 1) * 2 > m_Slots.size())
+        Grow();
+
+    size_t nMask = m_Slots.size() - 1;
+    for (size_t i = ResourceHash(text) & nMask;; i = (i + 1) & nMask)
+    {
+        if (m_Slots[i] == RESOURCESTRING_NONE)
+        {
+            m_Slots[i] = (resourcestring_t)m_Data.size();
+            m_Data.insert(m_Data.end(), text.begin(), text.end());
+            m_Data.push_back(0);
+            m_nStrings++;
+            return m_Slots[i];
+        }
+        if (Equals(m_Slots[i], text))
+            return m_Slots[i];
+    }
+}
+
+inline resourcestring_t CResourceStringPool::Find(std::string_view text) const
+{
+    text = Terminate(text);
+    if (text.empty())
+        return 0;
+
+    size_t nMask = m_Slots.size() - 1;
+    for (size_t i = ResourceHash(text) & nMask;; i = (i + 1) & nMask)
+    {
+        if (m_Slots[i] == RESOURCESTRING_NONE)
+            return RESOURCESTRING_NONE;
+        if (Equals(m_Slots[i], text))
+            return m_Slots[i];
+    }
+}
+
+inline void CResourceStringPool::Grow()
+{
+    std::vector<resourcestring_t> slots(m_Slots.size() * 2, RESOURCESTRING_NONE);
+    size_t nMask = slots.size() - 1;
+
+    for (size_t i = 0; i < m_Slots.size(); i++)
+    {
+        if (m_Slots[i] == RESOURCESTRING_NONE)
+            continue;
+
+        size_t j = ResourceHash(Get(m_Slots[i])) & nMask;
+        while (slots[j] != RESOURCESTRING_NONE)
+            j = (j + 1) & nMask;
+        slots[j] = m_Slots[i];
+    }
+    m_Slots.swap(slots);
+}
+
+/*
+===========================================================================
+
+   CResourceTable - файл ресурсов в компактном виде, только для чтения.
+
+   Значение разбирается один раз при загрузке, как его разобрал бы
+   ScriptDeclaredVariable_t::ConvertValue, и дальше читается без atoi
+   и сравнения строк. Имена и тексты значений - строки пула файла.
+   Пары всех блоков лежат одним массивом, блок - диапазон в нём;
+   глобальные переменные - такой же диапазон в конце.
+
+   Пара занимает 16 байт вместо 140 у ScriptVariablePair_t, а блок -
+   12 байт вместо std::string и std::vector.
+
+      CResourceTable table;
+      table.CreateFromMappedFile("scripts/weapons.txt");
+      int32 iDamage = table.Get("shotgun", "damage", 10);
+      const char *pszModel = table.Get("shotgun", "model", "");
+
+   Блоки ищутся по хеш-индексу, переменные блока - перебором номеров
+   имён, без сравнения строк. Имя, которое читается часто, можно
+   один раз перевести в номер (FindString) и искать уже по нему.
+
+   После загрузки таблица не меняется, читать её можно из любых
+   потоков одновременно.
+
+===========================================================================
+*/
+struct resourcevalue_t
+{
+    int32 m_iNumber;          // INT32 и UINT16 - число, BOOLEAN - 0 или 1
+    resourcestring_t m_iText; // текст значения
+    VariableType_t m_iType;
+};
+
+struct resourcepair_t
+{
+    resourcestring_t m_iName;
+    resourcevalue_t m_Value;
+};
+
+struct resourceblock_t
+{
+    resourcestring_t m_iName;
+    uint32 m_iFirstPair;
+    uint32 m_nPairs;
+};
+
+struct resourcetableslot_t
+{
+    resourcestring_t m_iName;
+    int32 m_iItem; // -1 - пустой слот
+};
+
+class CResourceTable
+{
+  public:
+    CResourceTable()
+    {
+        Destroy();
+    }
+
+    // загрузка заменяет прежнее содержимое
+    bool CreateFromMappedFile(const char *pszFilepath);
+    bool CreateFromMemory(const char *pData, size_t nSize);
+    void CreateFromResourceFile(const CResourceFile &file);
+    void Destroy();
+
+    const resourceblock_t *FindBlock(resourcestring_t iName) const;
+    const resourceblock_t *FindBlock(std::string_view name) const
+    {
+        return FindBlock(m_Strings.Find(name));
+    }
+
+    const resourcevalue_t *Find(const resourceblock_t *pBlock, resourcestring_t iName) const;
+    const resourcevalue_t *Find(std::string_view blockName, std::string_view name) const
+    {
+        const resourceblock_t *pBlock = FindBlock(blockName);
+        return pBlock ? Find(pBlock, m_Strings.Find(name)) : NULL;
+    }
+    const resourcevalue_t *FindGlobal(resourcestring_t iName) const;
+    const resourcevalue_t *FindGlobal(std::string_view name) const
+    {
+        return FindGlobal(m_Strings.Find(name));
+    }
+
+    // как ScriptDeclaredVariable_t::ConvertValue: при другом типе - то же
+    // значение-признак, что у библиотеки
+    template <typename T> T ConvertValue(const resourcevalue_t *pValue) const;
+
+    // defaultValue, если переменной нет
+    template <typename T> T Get(std::string_view blockName, std::string_view name, T defaultValue) const
+    {
+        const resourcevalue_t *pValue = Find(blockName, name);
+        return pValue ? ConvertValue<T>(pValue) : defaultValue;
+    }
+    template <typename T> T GetGlobal(std::string_view name, T defaultValue) const
+    {
+        const resourcevalue_t *pValue = FindGlobal(name);
+        return pValue ? ConvertValue<T>(pValue) : defaultValue;
+    }
+
+    resourcestring_t FindString(std::string_view text) const
+    {
+        return m_Strings.Find(text);
+    }
+    const char *GetString(resourcestring_t iString) const
+    {
+        return m_Strings.Get(iString);
+    }
+
+    const std::vector<resourceblock_t> &GetBlocks() const
+    {
+        return m_Blocks;
+    }
+    const resourceblock_t &GetGlobals() const
+    {
+        return m_Globals;
+    }
+    const resourcepair_t *GetPairs(const resourceblock_t &block) const
+    {
+        return m_Pairs.data() + block.m_iFirstPair;
+    }
+
+    size_t GetMemoryUsage() const;
+
+  private:
+    CResourceStringPool m_Strings;
+    std::vector<resourcepair_t> m_Pairs;
+    std::vector<resourceblock_t> m_Blocks;
+    resourceblock_t m_Globals;
+
+    std::vector<resourcetableslot_t> m_BlockSlots;  // имя блока -> номер в m_Blocks
+    std::vector<resourcetableslot_t> m_GlobalSlots; // имя -> номер глобальной пары
+
+    resourcepair_t MakePair(VariableType_t iType, std::string_view name, std::string_view value);
+    void Finish();
+
+    static uint32 Slot(resourcestring_t iName)
+    {
+        return (uint32)(((uint64)iName * 0x9E3779B97F4A7C15ull) >> 32);
+    }
+    template <typename Name> static void BuildSlots(std::vector<resourcetableslot_t> &slots, size_t nCount, Name name);
+    static int FindSlot(const std::vector<resourcetableslot_t> &slots, resourcestring_t iName);
+};
+
+inline void CResourceTable::Destroy()
+{
+    m_Strings.Clear();
+    m_Pairs.clear();
+    m_Blocks.clear();
+    m_Globals.m_iName = 0;
+    m_Globals.m_iFirstPair = 0;
+    m_Globals.m_nPairs = 0;
+    m_BlockSlots.clear();
+    m_GlobalSlots.clear();
+}
+
+inline bool CResourceTable::CreateFromMappedFile(const char *pszFilepath)
+{
+    filemapping_t file;
+    if (!file.Open(pszFilepath))
+    {
+        common()->Warning("Failed to map file '%s'", pszFilepath);
+        return false;
+    }
+
+    bool bResult = CreateFromMemory(file.m_pData, file.m_nSize);
+    file.Close();
+    return bResult;
+}
+
+inline bool CResourceTable::CreateFromMemory(const char *pData, size_t nSize)
+{
+    Destroy();
+
+    // пары блока пишутся сразу в общий массив, глобальные копятся отдельно
+    struct handler_t
+    {
+        CResourceTable *m_pTable;
+        std::vector<resourcepair_t> m_Globals;
+        size_t m_nClosed; // пары закрытых блоков
+
+        void Variable(bool bInBlock, VariableType_t iType, std::string_view name, std::string_view value)
+        {
+            resourcepair_t pair = m_pTable->MakePair(iType, name, value);
+            (bInBlock ? m_pTable->m_Pairs : m_Globals).push_back(pair);
+        }
+        void BeginBlock()
+        {
+            m_pTable->m_Pairs.resize(m_nClosed);
+        }
+        void EndBlock(std::string_view blockName)
+        {
+            resourceblock_t block;
+            block.m_iName = m_pTable->m_Strings.Intern(blockName);
+            block.m_iFirstPair = (uint32)m_nClosed;
+            block.m_nPairs = (uint32)(m_pTable->m_Pairs.size() - m_nClosed);
+            m_pTable->m_Blocks.push_back(block);
+            m_nClosed = m_pTable->m_Pairs.size();
+        }
+    };
+
+    handler_t handler;
+    handler.m_pTable = this;
+    handler.m_nClosed = 0;
+    ResourceParseText(pData, nSize, handler);
+
+    // незакрытый блок не попадает в файл, как и у CResourceFile
+    m_Pairs.resize(handler.m_nClosed);
+    m_Globals.m_iFirstPair = (uint32)m_Pairs.size();
+    m_Globals.m_nPairs = (uint32)handler.m_Globals.size();
+    m_Pairs.insert(m_Pairs.end(), handler.m_Globals.begin(), handler.m_Globals.end());
+
+    Finish();
+    return true;
+}
+
+inline void CResourceTable::CreateFromResourceFile(const CResourceFile &file)
+{
+    Destroy();
+
+    size_t nPairs = file.m_GlobalPairs.size();
+    for (size_t i = 0; i < file.m_Blocks.size(); i++)
+        nPairs += file.m_Blocks[i].m_Pairs.size();
+    m_Pairs.reserve(nPairs);
+    m_Blocks.reserve(file.m_Blocks.size());
+
+    auto Append = [&](const std::vector<ScriptVariablePair_t> &pairs) {
+        for (size_t i = 0; i < pairs.size(); i++)
+        {
+            const ScriptDeclaredVariable_t &var = pairs[i].m_sdvVar;
+            std::string_view value(var.m_strValue, strnlen(var.m_strValue, sizeof(var.m_strValue)));
+            m_Pairs.push_back(MakePair(var.m_iValueType, ResourceVariableName(pairs[i]), value));
+        }
+    };
+
+    for (size_t i = 0; i < file.m_Blocks.size(); i++)
+    {
+        resourceblock_t block;
+        block.m_iName = m_Strings.Intern(file.m_Blocks[i].m_pszNametag);
+        block.m_iFirstPair = (uint32)m_Pairs.size();
+        block.m_nPairs = (uint32)file.m_Blocks[i].m_Pairs.size();
+        m_Blocks.push_back(block);
+        Append(file.m_Blocks[i].m_Pairs);
+    }
+
+    m_Globals.m_iFirstPair = (uint32)m_Pairs.size();
+    m_Globals.m_nPairs = (uint32)file.m_GlobalPairs.size();
+    Append(file.m_GlobalPairs);
+
+    Finish();
+}
+
+inline resourcepair_t CResourceTable::MakePair(VariableType_t iType, std::string_view name, std::string_view value)
+{
+    // столько же, сколько помещается в ScriptVariablePair_t
+    const size_t nMaxLength = sizeof(ScriptDeclaredVariable_t::m_strValue) - 1;
+
+    resourcepair_t pair;
+    pair.m_iName = m_Strings.Intern(name.substr(0, nMaxLength));
+    pair.m_Value.m_iText = m_Strings.Intern(value.substr(0, nMaxLength));
+    pair.m_Value.m_iType = iType;
+
+    const char *pszValue = m_Strings.Get(pair.m_Value.m_iText);
+    if (iType == VARTYPE_INT32 || iType == VARTYPE_UINT16 || iType == VARTYPE_INT64)
+        pair.m_Value.m_iNumber = atoi(pszValue);
+    else if (iType == VARTYPE_BOOLEAN)
+        pair.m_Value.m_iNumber = ResourceBooleanValue(pszValue);
+    else
+        pair.m_Value.m_iNumber = 0;
+    return pair;
+}
+
+inline void CResourceTable::Finish()
+{
+    m_Strings.Compact();
+    m_Pairs.shrink_to_fit();
+    m_Blocks.shrink_to_fit();
+
+    BuildSlots(m_BlockSlots, m_Blocks.size(), [&](size_t i) { return m_Blocks[i].m_iName; });
+    const resourcepair_t *pGlobals = GetPairs(m_Globals);
+    BuildSlots(m_GlobalSlots, m_Globals.m_nPairs, [&](size_t i) { return pGlobals[i].m_iName; });
+}
+
+template <typename Name>
+inline void CResourceTable::BuildSlots(std::vector<resourcetableslot_t> &slots, size_t nCount, Name name)
+{
+    // заполнение не больше половины, чтобы цепочки оставались короткими
+    size_t nSlots = 16;
+    while (nSlots < nCount * 2)
+        nSlots <<= 1;
+
+    resourcetableslot_t empty = {0, -1};
+    slots.assign(nSlots, empty);
+
+    for (size_t i = 0; i < nCount; i++)
+    {
+        resourcestring_t iName = name(i);
+
+        // из повторяющихся имён находится первое, как и при переборе
+        size_t j = Slot(iName) & (nSlots - 1);
+        while (slots[j].m_iItem >= 0 && slots[j].m_iName != iName)
+            j = (j + 1) & (nSlots - 1);
+        if (slots[j].m_iItem >= 0)
+            continue;
+
+        slots[j].m_iName = iName;
+        slots[j].m_iItem = (int32)i;
+    }
+}
+
+inline int CResourceTable::FindSlot(const std::vector<resourcetableslot_t> &slots, resourcestring_t iName)
+{
+    if (iName == RESOURCESTRING_NONE || slots.empty())
+        return -1;
+
+    size_t nMask = slots.size() - 1;
+    for (size_t i = Slot(iName) & nMask;; i = (i + 1) & nMask)
+    {
+        if (slots[i].m_iItem < 0)
+            return -1;
+        if (slots[i].m_iName == iName)
+            return slots[i].m_iItem;
+    }
+}
+
+inline const resourceblock_t *CResourceTable::FindBlock(resourcestring_t iName) const
+{
+    int iBlock = FindSlot(m_BlockSlots, iName);
+    return iBlock >= 0 ? &m_Blocks[iBlock] : NULL;
+}
+
+inline const resourcevalue_t *CResourceTable::Find(const resourceblock_t *pBlock, resourcestring_t iName) const
+{
+    if (!pBlock || iName == RESOURCESTRING_NONE)
+        return NULL;
+
+    const resourcepair_t *pPairs = GetPairs(*pBlock);
+    for (uint32 i = 0; i < pBlock->m_nPairs; i++)
+    {
+        if (pPairs[i].m_iName == iName)
+            return &pPairs[i].m_Value;
+    }
+    return NULL;
+}
+
+inline const resourcevalue_t *CResourceTable::FindGlobal(resourcestring_t iName) const
+{
+    int iPair = FindSlot(m_GlobalSlots, iName);
+    return iPair >= 0 ? &GetPairs(m_Globals)[iPair].m_Value : NULL;
+}
+
+inline size_t CResourceTable::GetMemoryUsage() const
+{
+    return m_Strings.GetMemoryUsage() + m_Pairs.capacity() * sizeof(resourcepair_t) +
+           m_Blocks.capacity() * sizeof(resourceblock_t) +
+           (m_BlockSlots.capacity() + m_GlobalSlots.capacity()) * sizeof(resourcetableslot_t);
+}
+
+template <> inline uint16 CResourceTable::ConvertValue<uint16>(const resourcevalue_t *pValue) const
+{
+    return pValue->m_iType == VARTYPE_UINT16 ? (uint16)pValue->m_iNumber : 0xFFFF;
+}
+
+template <> inline int32 CResourceTable::ConvertValue<int32>(const resourcevalue_t *pValue) const
+{
+    return pValue->m_iType == VARTYPE_INT32 ? pValue->m_iNumber : INT32_MAX;
+}
+
+template <> inline int64 CResourceTable::ConvertValue<int64>(const resourcevalue_t *pValue) const
+{
+    return pValue->m_iType == VARTYPE_INT64 ? (int64)pValue->m_iNumber : INT64_MAX;
+}
+
+template <> inline bool CResourceTable::ConvertValue<bool>(const resourcevalue_t *pValue) const
+{
+    return pValue->m_iType == VARTYPE_BOOLEAN && pValue->m_iNumber != 0;
+}
+
+template <> inline const char *CResourceTable::ConvertValue<const char *>(const resourcevalue_t *pValue) const
+{
+    return pValue->m_iType == VARTYPE_STRING ? GetString(pValue->m_iText) : "";
+}
+
+#endif /* HAYATOLABS_RESOURCETABLE_H */
@@ -73,6 +73,21 @@ class CScopedCriticalSection
     CSystemMutex *mutex; // NOTE: making this a reference causes a TypeInfo crash
 };
 
+/*
+================================================
+MemGeneralZoneMutex guards the general zone behind g_pMemoryManager, which has no lock of its
+own. Every caller that may reach g_pMemoryManager->Malloc/Free off the main thread (slab pages,
+debug tables, pools, allocator adapters, package segments) takes it, and so must application
+code that uses the general zone concurrently with them. A private lock around the same calls
+does not help: it only serializes against itself.
+================================================
+*/
+inline CSystemMutex &MemGeneralZoneMutex()
+{
+    static CSystemMutex s_Mutex;
+    return s_Mutex;
+}
+
 /*
 ================================================
 CSystemSignal is a C++ wrapper for the low level system signal functions.  A signal is an object
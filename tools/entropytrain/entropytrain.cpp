@@ -0,0 +1,146 @@
+/*
+  This file associated with Hayato Labs project.
+
+  For license and copyright information please follow this link:
+  https://github.com/hayatolabs/general/blob/main/LEGAL
+*/
+
+/*
+===========================================================================
+
+   entropytrain - статические таблицы сжатия по записи трафика.
+
+   entropytrain -name <Name> [-out <file.h>] [-raw] <capture>...
+
+   Запись - файл EntropyTrainer_WriteCapture, с -raw каждый файл
+   считается одним сообщением. Результат - заголовок с таблицами
+   g_<Name>RansFreq, g_<Name>HuffmanLengths и g_<Name>HuffmanCodes,
+   в stderr - оценка сжатия корпуса текущими и новыми таблицами.
+
+      static ranstable_t s_GameTable;
+      s_GameTable.Build(g_GameRansFreq);
+      RansRegisterTable(1, &s_GameTable);
+
+===========================================================================
+*/
+
+#include "common/entropytrainer.h"
+
+#include <vector>
+
+static bool Train_ReadFile(const char *pszFilename, std::vector<ubyte> &data)
+{
+    FILE *f = fopen(pszFilename, "rb");
+    if (!f)
+        return false;
+
+    ubyte buffer[65536];
+    size_t nRead;
+    while ((nRead = fread(buffer, 1, sizeof(buffer), f)) > 0)
+        data.insert(data.end(), buffer, buffer + nRead);
+
+    bool bOk = !ferror(f);
+    fclose(f);
+    return bOk;
+}
+
+static bool Train_AddCapture(CEntropyTrainer &trainer, const std::vector<ubyte> &data)
+{
+    size_t iPos = 0;
+    while (iPos < data.size())
+    {
+        if (data.size() - iPos < 4)
+            return false;
+
+        uint32 nLength = data[iPos] | (data[iPos + 1] << 8) | (data[iPos + 2] << 16) | ((uint32)data[iPos + 3] << 24);
+        iPos += 4;
+        if (nLength > data.size() - iPos)
+            return false;
+
+        trainer.AddPayload(data.data() + iPos, (int)nLength);
+        iPos += nLength;
+    }
+    return true;
+}
+
+static void Train_Report(const CEntropyTrainer &trainer)
+{
+    double flBytes = (double)Max<uint64>(trainer.GetByteCount(), 1);
+
+    uint32 freq[256], defaultFreq[256];
+    uint8 lengths[256];
+    trainer.BuildFrequencies(freq);
+    trainer.BuildHuffmanLengths(lengths);
+    for (int i = 0; i < 256; i++)
+        defaultFreq[i] = RansTable(0)->m_Freq[i];
+
+    fprintf(stderr, "entropytrain: %llu messages, %llu bytes\n", (unsigned long long)trainer.GetMessageCount(),
+            (unsigned long long)trainer.GetByteCount());
+    fprintf(stderr, "  static huffman:  %6.2f%%\n",
+            trainer.EstimateHuffmanBits(HuffmanTables()->m_Lengths) * 100.0 / (flBytes * 8));
+    fprintf(stderr, "  trained huffman: %6.2f%%\n", trainer.EstimateHuffmanBits(lengths) * 100.0 / (flBytes * 8));
+    fprintf(stderr, "  default rans:    %6.2f%%\n", trainer.EstimateRansBits(defaultFreq) * 100.0 / (flBytes * 8));
+    fprintf(stderr, "  trained rans:    %6.2f%%\n", trainer.EstimateRansBits(freq) * 100.0 / (flBytes * 8));
+}
+
+int main(int argc, char **argv)
+{
+    const char *pszName = NULL;
+    const char *pszOutput = NULL;
+    bool bRaw = false;
+    std::vector<const char *> files;
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (!strcmp(argv[i], "-raw"))
+            bRaw = true;
+        else if (!strcmp(argv[i], "-name") && i + 1 < argc)
+            pszName = argv[++i];
+        else if (!strcmp(argv[i], "-out") && i + 1 < argc)
+            pszOutput = argv[++i];
+        else
+            files.push_back(argv[i]);
+    }
+
+    if (!pszName || files.empty())
+    {
+        fprintf(stderr, "usage: entropytrain -name <Name> [-out <file.h>] [-raw] <capture>...\n");
+        return 1;
+    }
+
+    CEntropyTrainer trainer;
+    for (size_t i = 0; i < files.size(); i++)
+    {
+        std::vector<ubyte> data;
+        if (!Train_ReadFile(files[i], data))
+        {
+            fprintf(stderr, "entropytrain: can't read %s\n", files[i]);
+            return 1;
+        }
+
+        if (bRaw)
+            trainer.AddPayload(data.data(), (int)data.size());
+        else if (!Train_AddCapture(trainer, data))
+        {
+            fprintf(stderr, "entropytrain: %s is truncated\n", files[i]);
+            return 1;
+        }
+    }
+
+    if (!trainer.GetByteCount())
+    {
+        fprintf(stderr, "entropytrain: no data\n");
+        return 1;
+    }
+
+    Train_Report(trainer);
+
+    FILE *f = pszOutput ? fopen(pszOutput, "w") : stdout;
+    if (!f)
+        return 1;
+
+    bool bOk = trainer.WriteHeader(f, pszName);
+    if (f != stdout)
+        bOk = !fclose(f) && bOk;
+    return bOk ? 0 : 1;
+}
@@ -0,0 +1,595 @@
+/*
+  This file associated with Hayato Labs project.
+
+  For license and copyright information please follow this link:
+  https://github.com/hayatolabs/general/blob/main/LEGAL
+*/
+
+/*
+===========================================================================
+
+   membench - сравнение аллокаторов SDK с системным malloc
+
+   membench [-out <file.json>] [-ops <count>] [-trace <file>] [-seed <n>]
+
+   Сценарии:
+      fixed      - выделение/освобождение блоков одного размера
+      random     - размеры от 8 байт до 64 Кб, равномерно по log2
+      crossthread - поток-производитель выделяет, потребитель освобождает
+      fragment   - долгий прогон со случайным временем жизни блоков
+      trace      - воспроизведение записанной трассы (-trace)
+
+   Формат трассы - текст, по операции на строку:
+      a <id> <size>   выделить блок и запомнить под номером id
+      f <id>          освободить блок id
+
+   Результат - JSON: пропускная способность, p50/p99/p999 задержки
+   одной операции в наносекундах и пиковый RSS процесса.
+
+===========================================================================
+*/
+
+#include "common/memallocator.h"
+#include "common/memslab.h"
+#include "common/memtlsf.h"
+
+#include <algorithm>
+#include <chrono>
+#include <random>
+#include <thread>
+
+#if defined(_WIN32)
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#endif
+
+#define MEMBENCH_DEFAULT_OPS 2000000
+#define MEMBENCH_WINDOW 4096                // живых блоков в сценариях churn
+#define MEMBENCH_ZONE_SIZE (256 * 1024 * 1024) // размер собственных зон
+#define MEMBENCH_TAG 20
+#define MEMBENCH_QUEUE_SIZE 1024
+
+/*
+===========================================================================
+
+   Испытуемые аллокаторы
+
+===========================================================================
+*/
+struct benchallocator_t
+{
+    const char *m_pszName;
+    bool m_bAvailable;
+    bool m_bThreadSafe; // участвует в crossthread
+
+    void *(*m_pfnMalloc)(benchallocator_t *pAllocator, size_t nSize);
+    void (*m_pfnFree)(benchallocator_t *pAllocator, void *ptr);
+
+    memoryzone_t *m_pZone;
+    CMemoryZone *m_pMemoryZone;
+    CMemorySlab *m_pSlab;
+};
+
+static void *System_Malloc(benchallocator_t *, size_t nSize)
+{
+    return malloc(nSize);
+}
+
+static void System_Free(benchallocator_t *, void *ptr)
+{
+    free(ptr);
+}
+
+static void *General_Malloc(benchallocator_t *, size_t nSize)
+{
+    return g_pMemoryManager->Malloc(nSize, MEMBENCH_TAG);
+}
+
+static void *General_MallocDebug(benchallocator_t *, size_t nSize)
+{
+    return g_pMemoryManager->MallocDebug(nSize, MEMBENCH_TAG, __FUNCTION__, __FILE__, __LINE__);
+}
+
+static void General_Free(benchallocator_t *, void *ptr)
+{
+    g_pMemoryManager->Free(ptr);
+}
+
+static void *Zone_Malloc(benchallocator_t *pAllocator, size_t nSize)
+{
+    return pAllocator->m_pZone->Malloc(nSize, MEMBENCH_TAG);
+}
+
+static void *Zone_MallocDebug(benchallocator_t *pAllocator, size_t nSize)
+{
+    return pAllocator->m_pZone->Malloc(nSize, MEMBENCH_TAG, __FUNCTION__, __FILE__, __LINE__);
+}
+
+static void Zone_Free(benchallocator_t *pAllocator, void *ptr)
+{
+    pAllocator->m_pZone->Free(ptr);
+}
+
+static void *MemoryZone_Malloc(benchallocator_t *pAllocator, size_t nSize)
+{
+    return pAllocator->m_pMemoryZone->Malloc(nSize, MEMBENCH_TAG);
+}
+
+static void MemoryZone_Free(benchallocator_t *pAllocator, void *ptr)
+{
+    pAllocator->m_pMemoryZone->Free(ptr);
+}
+
+static void *Slab_Malloc(benchallocator_t *pAllocator, size_t nSize)
+{
+    return pAllocator->m_pSlab->Malloc(nSize, MEMBENCH_TAG);
+}
+
+static void Slab_Free(benchallocator_t *pAllocator, void *ptr)
+{
+    pAllocator->m_pSlab->Free(ptr);
+}
+
+/*
+===========================================================================
+
+   Замеры
+
+===========================================================================
+*/
+struct benchresult_t
+{
+    std::string m_strScenario;
+    std::string m_strAllocator;
+    int64 m_nOps;
+    int64 m_nFailed;
+    double m_flSeconds;
+    uint32 m_nP50, m_nP99, m_nP999; // нс на операцию
+    int64 m_nPeakRSS;               // байт
+};
+
+static int64 Bench_PeakRSS()
+{
+#if defined(_WIN32)
+    PROCESS_MEMORY_COUNTERS counters;
+    if (!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+        return 0;
+    return (int64)counters.PeakWorkingSetSize;
+#else
+    // ru_maxrss - максимум за всю жизнь процесса, его не сбросить между сценариями;
+    // VmHWM сбрасывает Bench_ResetPeakRSS
+    FILE *f = fopen("/proc/self/status", "r");
+    if (f)
+    {
+        char szLine[256];
+        long long nKilobytes = -1;
+        while (fgets(szLine, sizeof(szLine), f))
+        {
+            if (sscanf(szLine, "VmHWM: %lld kB", &nKilobytes) == 1)
+                break;
+        }
+        fclose(f);
+        if (nKilobytes >= 0)
+            return (int64)nKilobytes * 1024;
+    }
+
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return (int64)usage.ru_maxrss * 1024;
+#endif
+}
+
+static void Bench_ResetPeakRSS()
+{
+#if !defined(_WIN32)
+    // ядро Linux 4.0+ сбрасывает VmHWM записью "5"; на Windows пик общий для процесса
+    FILE *f = fopen("/proc/self/clear_refs", "w");
+    if (f)
+    {
+        fputs("5", f);
+        fclose(f);
+    }
+#endif
+}
+
+static uint64 Bench_Now()
+{
+    return (uint64)std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+}
+
+class CBenchTimer
+{
+  public:
+    CBenchTimer(int64 nExpectedOps)
+    {
+        m_Samples.reserve((size_t)nExpectedOps);
+        m_nStart = Bench_Now();
+    }
+
+    uint64 Begin()
+    {
+        return Bench_Now();
+    }
+    void End(uint64 nBegin)
+    {
+        AddSample(Bench_Now() - nBegin);
+    }
+    void AddSample(uint64 nDelta)
+    {
+        m_Samples.push_back(nDelta > UINT32_MAX ? UINT32_MAX : (uint32)nDelta);
+    }
+
+    void Finish(benchresult_t &result)
+    {
+        result.m_flSeconds = (Bench_Now() - m_nStart) * 1e-9;
+        result.m_nOps = (int64)m_Samples.size();
+        result.m_nP50 = Percentile(0.5);
+        result.m_nP99 = Percentile(0.99);
+        result.m_nP999 = Percentile(0.999);
+    }
+
+  private:
+    std::vector<uint32> m_Samples;
+    uint64 m_nStart;
+
+    uint32 Percentile(double flFraction)
+    {
+        if (m_Samples.empty())
+            return 0;
+
+        size_t i = Min(m_Samples.size() - 1, (size_t)(m_Samples.size() * flFraction));
+        std::nth_element(m_Samples.begin(), m_Samples.begin() + i, m_Samples.end());
+        return m_Samples[i];
+    }
+};
+
+static size_t Bench_RandomSize(std::mt19937 &random)
+{
+    // равномерно по log2, чтобы мелкие блоки не тонули в крупных
+    int iLog = std::uniform_int_distribution<int>(3, 15)(random);
+    return std::uniform_int_distribution<size_t>((size_t)1 << iLog, ((size_t)2 << iLog) - 1)(random);
+}
+
+/*
+===========================================================================
+
+   Сценарии
+
+===========================================================================
+*/
+static void Bench_Churn(benchallocator_t *pAllocator, int64 nOps, bool bRandomSize, uint32 iSeed,
+                        benchresult_t &result)
+{
+    std::mt19937 random(iSeed);
+    std::vector<void *> window(MEMBENCH_WINDOW, (void *)NULL);
+    std::vector<size_t> sizes((size_t)nOps / 2 + 1);
+    for (size_t i = 0; i < sizes.size(); i++)
+        sizes[i] = bRandomSize ? Bench_RandomSize(random) : 64;
+
+    CBenchTimer timer(nOps);
+    for (int64 i = 0; i < nOps / 2; i++)
+    {
+        size_t iSlot = (size_t)random() % MEMBENCH_WINDOW;
+        if (window[iSlot])
+        {
+            uint64 nBegin = timer.Begin();
+            pAllocator->m_pfnFree(pAllocator, window[iSlot]);
+            timer.End(nBegin);
+        }
+
+        uint64 nBegin = timer.Begin();
+        window[iSlot] = pAllocator->m_pfnMalloc(pAllocator, sizes[i]);
+        timer.End(nBegin);
+        if (!window[iSlot])
+            result.m_nFailed++;
+    }
+    timer.Finish(result);
+
+    for (size_t i = 0; i < window.size(); i++)
+        pAllocator->m_pfnFree(pAllocator, window[i]);
+}
+
+static void Bench_Fragment(benchallocator_t *pAllocator, int64 nOps, uint32 iSeed, benchresult_t &result)
+{
+    // у каждого блока своё время жизни: часть живёт почти весь прогон
+    std::mt19937 random(iSeed);
+    std::vector<std::pair<int64, void *>> live;
+    std::vector<void *> longLived;
+
+    CBenchTimer timer(nOps);
+    for (int64 i = 0; i < nOps / 2; i++)
+    {
+        while (!live.empty() && live.front().first <= i)
+        {
+            std::pop_heap(live.begin(), live.end(), std::greater<std::pair<int64, void *>>());
+            uint64 nBegin = timer.Begin();
+            pAllocator->m_pfnFree(pAllocator, live.back().second);
+            timer.End(nBegin);
+            live.pop_back();
+        }
+
+        uint64 nBegin = timer.Begin();
+        void *ptr = pAllocator->m_pfnMalloc(pAllocator, Bench_RandomSize(random));
+        timer.End(nBegin);
+        if (!ptr)
+        {
+            result.m_nFailed++;
+            continue;
+        }
+
+        if (random() % 64 == 0)
+        {
+            longLived.push_back(ptr);
+            continue;
+        }
+        live.push_back(std::make_pair(i + 1 + (int64)(random() % 20000), ptr));
+        std::push_heap(live.begin(), live.end(), std::greater<std::pair<int64, void *>>());
+    }
+    timer.Finish(result);
+
+    for (size_t i = 0; i < live.size(); i++)
+        pAllocator->m_pfnFree(pAllocator, live[i].second);
+    for (size_t i = 0; i < longLived.size(); i++)
+        pAllocator->m_pfnFree(pAllocator, longLived[i]);
+}
+
+static void Bench_CrossThread(benchallocator_t *pAllocator, int64 nOps, uint32 iSeed, benchresult_t &result)
+{
+    // кольцо указателей между двумя потоками, NULL - ячейка пуста
+    static int s_iFailed; // подставляется вместо неудавшегося выделения
+    std::vector<std::atomic<void *>> queue(MEMBENCH_QUEUE_SIZE);
+    for (size_t i = 0; i < queue.size(); i++)
+        queue[i].store(NULL, std::memory_order_relaxed);
+
+    int64 nCount = nOps / 2;
+    std::vector<uint32> freeSamples;
+    freeSamples.reserve((size_t)nCount);
+
+    std::thread consumer([&]() {
+        for (int64 i = 0; i < nCount; i++)
+        {
+            std::atomic<void *> &cell = queue[(size_t)(i % MEMBENCH_QUEUE_SIZE)];
+            void *ptr;
+            while ((ptr = cell.load(std::memory_order_acquire)) == NULL)
+                std::this_thread::yield();
+            cell.store(NULL, std::memory_order_release);
+            if (ptr == &s_iFailed)
+                continue;
+
+            uint64 nBegin = Bench_Now();
+            pAllocator->m_pfnFree(pAllocator, ptr);
+            freeSamples.push_back((uint32)Min<uint64>(Bench_Now() - nBegin, UINT32_MAX));
+        }
+    });
+
+    std::mt19937 random(iSeed);
+    CBenchTimer timer(nOps);
+    for (int64 i = 0; i < nCount; i++)
+    {
+        uint64 nBegin = timer.Begin();
+        void *ptr = pAllocator->m_pfnMalloc(pAllocator, Bench_RandomSize(random));
+        timer.End(nBegin);
+        if (!ptr)
+        {
+            // потребитель ждёт ровно nCount блоков
+            ptr = &s_iFailed;
+            result.m_nFailed++;
+        }
+
+        std::atomic<void *> &cell = queue[(size_t)(i % MEMBENCH_QUEUE_SIZE)];
+        while (cell.load(std::memory_order_acquire) != NULL)
+            std::this_thread::yield();
+        cell.store(ptr, std::memory_order_release);
+    }
+    consumer.join();
+
+    for (size_t i = 0; i < freeSamples.size(); i++)
+        timer.AddSample(freeSamples[i]);
+    timer.Finish(result);
+}
+
+struct benchtraceop_t
+{
+    bool m_bFree;
+    uint32 m_iId;
+    size_t m_nSize;
+};
+
+static bool Bench_LoadTrace(const char *pszFilename, std::vector<benchtraceop_t> &ops, uint32 &nMaxId)
+{
+    FILE *f = fopen(pszFilename, "r");
+    if (!f)
+        return false;
+
+    char szOp[8];
+    unsigned int iId;
+    unsigned long long nSize;
+    nMaxId = 0;
+    while (fscanf(f, "%7s %u", szOp, &iId) == 2)
+    {
+        benchtraceop_t op;
+        op.m_bFree = szOp[0] == 'f';
+        op.m_iId = iId;
+        op.m_nSize = 0;
+        if (!op.m_bFree)
+        {
+            if (fscanf(f, "%llu", &nSize) != 1)
+                break;
+            op.m_nSize = (size_t)nSize;
+        }
+        nMaxId = Max(nMaxId, (uint32)iId);
+        ops.push_back(op);
+    }
+    fclose(f);
+    return true;
+}
+
+static void Bench_Trace(benchallocator_t *pAllocator, const std::vector<benchtraceop_t> &ops, uint32 nMaxId,
+                        benchresult_t &result)
+{
+    std::vector<void *> blocks((size_t)nMaxId + 1, (void *)NULL);
+
+    CBenchTimer timer((int64)ops.size());
+    for (size_t i = 0; i < ops.size(); i++)
+    {
+        const benchtraceop_t &op = ops[i];
+        uint64 nBegin = timer.Begin();
+        if (op.m_bFree)
+        {
+            pAllocator->m_pfnFree(pAllocator, blocks[op.m_iId]);
+            blocks[op.m_iId] = NULL;
+        }
+        else
+        {
+            blocks[op.m_iId] = pAllocator->m_pfnMalloc(pAllocator, op.m_nSize);
+            if (!blocks[op.m_iId])
+                result.m_nFailed++;
+        }
+        timer.End(nBegin);
+    }
+    timer.Finish(result);
+
+    for (size_t i = 0; i < blocks.size(); i++)
+        pAllocator->m_pfnFree(pAllocator, blocks[i]);
+}
+
+/*
+===========================================================================
+
+   Вывод
+
+===========================================================================
+*/
+static void Bench_WriteJSON(FILE *f, const std::vector<benchresult_t> &results)
+{
+    fprintf(f, "{\n  \"benchmark\": \"membench\",\n  \"results\": [\n");
+    for (size_t i = 0; i < results.size(); i++)
+    {
+        const benchresult_t &r = results[i];
+        double flOpsPerSec = r.m_flSeconds > 0 ? r.m_nOps / r.m_flSeconds : 0;
+        fprintf(f,
+                "    {\"scenario\": \"%s\", \"allocator\": \"%s\", \"ops\": %lld, \"failed\": %lld, "
+                "\"seconds\": %.6f, \"ops_per_sec\": %.0f, \"p50_ns\": %u, \"p99_ns\": %u, \"p999_ns\": %u, "
+                "\"peak_rss_bytes\": %lld}%s\n",
+                r.m_strScenario.c_str(), r.m_strAllocator.c_str(), (long long)r.m_nOps, (long long)r.m_nFailed,
+                r.m_flSeconds, flOpsPerSec, r.m_nP50, r.m_nP99, r.m_nP999, (long long)r.m_nPeakRSS,
+                i + 1 < results.size() ? "," : "");
+    }
+    fprintf(f, "  ]\n}\n");
+}
+
+int main(int argc, char **argv)
+{
+    const char *pszOutput = NULL;
+    const char *pszTrace = NULL;
+    int64 nOps = MEMBENCH_DEFAULT_OPS;
+    uint32 iSeed = 1;
+
+    for (int i = 1; i + 1 < argc; i += 2)
+    {
+        if (!strcmp(argv[i], "-out"))
+            pszOutput = argv[i + 1];
+        else if (!strcmp(argv[i], "-ops"))
+            nOps = atoll(argv[i + 1]);
+        else if (!strcmp(argv[i], "-trace"))
+            pszTrace = argv[i + 1];
+        else if (!strcmp(argv[i], "-seed"))
+            iSeed = (uint32)atoi(argv[i + 1]);
+    }
+
+    common()->Init();
+
+    std::vector<benchtraceop_t> traceOps;
+    uint32 nTraceMaxId = 0;
+    if (pszTrace && !Bench_LoadTrace(pszTrace, traceOps, nTraceMaxId))
+        common()->Warning("membench: can't read trace %s\n", pszTrace);
+
+    memoryzone_t *pZone = g_pMemoryManager->MallocZoneMemory(MEMBENCH_ZONE_SIZE);
+    CMemoryZone tlsfZone;
+    bool bTlsf = tlsfZone.Create(MEMBENCH_ZONE_SIZE, MEMZONE_POLICY_TLSF);
+    tlsfZone.SetName("membench_tlsf");
+    CMemoryZone virtualZone;
+    bool bVirtual = virtualZone.CreateVirtual(MEMBENCH_ZONE_SIZE, MEMPAGE_HUGE_TRANSPARENT);
+    virtualZone.SetName("membench_virtual");
+    CMemorySlab slab;
+
+    benchallocator_t allocators[] = {
+        {"system", true, true, System_Malloc, System_Free, NULL, NULL, NULL},
+        // общая зона менеджера памяти не берёт блокировок, в crossthread её не пускаем
+        {"general", true, false, General_Malloc, General_Free, NULL, NULL, NULL},
+        {"general_debug", true, false, General_MallocDebug, General_Free, NULL, NULL, NULL},
+        {"zone", pZone != NULL, false, Zone_Malloc, Zone_Free, pZone, NULL, NULL},
+        {"zone_debug", pZone != NULL, false, Zone_MallocDebug, Zone_Free, pZone, NULL, NULL},
+        {"zone_tlsf", bTlsf, false, MemoryZone_Malloc, MemoryZone_Free, NULL, &tlsfZone, NULL},
+        {"zone_virtual", bVirtual, false, MemoryZone_Malloc, MemoryZone_Free, NULL, &virtualZone, NULL},
+        {"slab", true, true, Slab_Malloc, Slab_Free, NULL, NULL, &slab},
+    };
+
+    std::vector<benchresult_t> results;
+    for (size_t i = 0; i < sizeof(allocators) / sizeof(allocators[0]); i++)
+    {
+        benchallocator_t *pAllocator = &allocators[i];
+        if (!pAllocator->m_bAvailable)
+            continue;
+
+        for (int iScenario = 0; iScenario < 5; iScenario++)
+        {
+            static const char *s_pszScenarios[] = {"fixed", "random", "crossthread", "fragment", "trace"};
+            if (iScenario == 2 && !pAllocator->m_bThreadSafe)
+                continue;
+            if (iScenario == 4 && traceOps.empty())
+                continue;
+
+            benchresult_t result;
+            result.m_strScenario = s_pszScenarios[iScenario];
+            result.m_strAllocator = pAllocator->m_pszName;
+            result.m_nFailed = 0;
+
+            Bench_ResetPeakRSS();
+            switch (iScenario)
+            {
+            case 0:
+                Bench_Churn(pAllocator, nOps, false, iSeed, result);
+                break;
+            case 1:
+                Bench_Churn(pAllocator, nOps, true, iSeed, result);
+                break;
+            case 2:
+                Bench_CrossThread(pAllocator, nOps, iSeed, result);
+                break;
+            case 3:
+                Bench_Fragment(pAllocator, nOps, iSeed, result);
+                break;
+            case 4:
+                Bench_Trace(pAllocator, traceOps, nTraceMaxId, result);
+                break;
+            }
+            result.m_nPeakRSS = Bench_PeakRSS();
+            results.push_back(result);
+
+            common()->Print("%-12s %-14s %10.0f ops/s  p50 %u ns  p99 %u ns  p999 %u ns\n",
+                            result.m_strScenario.c_str(), result.m_strAllocator.c_str(),
+                            result.m_flSeconds > 0 ? result.m_nOps / result.m_flSeconds : 0, result.m_nP50,
+                            result.m_nP99, result.m_nP999);
+        }
+    }
+
+    FILE *f = pszOutput ? fopen(pszOutput, "w") : stdout;
+    if (f)
+    {
+        Bench_WriteJSON(f, results);
+        if (f != stdout)
+            fclose(f);
+    }
+
+    slab.Shutdown();
+    virtualZone.Destroy();
+    tlsfZone.Destroy();
+    if (pZone)
+        g_pMemoryManager->ReleaseZoneMemory(pZone);
+    common()->Shutdown();
+    return 0;
+}
@@ -0,0 +1,210 @@
+/*
+  This file associated with Hayato Labs project.
+
+  For license and copyright information please follow this link:
+  https://github.com/hayatolabs/general/blob/main/LEGAL
+*/
+
+/*
+===========================================================================
+
+   huffbench - скорость статического Хаффмана: побайтовые
+   HuffmanPutSymbol/HuffmanGetSymbol и MSG_WriteData/MSG_ReadByte
+   против пакетных HuffmanEncodeBytes/HuffmanDecodeBytes и
+   MSG_WriteHuffmanData/MSG_ReadHuffmanData.
+
+   huffbench [-size <bytes>] [-iterations <n>] [-out <file.json>]
+
+   Перед замерами проверяет, что оба пути дают одинаковый поток бит,
+   при расхождении завершается с кодом 1.
+
+===========================================================================
+*/
+
+#include "common/huffman.h"
+
+#include <chrono>
+#include <random>
+#include <vector>
+
+#define HUFFBENCH_DEFAULT_SIZE 1400 // типичный размер пакета
+#define HUFFBENCH_DEFAULT_ITERATIONS 20000
+
+struct huffbenchresult_t
+{
+    const char *m_pszCase;
+    const char *m_pszData;
+    double m_flMBps;
+    double m_flNsPerByte;
+};
+
+static double Bench_Seconds()
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// Данные, похожие на снапшоты: много нулей и мелких чисел, изредка произвольные байты
+static void Bench_MakeData(std::vector<ubyte> &data, bool bSkewed, uint32 iSeed)
+{
+    std::mt19937 random(iSeed);
+    for (size_t i = 0; i < data.size(); i++)
+    {
+        if (!bSkewed)
+            data[i] = (ubyte)random();
+        else if (random() % 4)
+            data[i] = (ubyte)(random() % 8);
+        else
+            data[i] = (ubyte)random();
+    }
+}
+
+static bool Bench_Verify(const std::vector<ubyte> &data)
+{
+    std::vector<ubyte> reference(data.size() * 2 + 16, 0), packed(data.size() * 2 + 16, 0);
+
+    int iBit = 3; // начинаем с середины байта, как после MSG_WriteBits(msg, x, 3)
+    for (size_t i = 0; i < data.size(); i++)
+        iBit += HuffmanPutSymbol(reference.data(), iBit, data[i]);
+
+    int iPackedBit = HuffmanEncodeBytes(packed.data(), (int)packed.size(), 3, data.data(), (int)data.size());
+    if (iPackedBit != iBit || reference != packed)
+        return false;
+
+    std::vector<ubyte> decoded(data.size());
+    if (HuffmanDecodeBytes(decoded.data(), (int)data.size(), packed.data(), (int)packed.size(), 3) != iBit)
+        return false;
+    return decoded == data;
+}
+
+int main(int argc, char **argv)
+{
+    int nSize = HUFFBENCH_DEFAULT_SIZE;
+    int nIterations = HUFFBENCH_DEFAULT_ITERATIONS;
+    const char *pszOutput = NULL;
+
+    for (int i = 1; i + 1 < argc; i += 2)
+    {
+        if (!strcmp(argv[i], "-size"))
+            nSize = atoi(argv[i + 1]);
+        else if (!strcmp(argv[i], "-iterations"))
+            nIterations = atoi(argv[i + 1]);
+        else if (!strcmp(argv[i], "-out"))
+            pszOutput = argv[i + 1];
+    }
+
+    std::vector<huffbenchresult_t> results;
+    std::vector<ubyte> data(nSize), decoded(nSize);
+    std::vector<ubyte> buffer(nSize * 2 + 16);
+
+    for (int iData = 0; iData < 2; iData++)
+    {
+        const char *pszData = iData ? "random" : "skewed";
+        Bench_MakeData(data, iData == 0, 1);
+        if (!Bench_Verify(data))
+        {
+            fprintf(stderr, "huffbench: bit stream mismatch on %s data\n", pszData);
+            return 1;
+        }
+
+        for (int iCase = 0; iCase < 8; iCase++)
+        {
+            static const char *s_pszCases[] = {"putsymbol", "encodebytes",      "getsymbol", "decodebytes",
+                                               "msg_write", "msg_writehuffman", "msg_read",  "msg_readhuffman"};
+            volatile uint32 nSink = 0;
+            double flStart = Bench_Seconds();
+
+            for (int iIteration = 0; iIteration < nIterations; iIteration++)
+            {
+                switch (iCase)
+                {
+                case 0: {
+                    memset(buffer.data(), 0, buffer.size());
+                    int iBit = 0;
+                    for (int i = 0; i < nSize; i++)
+                        iBit += HuffmanPutSymbol(buffer.data(), iBit, data[i]);
+                    nSink += iBit;
+                    break;
+                }
+                case 1:
+                    nSink += HuffmanEncodeBytes(buffer.data(), (int)buffer.size(), 0, data.data(), nSize);
+                    break;
+                case 2: {
+                    int iBit = 0;
+                    for (int i = 0; i < nSize; i++)
+                    {
+                        unsigned int iSymbol;
+                        iBit += HuffmanGetSymbol(&iSymbol, buffer.data(), iBit);
+                        decoded[i] = (ubyte)iSymbol;
+                    }
+                    nSink += iBit;
+                    break;
+                }
+                case 3:
+                    nSink += HuffmanDecodeBytes(decoded.data(), nSize, buffer.data(), (int)buffer.size(), 0);
+                    break;
+                case 4: {
+                    msg_t msg;
+                    MSG_Init(&msg, buffer.data(), (int)buffer.size());
+                    MSG_WriteData(&msg, data.data(), nSize);
+                    nSink += msg.nCursize;
+                    break;
+                }
+                case 5: {
+                    msg_t msg;
+                    MSG_Init(&msg, buffer.data(), (int)buffer.size());
+                    MSG_WriteHuffmanData(&msg, data.data(), nSize);
+                    nSink += msg.nCursize;
+                    break;
+                }
+                case 6: {
+                    msg_t msg;
+                    MSG_Init(&msg, buffer.data(), (int)buffer.size());
+                    msg.nCursize = msg.nMaxsize;
+                    MSG_BeginReading(&msg);
+                    for (int i = 0; i < nSize; i++)
+                        decoded[i] = (ubyte)MSG_ReadByte(&msg);
+                    nSink += msg.nReadCount;
+                    break;
+                }
+                case 7: {
+                    msg_t msg;
+                    MSG_Init(&msg, buffer.data(), (int)buffer.size());
+                    msg.nCursize = msg.nMaxsize;
+                    MSG_BeginReading(&msg);
+                    MSG_ReadHuffmanData(&msg, decoded.data(), nSize);
+                    nSink += msg.nReadCount;
+                    break;
+                }
+                }
+            }
+
+            double flSeconds = Bench_Seconds() - flStart;
+            double flBytes = (double)nSize * nIterations;
+
+            huffbenchresult_t result;
+            result.m_pszCase = s_pszCases[iCase];
+            result.m_pszData = pszData;
+            result.m_flMBps = flSeconds > 0 ? flBytes / flSeconds / (1024.0 * 1024.0) : 0;
+            result.m_flNsPerByte = flBytes > 0 ? flSeconds * 1e9 / flBytes : 0;
+            results.push_back(result);
+        }
+    }
+
+    FILE *f = pszOutput ? fopen(pszOutput, "w") : stdout;
+    if (!f)
+        return 1;
+
+    fprintf(f, "{\n  \"benchmark\": \"huffbench\",\n  \"size\": %d,\n  \"iterations\": %d,\n  \"results\": [\n", nSize,
+            nIterations);
+    for (size_t i = 0; i < results.size(); i++)
+    {
+        fprintf(f, "    {\"case\": \"%s\", \"data\": \"%s\", \"mb_per_sec\": %.1f, \"ns_per_byte\": %.3f}%s\n",
+                results[i].m_pszCase, results[i].m_pszData, results[i].m_flMBps, results[i].m_flNsPerByte,
+                i + 1 < results.size() ? "," : "");
+    }
+    fprintf(f, "  ]\n}\n");
+
+    if (f != stdout)
+        fclose(f);
+    return 0;
+}
@@ -0,0 +1,940 @@
+/*
+  This file associated with Hayato Labs project.
+
+  For license and copyright information please follow this link:
+  https://github.com/hayatolabs/general/blob/main/LEGAL
+*/
+
+/*
+===========================================================================
+
+   msgbench - скорость сериализации и сжатия сетевых сообщений
+
+   msgbench [-corpus <capture>] [-packets <n>] [-iterations <n>]
+            [-seed <n>] [-out <file.json>]
+
+   Группы замеров:
+      msg      - все MSG_Write и MSG_Read в обычном и out-of-band режиме
+      package  - битовый ввод-вывод CBinaryPackage
+      compress - Huff_Compress/Huff_Decompress, CHuffmanAdaptive, rANS
+                 и статический Хаффман на корпусе пакетов
+
+   Корпус - запись EntropyTrainer_WriteCapture (-corpus) или
+   синтетические снапшоты: заголовок, дельты сущностей и изредка
+   строковые команды. Перед замером каждый случай проверяется на
+   обратимость, при расхождении msgbench завершается с кодом 1.
+
+   Результат - JSON: ns_per_op (одна операция - одно значение для
+   msg/package, один пакет для compress), mb_per_sec по байтам
+   сообщения и ratio - размер в сообщении к исходному размеру.
+
+===========================================================================
+*/
+
+#include "common/binary_package.h"
+#include "common/huffman.h"
+#include "common/msgbatch.h"
+#include "common/rans.h"
+
+#include <chrono>
+#include <random>
+#include <string>
+#include <vector>
+
+#define MSGBENCH_DEFAULT_PACKETS 512
+#define MSGBENCH_DEFAULT_ITERATIONS 50
+#define MSGBENCH_VALUES 4096          // значений в одном прогоне msg/package
+#define MSGBENCH_STRINGS 256          // строк в одном прогоне
+#define MSGBENCH_BUFFER_SIZE (1 << 20) // хватает на любой прогон
+#define MSGBENCH_MAX_PACKET 1400
+
+struct msgbenchresult_t
+{
+    const char *m_pszGroup;
+    char m_szCase[32];
+    const char *m_pszMode;
+    double m_flNsPerOp;
+    double m_flMBps;
+    double m_flRatio;
+};
+
+struct msgbenchvalues_t
+{
+    int m_Widths[MSGBENCH_VALUES]; // 1..32 для MSG_WriteBits
+    int m_Bits[MSGBENCH_VALUES];
+    int m_Ints[MSGBENCH_VALUES];
+    uint32 m_Small[MSGBENCH_VALUES]; // экспоненциально распределённые, для varint и gamma
+    float m_Floats[MSGBENCH_VALUES];
+    std::vector<std::string> m_Strings;
+};
+
+static double Bench_Seconds()
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static void Bench_AddResult(std::vector<msgbenchresult_t> &results, const char *pszGroup, const char *pszCase,
+                            const char *pszMode, double flSeconds, double flOps, double flBytes, double flRatio)
+{
+    msgbenchresult_t result;
+    result.m_pszGroup = pszGroup;
+    snprintf(result.m_szCase, sizeof(result.m_szCase), "%s", pszCase);
+    result.m_pszMode = pszMode;
+    result.m_flNsPerOp = flOps > 0 ? flSeconds * 1e9 / flOps : 0;
+    result.m_flMBps = flSeconds > 0 ? flBytes / flSeconds / (1024.0 * 1024.0) : 0;
+    result.m_flRatio = flRatio;
+    results.push_back(result);
+}
+
+static void Bench_MakeValues(msgbenchvalues_t &values, uint32 iSeed)
+{
+    std::mt19937 random(iSeed);
+    std::exponential_distribution<double> small(1.0 / 40);
+
+    for (int i = 0; i < MSGBENCH_VALUES; i++)
+    {
+        values.m_Widths[i] = 1 + random() % 32;
+        values.m_Bits[i] = (int)(random() & BitMask32(values.m_Widths[i]));
+        values.m_Ints[i] = (int)random();
+        values.m_Small[i] = (uint32)small(random);
+        values.m_Floats[i] = (float)((int)(random() % 200000) - 100000) / 16.0f;
+    }
+
+    values.m_Strings.resize(MSGBENCH_STRINGS);
+    for (int i = 0; i < MSGBENCH_STRINGS; i++)
+    {
+        int nLength = 4 + random() % 40;
+        for (int j = 0; j < nLength; j++)
+            values.m_Strings[i] += (char)('a' + random() % 26);
+    }
+}
+
+/*
+===========================================================================
+
+   Корпус пакетов
+
+===========================================================================
+*/
+
+// Похоже на снапшот сервера: номера пакетов, маска изменённых полей
+// и мелкие дельты координат, изредка строковая команда
+static void Bench_MakePacket(std::vector<ubyte> &packet, std::mt19937 &random, int iSequence)
+{
+    ubyte buffer[MSGBENCH_MAX_PACKET + 256];
+    msg_t msg;
+    MSG_InitOOB(&msg, buffer, sizeof(buffer));
+
+    MSG_WriteLong(&msg, iSequence);
+    MSG_WriteLong(&msg, iSequence - 1 - random() % 3);
+    MSG_WriteByte(&msg, 7); // снапшот
+    MSG_WriteLong(&msg, iSequence * 50);
+
+    if (random() % 8 == 0)
+    {
+        char szCommand[128];
+        snprintf(szCommand, sizeof(szCommand), "cs %u \"models/players/unit%u/model.md3\"", (uint32)random() % 64,
+                 (uint32)random() % 16);
+        MSG_WriteByte(&msg, 5);
+        MSG_WriteString(&msg, szCommand);
+    }
+
+    int nEntities = 1 + random() % 48;
+    int iEntity = 0;
+    MSG_WriteByte(&msg, nEntities);
+    for (int i = 0; i < nEntities && msg.nCursize < MSGBENCH_MAX_PACKET; i++)
+    {
+        // сущности идут по возрастанию номера, как в дельте снапшота
+        int iFields = random() & random() & 0xFF;
+        iEntity += 1 + random() % 8;
+        MSG_WriteShort(&msg, iEntity);
+        MSG_WriteByte(&msg, iFields);
+        for (int iField = 0; iField < 8; iField++)
+        {
+            if (!(iFields & BIT(iField)))
+                continue;
+            if (random() % 16)
+                MSG_WriteShort(&msg, (int)(random() % 64) - 32);
+            else
+                MSG_WriteLong(&msg, (int)random());
+        }
+    }
+
+    packet.assign(buffer, buffer + msg.nCursize);
+}
+
+static bool Bench_ReadCorpus(const char *pszFilename, std::vector<std::vector<ubyte>> &corpus)
+{
+    FILE *f = fopen(pszFilename, "rb");
+    if (!f)
+        return false;
+
+    bool bOk = true;
+    ubyte header[4];
+    while (bOk && fread(header, 1, 4, f) == 4)
+    {
+        uint32 nLength = header[0] | (header[1] << 8) | (header[2] << 16) | ((uint32)header[3] << 24);
+        if (nLength > MSGCODER_MAX_SIZE - 1)
+        {
+            bOk = false;
+            break;
+        }
+
+        std::vector<ubyte> packet(nLength);
+        bOk = fread(packet.data(), 1, nLength, f) == nLength;
+        if (nLength)
+            corpus.push_back(packet);
+    }
+
+    bOk = bOk && !ferror(f);
+    fclose(f);
+    return bOk;
+}
+
+/*
+===========================================================================
+
+   msg: примитивы MSG_Write и MSG_Read
+
+===========================================================================
+*/
+enum msgprimitive_t
+{
+    MSGBENCH_BITS,
+    MSGBENCH_CHAR,
+    MSGBENCH_BYTE,
+    MSGBENCH_SHORT,
+    MSGBENCH_LONG,
+    MSGBENCH_FLOAT,
+    MSGBENCH_STRING,
+    MSGBENCH_BIGSTRING,
+    MSGBENCH_VECTOR2,
+    MSGBENCH_BOUNDS2,
+    MSGBENCH_DATA,
+    MSGBENCH_HUFFMANDATA,
+    MSGBENCH_VARUINT,
+    MSGBENCH_VARINT,
+    MSGBENCH_GAMMA,
+    MSGBENCH_PRIMITIVES
+};
+
+static const char *s_pszPrimitives[MSGBENCH_PRIMITIVES] = {
+    "bits",  "char",   "byte",    "short", "long",        "float",   "string", "bigstring",
+    "vector2", "bounds2", "data", "huffmandata", "varuint", "varint", "gamma",
+};
+
+static int Bench_PrimitiveCount(int iPrimitive)
+{
+    switch (iPrimitive)
+    {
+    case MSGBENCH_STRING:
+    case MSGBENCH_BIGSTRING:
+        return MSGBENCH_STRINGS;
+    case MSGBENCH_VECTOR2:
+        return MSGBENCH_VALUES / 2;
+    case MSGBENCH_BOUNDS2:
+        return MSGBENCH_VALUES / 4;
+    default:
+        return MSGBENCH_VALUES;
+    }
+}
+
+// исходный размер значений в байтах, для ratio
+static double Bench_PrimitiveRawBytes(int iPrimitive, const msgbenchvalues_t &values)
+{
+    double flBytes = 0;
+    switch (iPrimitive)
+    {
+    case MSGBENCH_BITS:
+        for (int i = 0; i < MSGBENCH_VALUES; i++)
+            flBytes += values.m_Widths[i] / 8.0;
+        return flBytes;
+    case MSGBENCH_STRING:
+    case MSGBENCH_BIGSTRING:
+        for (int i = 0; i < MSGBENCH_STRINGS; i++)
+            flBytes += values.m_Strings[i].size() + 1;
+        return flBytes;
+    case MSGBENCH_CHAR:
+    case MSGBENCH_BYTE:
+    case MSGBENCH_DATA:
+    case MSGBENCH_HUFFMANDATA:
+        return MSGBENCH_VALUES;
+    case MSGBENCH_SHORT:
+        return MSGBENCH_VALUES * 2.0;
+    default:
+        return MSGBENCH_VALUES * 4.0;
+    }
+}
+
+static bool Bench_PrimitiveSupported(int iPrimitive, bool bOOB)
+{
+    // out-of-band пишет только целые байты, поля произвольной ширины там недоступны
+    return !bOOB || iPrimitive != MSGBENCH_BITS;
+}
+
+static void Bench_WritePrimitive(msg_t *msg, int iPrimitive, const msgbenchvalues_t &values)
+{
+    int nCount = Bench_PrimitiveCount(iPrimitive);
+    switch (iPrimitive)
+    {
+    case MSGBENCH_BITS:
+        for (int i = 0; i < nCount; i++)
+            MSG_WriteBits(msg, values.m_Bits[i], values.m_Widths[i]);
+        break;
+    case MSGBENCH_CHAR:
+        for (int i = 0; i < nCount; i++)
+            MSG_WriteChar(msg, (int8)values.m_Ints[i]);
+        break;
+    case MSGBENCH_BYTE:
+        for (int i = 0; i < nCount; i++)
+            MSG_WriteByte(msg, (ubyte)values.m_Ints[i]);
+        break;
+    case MSGBENCH_SHORT:
+        for (int i = 0; i < nCount; i++)
+            MSG_WriteShort(msg, (int16)values.m_Ints[i]);
+        break;
+    case MSGBENCH_LONG:
+        for (int i = 0; i < nCount; i++)
+            MSG_WriteLong(msg, values.m_Ints[i]);
+        break;
+    case MSGBENCH_FLOAT:
+        for (int i = 0; i < nCount; i++)
+            MSG_WriteFloat(msg, values.m_Floats[i]);
+        break;
+    case MSGBENCH_STRING:
+        for (int i = 0; i < nCount; i++)
+            MSG_WriteString(msg, values.m_Strings[i].c_str());
+        break;
+    case MSGBENCH_BIGSTRING:
+        for (int i = 0; i < nCount; i++)
+            MSG_WriteBigString(msg, values.m_Strings[i].c_str());
+        break;
+    case MSGBENCH_VECTOR2:
+        for (int i = 0; i < nCount; i++)
+            MSG_WriteVector2(msg, vec2_t(values.m_Floats[i * 2], values.m_Floats[i * 2 + 1]));
+        break;
+    case MSGBENCH_BOUNDS2:
+        for (int i = 0; i < nCount; i++)
+        {
+            const float *p = values.m_Floats + i * 4;
+            MSG_WriteBounds2(msg, bounds2d_t(vec2_t(p[0], p[1]), vec2_t(p[2], p[3])));
+        }
+        break;
+    case MSGBENCH_DATA:
+        MSG_WriteData(msg, values.m_Ints, nCount);
+        break;
+    case MSGBENCH_HUFFMANDATA:
+        MSG_WriteHuffmanData(msg, values.m_Ints, nCount);
+        break;
+    case MSGBENCH_VARUINT:
+        for (int i = 0; i < nCount; i++)
+            MSG_WriteVarUInt(msg, values.m_Small[i]);
+        break;
+    case MSGBENCH_VARINT:
+        for (int i = 0; i < nCount; i++)
+            MSG_WriteVarInt(msg, (i & 1) ? -(int)values.m_Small[i] : (int)values.m_Small[i]);
+        break;
+    case MSGBENCH_GAMMA:
+        for (int i = 0; i < nCount; i++)
+            MSG_WriteGamma(msg, values.m_Small[i]);
+        break;
+    }
+}
+
+// bVerify - сверять прочитанное с исходным, иначе только копить в nSink
+static bool Bench_ReadPrimitive(msg_t *msg, int iPrimitive, const msgbenchvalues_t &values, bool bVerify,
+                                uint32 &nSink)
+{
+    int nCount = Bench_PrimitiveCount(iPrimitive);
+    bool bOk = true;
+    switch (iPrimitive)
+    {
+    case MSGBENCH_BITS: {
+        // MSG_nReadBits библиотека не экспортирует, биты читаются через CMsgBitReader
+        CMsgBitReader reader(msg);
+        for (int i = 0; i < nCount; i++)
+        {
+            int iValue = reader.ReadBits(values.m_Widths[i]);
+            bOk &= !bVerify || (uint32)iValue == (uint32)values.m_Bits[i];
+            nSink += iValue;
+        }
+        reader.End();
+        break;
+    }
+    case MSGBENCH_CHAR:
+        for (int i = 0; i < nCount; i++)
+        {
+            int iValue = MSG_ReadChar(msg);
+            bOk &= !bVerify || iValue == (int8)values.m_Ints[i];
+            nSink += iValue;
+        }
+        break;
+    case MSGBENCH_BYTE:
+        for (int i = 0; i < nCount; i++)
+        {
+            int iValue = MSG_ReadByte(msg);
+            bOk &= !bVerify || iValue == (ubyte)values.m_Ints[i];
+            nSink += iValue;
+        }
+        break;
+    case MSGBENCH_SHORT:
+        for (int i = 0; i < nCount; i++)
+        {
+            int iValue = MSG_ReadShort(msg);
+            bOk &= !bVerify || iValue == (int16)values.m_Ints[i];
+            nSink += iValue;
+        }
+        break;
+    case MSGBENCH_LONG:
+        for (int i = 0; i < nCount; i++)
+        {
+            int iValue = MSG_ReadLong(msg);
+            bOk &= !bVerify || iValue == values.m_Ints[i];
+            nSink += iValue;
+        }
+        break;
+    case MSGBENCH_FLOAT:
+        for (int i = 0; i < nCount; i++)
+        {
+            float flValue = MSG_ReadFloat(msg);
+            bOk &= !bVerify || flValue == values.m_Floats[i];
+            nSink += (uint32)flValue;
+        }
+        break;
+    case MSGBENCH_STRING:
+    case MSGBENCH_BIGSTRING:
+        for (int i = 0; i < nCount; i++)
+        {
+            const char *pszValue = iPrimitive == MSGBENCH_STRING ? MSG_ReadString(msg) : MSG_ReadBigString(msg);
+            bOk &= !bVerify || !strcmp(pszValue, values.m_Strings[i].c_str());
+            nSink += (ubyte)pszValue[0];
+        }
+        break;
+    case MSGBENCH_VECTOR2:
+        for (int i = 0; i < nCount; i++)
+        {
+            vec2_t vec;
+            MSG_ReadVector2(msg, vec);
+            bOk &= !bVerify || (vec.x() == values.m_Floats[i * 2] && vec.y() == values.m_Floats[i * 2 + 1]);
+            nSink += (uint32)vec.x();
+        }
+        break;
+    case MSGBENCH_BOUNDS2:
+        for (int i = 0; i < nCount; i++)
+        {
+            const float *p = values.m_Floats + i * 4;
+            bounds2d_t bounds;
+            MSG_ReadBounds2(msg, bounds);
+            if (bVerify)
+            {
+                vec2_t vecOrigin = bounds.Origin(), vecSize = bounds.Size();
+                bOk &= vecOrigin.x() == p[0] && vecOrigin.y() == p[1] && vecSize.x() == p[2] && vecSize.y() == p[3];
+            }
+            nSink += i;
+        }
+        break;
+    case MSGBENCH_DATA:
+    case MSGBENCH_HUFFMANDATA: {
+        ubyte data[MSGBENCH_VALUES];
+        if (iPrimitive == MSGBENCH_DATA)
+            MSG_pReadData(msg, data, nCount);
+        else
+            MSG_ReadHuffmanData(msg, data, nCount);
+        bOk &= !bVerify || !memcmp(data, values.m_Ints, nCount);
+        nSink += data[0];
+        break;
+    }
+    case MSGBENCH_VARUINT:
+        for (int i = 0; i < nCount; i++)
+        {
+            uint32 iValue = MSG_ReadVarUInt(msg);
+            bOk &= !bVerify || iValue == values.m_Small[i];
+            nSink += iValue;
+        }
+        break;
+    case MSGBENCH_VARINT:
+        for (int i = 0; i < nCount; i++)
+        {
+            int iValue = MSG_ReadVarInt(msg);
+            bOk &= !bVerify || iValue == ((i & 1) ? -(int)values.m_Small[i] : (int)values.m_Small[i]);
+            nSink += iValue;
+        }
+        break;
+    case MSGBENCH_GAMMA:
+        for (int i = 0; i < nCount; i++)
+        {
+            uint32 iValue = MSG_ReadGamma(msg);
+            bOk &= !bVerify || iValue == values.m_Small[i];
+            nSink += iValue;
+        }
+        break;
+    }
+    return bOk;
+}
+
+static void Bench_BeginMsg(msg_t *msg, ubyte *pBuffer, bool bOOB)
+{
+    if (bOOB)
+        MSG_InitOOB(msg, pBuffer, MSGBENCH_BUFFER_SIZE);
+    else
+        MSG_Init(msg, pBuffer, MSGBENCH_BUFFER_SIZE);
+}
+
+static bool Bench_Primitives(std::vector<msgbenchresult_t> &results, const msgbenchvalues_t &values,
+                             int nIterations)
+{
+    std::vector<ubyte> buffer(MSGBENCH_BUFFER_SIZE);
+    volatile uint32 nVolatileSink = 0;
+
+    for (int iMode = 0; iMode < 2; iMode++)
+    {
+        bool bOOB = iMode != 0;
+        const char *pszMode = bOOB ? "oob" : "huffman";
+
+        for (int iPrimitive = 0; iPrimitive < MSGBENCH_PRIMITIVES; iPrimitive++)
+        {
+            if (!Bench_PrimitiveSupported(iPrimitive, bOOB))
+                continue;
+
+            msg_t msg;
+            Bench_BeginMsg(&msg, buffer.data(), bOOB);
+            Bench_WritePrimitive(&msg, iPrimitive, values);
+
+            msg_t written = msg;
+            uint32 nSink = 0;
+            if (bOOB)
+                MSG_BeginReadingOOB(&msg);
+            else
+                MSG_BeginReading(&msg);
+            if (msg.bOverflowed || !Bench_ReadPrimitive(&msg, iPrimitive, values, true, nSink))
+            {
+                fprintf(stderr, "msgbench: %s %s does not round-trip\n", s_pszPrimitives[iPrimitive], pszMode);
+                return false;
+            }
+
+            double flOps = (double)Bench_PrimitiveCount(iPrimitive) * nIterations;
+            double flBytes = (double)written.nCursize * nIterations;
+            double flRatio = written.nCursize / Bench_PrimitiveRawBytes(iPrimitive, values);
+
+            double flStart = Bench_Seconds();
+            for (int iIteration = 0; iIteration < nIterations; iIteration++)
+            {
+                Bench_BeginMsg(&msg, buffer.data(), bOOB);
+                Bench_WritePrimitive(&msg, iPrimitive, values);
+                nSink += msg.nCursize;
+            }
+            double flWrite = Bench_Seconds() - flStart;
+
+            flStart = Bench_Seconds();
+            for (int iIteration = 0; iIteration < nIterations; iIteration++)
+            {
+                msg = written;
+                if (bOOB)
+                    MSG_BeginReadingOOB(&msg);
+                else
+                    MSG_BeginReading(&msg);
+                Bench_ReadPrimitive(&msg, iPrimitive, values, false, nSink);
+            }
+            double flRead = Bench_Seconds() - flStart;
+            nVolatileSink += nSink;
+
+            char szCase[32];
+            snprintf(szCase, sizeof(szCase), "write%s", s_pszPrimitives[iPrimitive]);
+            Bench_AddResult(results, "msg", szCase, pszMode, flWrite, flOps, flBytes, flRatio);
+            snprintf(szCase, sizeof(szCase), "read%s", s_pszPrimitives[iPrimitive]);
+            Bench_AddResult(results, "msg", szCase, pszMode, flRead, flOps, flBytes, flRatio);
+        }
+    }
+    return true;
+}
+
+/*
+===========================================================================
+
+   package: битовый ввод-вывод CBinaryPackage
+
+===========================================================================
+*/
+enum packagecase_t
+{
+    PACKAGEBENCH_BITS,      // WriteBits/nReadBits
+    PACKAGEBENCH_INT32,     // WriteInt32/ReadInt32
+    PACKAGEBENCH_FLOAT,     // WriteFloat/ReadFloat
+    PACKAGEBENCH_BITWRITER, // CBitWriter/CBitReader через BeginBitWriting
+    PACKAGEBENCH_VARUINT,   // WriteVarUInt32/ReadVarUInt32
+    PACKAGEBENCH_VARARRAY,  // WriteVarUInt32/ReadVarUInt32Array
+    PACKAGEBENCH_CASES
+};
+
+static const char *s_pszPackageCases[PACKAGEBENCH_CASES] = {"bits",      "int32",   "float",
+                                                            "bitwriter", "varuint", "varuintarray"};
+
+static void Bench_WritePackage(CBinaryPackage &package, int iCase, const msgbenchvalues_t &values)
+{
+    switch (iCase)
+    {
+    case PACKAGEBENCH_BITS:
+        for (int i = 0; i < MSGBENCH_VALUES; i++)
+            package.WriteBits(values.m_Bits[i], values.m_Widths[i]);
+        break;
+    case PACKAGEBENCH_INT32:
+        for (int i = 0; i < MSGBENCH_VALUES; i++)
+            package.WriteInt32(values.m_Ints[i]);
+        break;
+    case PACKAGEBENCH_FLOAT:
+        for (int i = 0; i < MSGBENCH_VALUES; i++)
+            package.WriteFloat(values.m_Floats[i]);
+        break;
+    case PACKAGEBENCH_BITWRITER: {
+        CBitWriter writer;
+        package.BeginBitWriting(writer);
+        for (int i = 0; i < MSGBENCH_VALUES; i++)
+            writer.WriteBits(values.m_Bits[i], values.m_Widths[i]);
+        package.EndBitWriting(writer);
+        break;
+    }
+    case PACKAGEBENCH_VARUINT:
+    case PACKAGEBENCH_VARARRAY:
+        for (int i = 0; i < MSGBENCH_VALUES; i++)
+            package.WriteVarUInt32(values.m_Small[i]);
+        break;
+    }
+}
+
+static bool Bench_ReadPackage(const CBinaryPackage &package, int iCase, const msgbenchvalues_t &values, bool bVerify,
+                              uint32 &nSink)
+{
+    bool bOk = true;
+    switch (iCase)
+    {
+    case PACKAGEBENCH_BITS:
+        for (int i = 0; i < MSGBENCH_VALUES; i++)
+        {
+            int iValue = package.nReadBits(values.m_Widths[i]);
+            bOk &= !bVerify || (uint32)iValue == (uint32)values.m_Bits[i];
+            nSink += iValue;
+        }
+        break;
+    case PACKAGEBENCH_INT32:
+        for (int i = 0; i < MSGBENCH_VALUES; i++)
+        {
+            int32 iValue;
+            package.ReadInt32(iValue);
+            bOk &= !bVerify || iValue == values.m_Ints[i];
+            nSink += iValue;
+        }
+        break;
+    case PACKAGEBENCH_FLOAT:
+        for (int i = 0; i < MSGBENCH_VALUES; i++)
+        {
+            float flValue;
+            package.ReadFloat(flValue);
+            bOk &= !bVerify || flValue == values.m_Floats[i];
+            nSink += (uint32)flValue;
+        }
+        break;
+    case PACKAGEBENCH_BITWRITER: {
+        CBitReader reader;
+        package.BeginBitReading(reader);
+        for (int i = 0; i < MSGBENCH_VALUES; i++)
+        {
+            uint32 iValue = reader.ReadBits(values.m_Widths[i]);
+            bOk &= !bVerify || iValue == (uint32)values.m_Bits[i];
+            nSink += iValue;
+        }
+        bOk &= !reader.IsOverflowed();
+        package.EndBitReading(reader);
+        break;
+    }
+    case PACKAGEBENCH_VARUINT:
+        for (int i = 0; i < MSGBENCH_VALUES; i++)
+        {
+            uint32 iValue;
+            package.ReadVarUInt32(iValue);
+            bOk &= !bVerify || iValue == values.m_Small[i];
+            nSink += iValue;
+        }
+        break;
+    case PACKAGEBENCH_VARARRAY: {
+        uint32 decoded[MSGBENCH_VALUES];
+        bOk &= package.ReadVarUInt32Array(decoded, MSGBENCH_VALUES);
+        bOk &= !bVerify || !memcmp(decoded, values.m_Small, sizeof(decoded));
+        nSink += decoded[0];
+        break;
+    }
+    }
+    return bOk;
+}
+
+static bool Bench_Package(std::vector<msgbenchresult_t> &results, const msgbenchvalues_t &values, int nIterations)
+{
+    std::vector<ubyte> buffer(MSGBENCH_BUFFER_SIZE);
+    volatile uint32 nVolatileSink = 0;
+
+    for (int iCase = 0; iCase < PACKAGEBENCH_CASES; iCase++)
+    {
+        CBinaryPackage package(buffer.data(), buffer.size());
+        Bench_WritePackage(package, iCase, values);
+        int nSize = package.GetSize();
+
+        uint32 nSink = 0;
+        CBinaryPackage reader((const ubyte *)buffer.data(), nSize);
+        if (package.IsbOverflowed() || !Bench_ReadPackage(reader, iCase, values, true, nSink))
+        {
+            fprintf(stderr, "msgbench: package %s does not round-trip\n", s_pszPackageCases[iCase]);
+            return false;
+        }
+
+        double flRaw = iCase == PACKAGEBENCH_BITS || iCase == PACKAGEBENCH_BITWRITER
+                           ? Bench_PrimitiveRawBytes(MSGBENCH_BITS, values)
+                           : MSGBENCH_VALUES * 4.0;
+        double flOps = (double)MSGBENCH_VALUES * nIterations;
+        double flBytes = (double)nSize * nIterations;
+
+        double flStart = Bench_Seconds();
+        for (int iIteration = 0; iIteration < nIterations; iIteration++)
+        {
+            package.InitWrite(buffer.data(), buffer.size());
+            Bench_WritePackage(package, iCase, values);
+            nSink += package.GetSize();
+        }
+        double flWrite = Bench_Seconds() - flStart;
+
+        flStart = Bench_Seconds();
+        for (int iIteration = 0; iIteration < nIterations; iIteration++)
+        {
+            reader.InitRead(buffer.data(), nSize);
+            Bench_ReadPackage(reader, iCase, values, false, nSink);
+        }
+        double flRead = Bench_Seconds() - flStart;
+        nVolatileSink += nSink;
+
+        static const char *s_pszWrite[PACKAGEBENCH_CASES] = {"writebits",      "writeint32",     "writefloat",
+                                                             "bitwriter",      "writevaruint32", "writevaruint32"};
+        static const char *s_pszRead[PACKAGEBENCH_CASES] = {"readbits",      "readint32",     "readfloat",
+                                                            "bitreader",     "readvaruint32", "readvaruint32array"};
+        if (iCase != PACKAGEBENCH_VARARRAY)
+            Bench_AddResult(results, "package", s_pszWrite[iCase], "raw", flWrite, flOps, flBytes, nSize / flRaw);
+        Bench_AddResult(results, "package", s_pszRead[iCase], "raw", flRead, flOps, flBytes, nSize / flRaw);
+    }
+    return true;
+}
+
+/*
+===========================================================================
+
+   compress: сжатие пакетов корпуса
+
+===========================================================================
+*/
+enum compresscase_t
+{
+    COMPRESSBENCH_HUFF,     // Huff_Compress/Huff_Decompress
+    COMPRESSBENCH_ADAPTIVE, // CHuffmanAdaptive
+    COMPRESSBENCH_RANS,     // MSG_Compress/MSG_Decompress с MSGCODER_RANS
+    COMPRESSBENCH_STATIC,   // MSG_WriteHuffmanData/MSG_ReadHuffmanData
+    COMPRESSBENCH_CASES
+};
+
+static const char *s_pszCompressCases[COMPRESSBENCH_CASES][2] = {
+    {"huff_compress", "huff_decompress"},
+    {"adaptive_compress", "adaptive_decompress"},
+    {"rans_compress", "rans_decompress"},
+    {"static_encode", "static_decode"},
+};
+
+static void Bench_Compress(int iCase, CHuffmanAdaptive &adaptive, const std::vector<ubyte> &packet, ubyte *pBuffer,
+                           msg_t &msg)
+{
+    MSG_Init(&msg, pBuffer, MSGCODER_MAX_SIZE + 16);
+    switch (iCase)
+    {
+    case COMPRESSBENCH_STATIC:
+        MSG_WriteHuffmanData(&msg, packet.data(), (int)packet.size());
+        return;
+    case COMPRESSBENCH_RANS:
+        msg.iCoder = MSGCODER_RANS;
+        break;
+    }
+
+    memcpy(pBuffer, packet.data(), packet.size());
+    msg.nCursize = (int)packet.size();
+    if (iCase == COMPRESSBENCH_ADAPTIVE)
+        adaptive.Compress(&msg, 0);
+    else
+        MSG_Compress(&msg, 0);
+}
+
+static bool Bench_Decompress(int iCase, CHuffmanAdaptive &adaptive, const std::vector<ubyte> &packet, msg_t &msg,
+                             ubyte *pDecoded)
+{
+    switch (iCase)
+    {
+    case COMPRESSBENCH_STATIC:
+        MSG_BeginReading(&msg);
+        MSG_ReadHuffmanData(&msg, pDecoded, (int)packet.size());
+        return true;
+    case COMPRESSBENCH_ADAPTIVE:
+        return adaptive.Decompress(&msg, 0);
+    default:
+        return MSG_Decompress(&msg, 0);
+    }
+}
+
+static bool Bench_Corpus(std::vector<msgbenchresult_t> &results, const std::vector<std::vector<ubyte>> &corpus,
+                         int nIterations)
+{
+    std::vector<ubyte> buffer(MSGCODER_MAX_SIZE + 16), decoded(MSGCODER_MAX_SIZE + 16);
+    std::vector<std::vector<ubyte>> packed(corpus.size());
+    std::vector<msg_t> headers(corpus.size());
+    CHuffmanAdaptive *pAdaptive = new CHuffmanAdaptive; // таблицы узлов не для стека
+    volatile uint32 nSink = 0;
+
+    double flRawBytes = 0;
+    for (size_t i = 0; i < corpus.size(); i++)
+        flRawBytes += corpus[i].size();
+
+    for (int iCase = 0; iCase < COMPRESSBENCH_CASES; iCase++)
+    {
+        // проверка и заготовка сжатых пакетов для замера распаковки
+        double flPackedBytes = 0;
+        for (size_t i = 0; i < corpus.size(); i++)
+        {
+            msg_t msg;
+            Bench_Compress(iCase, *pAdaptive, corpus[i], buffer.data(), msg);
+            packed[i].assign(buffer.data(), buffer.data() + msg.nCursize);
+            headers[i] = msg;
+            flPackedBytes += msg.nCursize;
+
+            const ubyte *pDecoded = iCase == COMPRESSBENCH_STATIC ? decoded.data() : buffer.data();
+            if (msg.bOverflowed || !Bench_Decompress(iCase, *pAdaptive, corpus[i], msg, decoded.data()) ||
+                (iCase != COMPRESSBENCH_STATIC && msg.nCursize != (int)corpus[i].size()) ||
+                memcmp(pDecoded, corpus[i].data(), corpus[i].size()))
+            {
+                fprintf(stderr, "msgbench: %s does not round-trip on packet %d\n", s_pszCompressCases[iCase][0],
+                        (int)i);
+                delete pAdaptive;
+                return false;
+            }
+        }
+
+        double flOps = (double)corpus.size() * nIterations;
+        double flBytes = flRawBytes * nIterations;
+        double flRatio = flPackedBytes / flRawBytes;
+
+        double flStart = Bench_Seconds();
+        for (int iIteration = 0; iIteration < nIterations; iIteration++)
+        {
+            for (size_t i = 0; i < corpus.size(); i++)
+            {
+                msg_t msg;
+                Bench_Compress(iCase, *pAdaptive, corpus[i], buffer.data(), msg);
+                nSink += msg.nCursize;
+            }
+        }
+        double flCompress = Bench_Seconds() - flStart;
+
+        flStart = Bench_Seconds();
+        for (int iIteration = 0; iIteration < nIterations; iIteration++)
+        {
+            for (size_t i = 0; i < corpus.size(); i++)
+            {
+                msg_t msg = headers[i];
+                msg.pData = buffer.data();
+                memcpy(buffer.data(), packed[i].data(), packed[i].size());
+                Bench_Decompress(iCase, *pAdaptive, corpus[i], msg, decoded.data());
+                nSink += msg.nCursize;
+            }
+        }
+        double flDecompress = Bench_Seconds() - flStart;
+
+        Bench_AddResult(results, "compress", s_pszCompressCases[iCase][0], "corpus", flCompress, flOps, flBytes,
+                        flRatio);
+        Bench_AddResult(results, "compress", s_pszCompressCases[iCase][1], "corpus", flDecompress, flOps, flBytes,
+                        flRatio);
+    }
+
+    delete pAdaptive;
+    return true;
+}
+
+static void Bench_WriteJSON(FILE *f, const std::vector<msgbenchresult_t> &results, const char *pszCorpus,
+                            const std::vector<std::vector<ubyte>> &corpus, int nIterations)
+{
+    size_t nBytes = 0;
+    for (size_t i = 0; i < corpus.size(); i++)
+        nBytes += corpus[i].size();
+
+    fprintf(f, "{\n  \"benchmark\": \"msgbench\",\n  \"corpus\": \"%s\",\n  \"packets\": %d,\n  \"bytes\": %llu,\n",
+            pszCorpus ? pszCorpus : "synthetic", (int)corpus.size(), (unsigned long long)nBytes);
+    fprintf(f, "  \"iterations\": %d,\n  \"results\": [\n", nIterations);
+    for (size_t i = 0; i < results.size(); i++)
+    {
+        const msgbenchresult_t &result = results[i];
+        fprintf(f,
+                "    {\"group\": \"%s\", \"case\": \"%s\", \"mode\": \"%s\", \"ns_per_op\": %.3f, "
+                "\"mb_per_sec\": %.1f, \"ratio\": %.4f}%s\n",
+                result.m_pszGroup, result.m_szCase, result.m_pszMode, result.m_flNsPerOp, result.m_flMBps,
+                result.m_flRatio, i + 1 < results.size() ? "," : "");
+    }
+    fprintf(f, "  ]\n}\n");
+}
+
+int main(int argc, char **argv)
+{
+    const char *pszCorpus = NULL;
+    const char *pszOutput = NULL;
+    int nPackets = MSGBENCH_DEFAULT_PACKETS;
+    int nIterations = MSGBENCH_DEFAULT_ITERATIONS;
+    uint32 iSeed = 1;
+
+    for (int i = 1; i + 1 < argc; i += 2)
+    {
+        if (!strcmp(argv[i], "-corpus"))
+            pszCorpus = argv[i + 1];
+        else if (!strcmp(argv[i], "-packets"))
+            nPackets = atoi(argv[i + 1]);
+        else if (!strcmp(argv[i], "-iterations"))
+            nIterations = atoi(argv[i + 1]);
+        else if (!strcmp(argv[i], "-seed"))
+            iSeed = (uint32)atoi(argv[i + 1]);
+        else if (!strcmp(argv[i], "-out"))
+            pszOutput = argv[i + 1];
+    }
+
+    std::vector<std::vector<ubyte>> corpus;
+    if (pszCorpus)
+    {
+        if (!Bench_ReadCorpus(pszCorpus, corpus) || corpus.empty())
+        {
+            fprintf(stderr, "msgbench: can't read corpus %s\n", pszCorpus);
+            return 1;
+        }
+    }
+    else
+    {
+        std::mt19937 random(iSeed);
+        corpus.resize(Max(nPackets, 1));
+        for (size_t i = 0; i < corpus.size(); i++)
+            Bench_MakePacket(corpus[i], random, 1000 + (int)i);
+    }
+
+    msgbenchvalues_t *pValues = new msgbenchvalues_t;
+    Bench_MakeValues(*pValues, iSeed);
+
+    std::vector<msgbenchresult_t> results;
+    bool bOk = Bench_Primitives(results, *pValues, nIterations) && Bench_Package(results, *pValues, nIterations) &&
+               Bench_Corpus(results, corpus, nIterations);
+    delete pValues;
+    if (!bOk)
+        return 1;
+
+    FILE *f = pszOutput ? fopen(pszOutput, "w") : stdout;
+    if (!f)
+        return 1;
+
+    Bench_WriteJSON(f, results, pszCorpus, corpus, nIterations);
+    if (f != stdout)
+        fclose(f);
+    return 0;
+}